@@ -0,0 +1,199 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Open-addressing hash map for integer and pointer keys: Robin Hood linear
+// probing over one array of entries plus one byte of probe distance per
+// slot, so a lookup is a hash, a short scan of adjacent bytes and one entry
+// compare, with no per-entry allocation.
+//
+// Unlike std::unordered_map, any insert or erase may move entries: do not
+// hold references, pointers or iterators across them. V must be default
+// constructible and movable.
+template <typename K, typename V>
+class FlatMap {
+  static_assert(std::is_integral_v<K> || std::is_pointer_v<K>,
+                "FlatMap keys are integers or pointers");
+
+public:
+  using value_type = std::pair<K, V>;
+
+  template <bool Const>
+  class Iter {
+  public:
+    using Map = std::conditional_t<Const, const FlatMap, FlatMap>;
+    using Ref = std::conditional_t<Const, const value_type&, value_type&>;
+
+    Iter(Map* map, size_t i) : map_(map), i_(i) { skip(); }
+
+    Ref operator*() const { return map_->slots_[i_]; }
+    auto* operator->() const { return &map_->slots_[i_]; }
+    Iter& operator++() {
+      ++i_;
+      skip();
+      return *this;
+    }
+    bool operator==(const Iter& o) const { return i_ == o.i_; }
+
+  private:
+    void skip() {
+      while (i_ < map_->dist_.size() && map_->dist_[i_] == 0) ++i_;
+    }
+
+    Map* map_;
+    size_t i_;
+  };
+  using iterator       = Iter<false>;
+  using const_iterator = Iter<true>;
+
+  iterator begin() { return {this, 0}; }
+  iterator end() { return {this, capacity()}; }
+  const_iterator begin() const { return {this, 0}; }
+  const_iterator end() const { return {this, capacity()}; }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  size_t capacity() const { return dist_.size(); }
+  size_t memory_bytes() const {
+    return capacity() * (sizeof(value_type) + sizeof(uint8_t));
+  }
+
+  // Room for `n` entries without rehashing.
+  void reserve(size_t n) {
+    const size_t want = std::bit_ceil(std::max(MIN_CAPACITY, n * 8 / 7 + 1));
+    if (want > capacity()) rehash(want);
+  }
+
+  void clear() {
+    for (size_t i = 0; i < capacity(); ++i) {
+      if (dist_[i] == 0) continue;
+      slots_[i] = value_type{};
+      dist_[i]  = 0;
+    }
+    size_ = 0;
+  }
+
+  iterator find(K key) { return {this, locate(key)}; }
+  const_iterator find(K key) const { return {this, locate(key)}; }
+  bool contains(K key) const { return locate(key) != capacity(); }
+  size_t count(K key) const { return contains(key) ? 1 : 0; }
+
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(K key, Args&&... args) {
+    if (const size_t i = locate(key); i != capacity())
+      return {{this, i}, false};
+    if ((size_ + 1) * 8 > capacity() * 7)
+      rehash(std::max(MIN_CAPACITY, capacity() * 2));
+    const size_t i =
+      insert_new(value_type(key, V(std::forward<Args>(args)...)));
+    return {{this, i}, true};
+  }
+
+  std::pair<iterator, bool> emplace(K key, V value) {
+    return try_emplace(key, std::move(value));
+  }
+
+  V& operator[](K key) { return try_emplace(key).first->second; }
+
+  size_t erase(K key) {
+    size_t i = locate(key);
+    if (i == capacity()) return 0;
+    // Backward-shift deletion: pull the rest of the cluster one slot closer
+    // to home, so no tombstones are needed.
+    for (;;) {
+      const size_t next = (i + 1) & mask_;
+      if (dist_[next] <= 1) break;
+      slots_[i] = std::move(slots_[next]);
+      dist_[i]  = static_cast<uint8_t>(dist_[next] - 1);
+      i         = next;
+    }
+    slots_[i] = value_type{};
+    dist_[i]  = 0;
+    --size_;
+    return 1;
+  }
+
+private:
+  static constexpr size_t MIN_CAPACITY = 16;
+  static constexpr uint32_t MAX_DIST   = UINT8_MAX;
+
+  // Fibonacci hashing: the top bits of key * 2^64/phi. Aligned addresses
+  // (all low bits zero) still spread over the whole table.
+  size_t home(K key) const {
+    uint64_t k = 0;
+    if constexpr (std::is_pointer_v<K>)
+      k = reinterpret_cast<uintptr_t>(key);
+    else
+      k = static_cast<uint64_t>(key);
+    return static_cast<size_t>((k * 0x9e3779b97f4a7c15ULL) >> shift_);
+  }
+
+  // Slot of `key`, or capacity() when absent.
+  size_t locate(K key) const {
+    if (size_ == 0) return capacity();
+    size_t i = home(key);
+    for (uint32_t d = 1;; ++d) {
+      // An empty slot or an entry closer to its home than we are to ours:
+      // with Robin Hood ordering the key cannot be further along.
+      if (dist_[i] < d) return capacity();
+      if (dist_[i] == d && slots_[i].first == key) return i;
+      i = (i + 1) & mask_;
+    }
+  }
+
+  // Places an entry whose key is absent; returns its slot.
+  size_t insert_new(value_type entry) {
+    const K key = entry.first;
+    size_t at   = capacity();
+    size_t i    = home(key);
+    uint32_t d  = 1;
+    for (;;) {
+      if (dist_[i] == 0) {
+        slots_[i] = std::move(entry);
+        dist_[i]  = static_cast<uint8_t>(d);
+        ++size_;
+        return at == capacity() ? i : at;
+      }
+      // Take the slot from a richer entry and carry that one on.
+      if (dist_[i] < d) {
+        std::swap(slots_[i], entry);
+        const uint32_t displaced = dist_[i];
+        dist_[i]                 = static_cast<uint8_t>(d);
+        d                        = displaced;
+        if (at == capacity()) at = i;
+      }
+      i = (i + 1) & mask_;
+      if (++d > MAX_DIST) {
+        // Pathological cluster: grow and place whatever entry is in hand.
+        rehash(capacity() * 2);
+        insert_new(std::move(entry));
+        return locate(key);
+      }
+    }
+  }
+
+  void rehash(size_t cap) {
+    auto old_slots = std::move(slots_);
+    auto old_dist  = std::move(dist_);
+    slots_         = std::vector<value_type>(cap);
+    dist_.assign(cap, 0);
+    mask_  = cap - 1;
+    shift_ = 64 - static_cast<unsigned>(std::countr_zero(cap));
+    size_  = 0;
+    for (size_t i = 0; i < old_dist.size(); ++i) {
+      if (old_dist[i] != 0) insert_new(std::move(old_slots[i]));
+    }
+  }
+
+  std::vector<value_type> slots_;
+  std::vector<uint8_t> dist_;  // 0: empty, else probe distance + 1
+  size_t size_    = 0;
+  size_t mask_    = 0;
+  unsigned shift_ = 64;
+};
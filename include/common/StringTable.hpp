@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Interns strings into dense 32-bit ids. Id 0 is always the empty string.
+class StringTable {
+public:
+  StringTable() { intern({}); }
+
+  // The index keys on views into strings_, so copies would dangle. Moves keep
+  // the deque's nodes and are fine.
+  StringTable(const StringTable&)            = delete;
+  StringTable& operator=(const StringTable&) = delete;
+  StringTable(StringTable&&)                 = default;
+  StringTable& operator=(StringTable&&)      = default;
+
+  uint32_t intern(std::string_view s) {
+    auto it = ids_.find(s);
+    if (it != ids_.end()) return it->second;
+    const auto id = static_cast<uint32_t>(strings_.size());
+    // deque never relocates elements, so the map can key on views of them.
+    ids_.emplace(strings_.emplace_back(s), id);
+    return id;
+  }
+
+  const std::string& get(uint32_t id) const { return strings_[id]; }
+  size_t size() const { return strings_.size(); }
+
+  size_t memory_bytes() const {
+    size_t bytes = strings_.size() * sizeof(std::string) +
+                   ids_.size() * (sizeof(std::string_view) + sizeof(uint32_t) +
+                                  2 * sizeof(void*));
+    for (const auto& s : strings_) bytes += s.capacity();
+    return bytes;
+  }
+
+private:
+  std::deque<std::string> strings_;
+  std::unordered_map<std::string_view, uint32_t> ids_;
+};
@@ -1,8 +1,10 @@
 #pragma once
 #include <libdwarf/libdwarf.h>
 
+#include <array>
 #include <cstdint>
 #include <format>
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -11,6 +13,7 @@ using std::string, std::vector;
 // Forward declarations (this solves the cycle)
 struct FieldInfo;
 struct TypeInfo;
+struct Mapping;
 
 enum class TypeKind {
   Primitive,
@@ -39,7 +42,7 @@ struct TypeInfo {
   TypeInfo* element = nullptr;
   size_t array_len  = 0;
 
-  vector<TypeInfo*> bases;
+  vector<FieldInfo*> bases;  // base class subobjects, named after the base
   vector<FieldInfo*> fields;
 
   // Flags
@@ -53,8 +56,10 @@ struct TypeInfo {
 
 struct FieldInfo {
   string name;
-  size_t offset;
-  size_t size;
+  size_t offset;  // bytes; a bitfield's first byte
+  size_t size;    // bytes; those a bitfield spans
+  // Bitfields only: width, and the first bit within the byte at `offset`
+  // counted from the least significant.
   Dwarf_Unsigned bit_size   = 0;
   Dwarf_Unsigned bit_offset = 0;
 
@@ -75,10 +80,40 @@ struct StackFrameEvent {
   uint32_t pid;
   uint32_t tid;
 };
+// How far a cache line travels when it moves from one CPU to another.
+enum class CpuDistance : uint8_t {
+  SAME_CPU,
+  SMT,           // hyperthread sibling, same core
+  SHARED_CACHE,  // other core under the same last-level cache
+  CROSS_CACHE,   // same package and node, different last-level cache
+  CROSS_NODE,    // other NUMA node or socket
+  UNKNOWN,       // a CPU the topology does not describe
+};
+inline constexpr size_t CPU_DISTANCES = 6;
+
+// What kind of sharing makes a cache line hot, in report order.
+enum class SharingClass : uint8_t {
+  FALSE_SHARING,  // threads write different words of the line
+  TRUE_SHARING,   // threads contend for the same word
+  READ_MOSTLY,    // readers' data polluted by a rarely written neighbour
+  HANDOFF,        // one thread writes what a single other thread reads
+  PRIVATE,        // one thread, or threads that rarely take turns
+};
+inline constexpr size_t SHARING_CLASSES = 5;
+
+// A point estimate with its 95% confidence interval.
+struct Estimate {
+  double value{};
+  double low{};
+  double high{};
+};
+
 struct CacheLine {
   uint64_t base_addr{};
-  std::vector<uint32_t> tids;
-  std::vector<uint64_t> addrs;
+  uint64_t offset_mask{};  // bit i: some sample touched base_addr + i
+  size_t thread_count{};
+  bool thread_overflow{};      // too many threads to track each one
+  std::vector<uint32_t> tids;  // the threads tracked, in first-touch order
   size_t sample_count{};
   size_t sample_reads{};
   size_t sample_writes{};
@@ -88,12 +123,62 @@ struct CacheLine {
   size_t thread_switches{};
   double bounce_score{};
 
+  // Consecutive samples from different CPUs, by how far the line moved, and
+  // their estimated cost in cycles under the CPU topology.
+  std::array<size_t, CPU_DISTANCES> transitions{};
+  double coherence_cycles{};
+
   // Offset overlap heuristic: false sharing often looks like different threads
   // repeatedly touching different offsets within the same cache line.
   size_t shared_offset_count{};  // offsets touched by >=2 threads
   size_t total_offset_count{};   // distinct offsets touched by any thread
   size_t unique_top_offsets{};   // distinct "most frequent" offsets per thread
   double private_offset_fraction{};  // 1 - shared/total
+
+  // Read/write split by thread: how many tracked threads stored to the line,
+  // the offsets they stored to, and the offsets touched by threads that only
+  // loaded. Stores from threads beyond the tracked ones are not attributed.
+  size_t writer_count{};
+  uint64_t write_mask{};
+  uint64_t reader_mask{};
+  SharingClass sharing{};
+
+  // Confidence intervals of the sampled metrics, in samples: the sample
+  // count, bounce_score and coherence_cycles. Multiply counts by the sample
+  // period for real events.
+  Estimate samples_ci;
+  Estimate bounce_ci;
+  Estimate cycles_ci;
+
+  // Threads writing the other half of this line's 128-byte pair but not
+  // this line: with the adjacent-line prefetcher they keep bouncing the pair
+  // even after this line is padded to 64 bytes.
+  std::vector<uint32_t> adjacent_tids;
+
+  // Module the line belongs to: the file its data is mapped from (globals),
+  // else the one whose code touched it most (heap/stack data).
+  std::string module;
+};
+
+// A 128-byte aligned pair of cache lines. Intel's adjacent-line prefetcher
+// fetches both halves together, so threads writing different halves bounce
+// the pair even when each 64-byte line has a single writer.
+struct CacheLinePair {
+  uint64_t base_addr{};
+  size_t sample_count{};
+  std::array<size_t, 2> half_samples{};
+  std::array<size_t, 2> half_writes{};
+  // Per half: the threads that wrote it, or that touched it when the event
+  // source has no store info.
+  std::array<std::vector<uint32_t>, 2> half_tids;
+  bool split_writers{};  // the two halves have different writers
+
+  size_t thread_switches{};
+  double bounce_score{};
+  // Consecutive touches by different threads on different halves: the
+  // traffic a 64-byte view cannot see.
+  size_t cross_switches{};
+  double cross_bounce{};
 };
 
 struct DwarfStackObject {
@@ -120,22 +205,50 @@ struct RuntimeStackObject {
   uint64_t pid;
 };
 
-enum class SampleType {
+enum class SampleType : uint8_t {
   CACHE_LOAD,
   CACHE_STORE,
 };
+
+// x86-64 DWARF register numbers of the general-purpose registers. The IP
+// (DWARF 16) is PerfSample::ip.
+enum DwarfReg : unsigned {
+  DWARF_RAX,
+  DWARF_RDX,
+  DWARF_RCX,
+  DWARF_RBX,
+  DWARF_RSI,
+  DWARF_RDI,
+  DWARF_RBP,
+  DWARF_RSP,
+  DWARF_R8,
+  DWARF_R15 = DWARF_R8 + 7,
+  DWARF_RIP,
+};
+
+// Sampled user general-purpose registers by DWARF number; which ones were
+// sampled is PerfSample::regs_mask.
+using UserRegs = std::array<uint64_t, DWARF_R15 + 1>;
+
 struct PerfSample {
   uint32_t tid;
   uint32_t pid;
   uint32_t cpu;
   uint64_t ip;
   uint64_t addr;
-  uint64_t sp{};  // sampled user stack pointer (perf --user-regs=sp)
-  uint64_t bp{};  // sampled user frame pointer (perf --user-regs=bp)
+  uint64_t sp{};         // sampled user stack pointer (perf --user-regs=sp)
+  uint64_t bp{};         // sampled user frame pointer (perf --user-regs=bp)
+  UserRegs regs{};       // every sampled register, sp and bp included
+  uint32_t regs_mask{};  // bit n: DWARF register n was sampled
   uint64_t time_stamp{};
   SampleType event_type;
   std::string symbol;
   std::string dso;
+  uint32_t ip_map{};    // AddressSpace mapping ids, 0 when unmapped/unknown
+  uint32_t addr_map{};
+  // ip_map's mapping, set by readers for their consumer and only valid
+  // during that call.
+  const Mapping* ip_mapping{};
 
   friend std::ostream& operator<<(std::ostream& os, const PerfSample& s) {
     return os << std::format(
@@ -147,6 +260,10 @@ struct PerfSample {
   }
 };
 
+// Receives samples one at a time as a reader decodes them. The sample is only
+// valid for the duration of the call.
+using SampleConsumer = std::function<void(const PerfSample&)>;
+
 struct ResolvedVariable {
   std::string name;
   std::string type_name;
@@ -159,5 +276,5 @@ struct ResolvedVariable {
 struct StaticRange {
   uint64_t start;
   uint64_t end;
-  DwarfGlobalObject* obj;
+  const DwarfGlobalObject* obj;
 };
@@ -1 +1,32 @@
-// TODO: Fill this file with useful helper functions used in multiple locations
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <format>
+#include <optional>
+#include <string>
+#include <string_view>
+
+inline std::string_view trim(std::string_view sv) {
+  auto b = sv.find_first_not_of(" \t\n");
+  auto e = sv.find_last_not_of(" \t\n");
+  if (b == std::string_view::npos) return {};
+  return sv.substr(b, e - b + 1);
+}
+
+inline std::optional<uint64_t> parse_hex_u64(std::string_view sv) {
+  sv = trim(sv);
+  if (sv.starts_with("0x")) sv.remove_prefix(2);
+  uint64_t v     = 0;
+  auto [ptr, ec] = std::from_chars(sv.data(), sv.data() + sv.size(), v, 16);
+  if (ec != std::errc{} || ptr == sv.data()) return std::nullopt;
+  return v;
+}
+
+// 1234567 -> "1.2M", for estimated event counts.
+inline std::string format_count(double v) {
+  if (v < 1e3) return std::format("{:.0f}", v);
+  if (v < 1e6) return std::format("{:.1f}K", v / 1e3);
+  if (v < 1e9) return std::format("{:.1f}M", v / 1e6);
+  return std::format("{:.1f}G", v / 1e9);
+}
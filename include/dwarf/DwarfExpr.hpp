@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+
+// Stack machine for DWARF expressions that compute a value from registers,
+// such as DW_CFA_def_cfa_expression rules (PLT stubs, realigned frames).
+// Covers the constant, stack, arithmetic, comparison, branch and DW_OP_breg
+// operations. Operations that need target memory (DW_OP_deref) or name a
+// location rather than a value (DW_OP_reg) fail the evaluation, as does
+// malformed input.
+class DwarfExpr {
+public:
+  // Value of DWARF register `n`, or nullopt when it was not sampled.
+  using RegReader = std::function<std::optional<uint64_t>(unsigned n)>;
+
+  // Top of the stack once `expr` has run. `initial` is pushed first
+  // (DW_CFA_expression register rules start with the CFA on the stack).
+  static std::optional<uint64_t> evaluate(
+    std::span<const uint8_t> expr, const RegReader& reg,
+    std::optional<uint64_t> initial = std::nullopt);
+
+  // Registers `expr` reads through DW_OP_breg*, bit n for register n < 32,
+  // so a caller knows what to keep before evaluating it.
+  static uint32_t registers(std::span<const uint8_t> expr);
+
+  static constexpr size_t MAX_STACK = 64;
+  static constexpr size_t MAX_STEPS = 1024;  // bounds DW_OP_skip/bra loops
+};
@@ -5,10 +5,10 @@
 
 #include <memory>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
 #include "DwarfContext.hpp"
+#include "common/FlatMap.hpp"
 #include "common/Registry.hpp"
 #include "common/Types.hpp"
 
@@ -19,8 +19,7 @@ public:
   void create_registry();
 
   const Registry<std::string, StructInfo>& get_registry() const;
-  const std::unordered_map<Dwarf_Off, std::unique_ptr<TypeInfo>>& get_types()
-    const;
+  const FlatMap<Dwarf_Off, std::unique_ptr<TypeInfo>>& get_types() const;
   const std::vector<std::unique_ptr<FieldInfo>>& get_owned_fields() const;
 
   const std::vector<DwarfStackObject>& get_stack_objects() const;
@@ -41,7 +40,7 @@ private:
   DwarfContext context;
   Registry<std::string, StructInfo> registry;
 
-  std::unordered_map<Dwarf_Off, std::unique_ptr<TypeInfo>> types;
+  FlatMap<Dwarf_Off, std::unique_ptr<TypeInfo>> types;
   std::vector<std::unique_ptr<FieldInfo>> owned_fields;
   std::vector<DwarfStackObject> stack_objects;
   std::vector<DwarfGlobalObject> global_objects;
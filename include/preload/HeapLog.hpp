@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+
+// Binary log shared by the heap tracer preload library and
+// AllocationTracker: HEAP_LOG_MAGIC, then HeapEvent records. Every thread
+// appends whole batches of its own events, so the file is in time order
+// per thread only. Plain data only: the tracer cannot use the C++ runtime
+// inside malloc.
+inline constexpr char HEAP_LOG_MAGIC[8] = {'C', 'S', 'H', 'E',
+                                           'A', 'P', '1', '\0'};
+
+// The environment variable naming the log to append to. The tracer is
+// inert without it.
+inline constexpr const char* HEAP_LOG_ENV = "CACHESCOPE_HEAP_LOG";
+
+enum class HeapEventKind : uint32_t {
+  ALLOC,
+  FREE,
+  START,  // the process (re)started its heap: exec after a traced image
+};
+
+struct HeapEvent {
+  uint64_t time;  // CLOCK_MONOTONIC, ns
+  uint64_t addr;
+  uint64_t size;  // ALLOC: bytes requested
+  uint64_t site;  // return address of the allocation call
+  uint32_t pid;
+  uint32_t tid;
+  HeapEventKind kind;
+  uint32_t reserved;
+};
+static_assert(sizeof(HeapEvent) == 48, "HeapEvent is a file format");
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// One mmap of a file (or anonymous region) into a process.
+struct Mapping {
+  uint32_t pid   = 0;
+  uint64_t start = 0;
+  uint64_t end   = 0;  // exclusive
+  uint64_t pgoff = 0;  // file offset of `start`
+  std::string path;
+  std::string build_id;  // hex, empty when the record did not carry one
+
+  uint64_t file_offset(uint64_t addr) const { return addr - start + pgoff; }
+
+  // False for anonymous and pseudo mappings ([heap], [stack], [vdso], //anon).
+  bool file_backed() const {
+    return !path.empty() && path.front() != '[' && !path.starts_with("//");
+  }
+};
+
+// Every mapping of every process seen in a recording, built from MMAP/MMAP2
+// (and /proc/<pid>/maps when attaching) in the order the kernel reported
+// them. Each process has an interval table sorted by start address, so an
+// address resolves in O(log n) against the mappings live at that moment.
+// Mappings get stable ids: a sample resolved to an id keeps pointing at the
+// right file and offset even if the range is later unmapped or replaced.
+class AddressSpace {
+public:
+  static constexpr uint32_t NONE       = 0;
+  static constexpr uint32_t KERNEL_PID = static_cast<uint32_t>(-1);
+
+  using Intervals = std::map<uint64_t, uint32_t>;  // start -> mapping id
+
+  // Maps [start, start + len) in `pid`, replacing whatever it overlaps
+  // (mremap/MAP_FIXED) while keeping the non-overlapping head and tail of
+  // older mappings. Returns the new mapping's id, or NONE when len is 0.
+  uint32_t map(uint32_t pid, uint64_t start, uint64_t len, uint64_t pgoff,
+               std::string path, std::string build_id = {});
+
+  // exec(): the process starts over with an empty address space.
+  void clear(uint32_t pid);
+
+  // fork(): the child starts with a copy of the parent's mappings.
+  void fork(uint32_t parent, uint32_t child);
+
+  // Id of the mapping that currently covers `addr` in `pid`, or NONE.
+  uint32_t resolve(uint32_t pid, uint64_t addr) const;
+
+  const Mapping& get(uint32_t id) const { return mappings_[id - 1]; }
+  size_t size() const { return mappings_.size(); }
+
+  // Load address of the image in `pid` whose path contains `name`: the
+  // mapping at file offset 0, or the lowest one if none starts there.
+  std::optional<uint64_t> image_base(uint32_t pid, std::string_view name) const;
+
+  // Raw state, for SampleCache.
+  const std::vector<Mapping>& mappings() const { return mappings_; }
+  const std::unordered_map<uint32_t, Intervals>& live() const { return live_; }
+  void restore(std::vector<Mapping> mappings,
+               std::unordered_map<uint32_t, Intervals> live);
+
+private:
+  uint32_t add(Mapping m);
+
+  std::vector<Mapping> mappings_;  // id - 1 -> mapping, never shrinks
+  std::unordered_map<uint32_t, Intervals> live_;  // currently mapped, per pid
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// One heap block from the heap tracer log, with its lifetime.
+struct Allocation {
+  static constexpr uint64_t LIVE = std::numeric_limits<uint64_t>::max();
+
+  uint64_t addr       = 0;
+  uint64_t size       = 0;
+  uint64_t site       = 0;  // return address of the allocation call
+  uint64_t alloc_time = 0;
+  uint64_t free_time  = LIVE;  // never freed while traced
+  uint32_t pid        = 0;
+  uint32_t tid        = 0;
+};
+
+// The heap blocks of a recording, from the log the heap tracer preload
+// library (libcachescope_heap.so) wrote: maps a sampled data address to the
+// allocation that was live at that address when it was sampled.
+//
+// Queries replay the allocations and frees up to the sample's time into a
+// per-process interval map of live blocks, so a pass over time-ordered
+// samples costs O(log live blocks) per sample. Timestamps must come from
+// the same clock as the samples' (CLOCK_MONOTONIC).
+class AllocationTracker {
+public:
+  // Reads a heap tracer log. Throws std::runtime_error when the file cannot
+  // be read or is not a heap log.
+  static AllocationTracker load(const std::string& path);
+
+  // Block of `pid` that contained `addr` at `time`, or nullptr. Going back
+  // in time restarts the replay from the beginning.
+  const Allocation* find(uint32_t pid, uint64_t addr, uint64_t time);
+
+  // Every block, by allocation time.
+  const std::vector<Allocation>& allocations() const { return allocations_; }
+  size_t events() const { return events_; }
+
+private:
+  using Key = std::pair<uint32_t, uint64_t>;  // pid, addr
+
+  void rewind();
+
+  std::vector<Allocation> allocations_;
+  std::vector<uint32_t> by_free_;  // freed blocks, by free time
+  size_t events_ = 0;
+
+  // Replay state.
+  std::map<Key, uint32_t> live_;
+  size_t next_alloc_ = 0;
+  size_t next_free_  = 0;
+  uint64_t now_      = 0;
+};
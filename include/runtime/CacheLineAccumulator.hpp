@@ -0,0 +1,127 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "common/FlatMap.hpp"
+#include "common/Types.hpp"
+
+class CpuTopology;
+
+// Streaming per-cache-line aggregation for false-sharing detection. Samples
+// are fed one at a time, in time order, and each line keeps fixed-size state
+// instead of every sample's tid and address:
+//   - read/write/sample counters,
+//   - the last tid, for counting thread switches,
+//   - the last CPU and CPU-to-CPU transitions per CpuDistance class,
+//   - per thread: a 64-bit mask of the offsets it touched, whether it
+//     stored, and a two-entry space-saving counter of its most frequent
+//     offset,
+//   - a mask of the offsets stored to.
+// Threads are tracked exactly up to THREAD_SLOTS per line (two inline, the
+// rest in a side block allocated when a third thread shows up). Further
+// threads only add to an overflow mask whose offsets count as shared.
+class CacheLineAccumulator {
+public:
+  static constexpr size_t LINE_SIZE    = 64;
+  static constexpr size_t THREAD_SLOTS = 8;
+
+  // Without a topology every move between two CPUs is UNKNOWN distance.
+  explicit CacheLineAccumulator(const CpuTopology* topology = nullptr)
+      : topology_(topology) {}
+
+  void add(uint64_t addr, uint32_t tid, uint32_t cpu, SampleType type);
+
+  size_t size() const { return lines_.size(); }
+  size_t memory_bytes() const;
+  // Whether any sample was a store; event sources without store info
+  // (e.g. AMD IBS loads only) never report one.
+  bool saw_stores() const { return saw_stores_; }
+
+  // Metrics of every line with at least `min_samples` samples, unordered.
+  std::vector<CacheLine> finish(size_t min_samples) const;
+
+private:
+  struct ThreadSlot {
+    uint64_t offsets = 0;  // bit i: offset i touched
+    uint32_t tid     = 0;
+    std::array<uint32_t, 2> top_count{};
+    std::array<uint8_t, 2> top_offset{};
+  };
+  using ExtraSlots = std::array<ThreadSlot, THREAD_SLOTS - 2>;
+
+  static constexpr uint32_t NO_EXTRA = UINT32_MAX;
+
+  struct LineState {
+    uint32_t samples          = 0;
+    uint32_t reads            = 0;
+    uint32_t writes           = 0;
+    uint32_t switches         = 0;
+    uint32_t last_tid         = 0;
+    uint32_t last_cpu         = 0;
+    uint32_t extra            = NO_EXTRA;  // index into extra_
+    uint8_t threads           = 0;         // slots in use
+    uint8_t wrote             = 0;         // bit i: slot i stored
+    bool overflow             = false;     // more than THREAD_SLOTS threads
+    uint64_t overflow_offsets = 0;
+    uint64_t write_offsets    = 0;
+    std::array<ThreadSlot, 2> slots{};
+    std::array<uint32_t, CPU_DISTANCES> transitions{};
+  };
+
+  // Slot index of `tid`, claiming a free one; THREAD_SLOTS when all are
+  // taken by other threads.
+  size_t slot_for(LineState& line, uint32_t tid);
+  ThreadSlot& slot(LineState& line, size_t i);
+  const ThreadSlot& slot(const LineState& line, size_t i) const;
+  CacheLine metrics(uint64_t base, const LineState& line) const;
+
+  const CpuTopology* topology_;
+  FlatMap<uint64_t, LineState> lines_;
+  std::vector<ExtraSlots> extra_;
+  bool saw_stores_ = false;
+};
+
+// The same streaming aggregation at 128-byte pair granularity, for the
+// adjacent-line prefetcher. Each half keeps its sample and write counts and
+// up to HALF_THREADS threads with whether each one wrote.
+class CacheLinePairAccumulator {
+public:
+  static constexpr size_t PAIR_SIZE    = 2 * CacheLineAccumulator::LINE_SIZE;
+  static constexpr size_t HALF_THREADS = 4;
+
+  void add(uint64_t addr, uint32_t tid, SampleType type);
+
+  size_t size() const { return pairs_.size(); }
+
+  // Metrics of every pair with at least `min_samples` samples, unordered.
+  std::vector<CacheLinePair> finish(size_t min_samples) const;
+  // Metrics of the pair at 128-byte aligned `base`, if it was touched.
+  std::optional<CacheLinePair> find(uint64_t base) const;
+
+private:
+  struct Half {
+    uint32_t samples = 0;
+    uint32_t writes  = 0;
+    std::array<uint32_t, HALF_THREADS> tids{};
+    uint8_t threads = 0;
+    uint8_t wrote   = 0;  // bit i: tids[i] wrote this half
+    bool overflow   = false;
+  };
+
+  struct PairState {
+    uint32_t samples        = 0;
+    uint32_t switches       = 0;
+    uint32_t cross_switches = 0;
+    uint32_t last_tid       = 0;
+    uint8_t last_half       = 0;
+    std::array<Half, 2> halves{};
+  };
+
+  CacheLinePair metrics(uint64_t base, const PairState& pair) const;
+
+  FlatMap<uint64_t, PairState> pairs_;
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "common/FlatMap.hpp"
+#include "common/Types.hpp"
+
+class CpuTopology;
+
+// Fixed-memory stand-in for CacheLineAccumulator on captures too long for
+// exact per-line state. A Space-Saving heavy-hitters summary keeps the
+// `capacity()` most sampled lines: a new line evicts the least counted one
+// and inherits its count as error. Any line with more than
+// samples() / capacity() samples is guaranteed to be tracked, and every
+// count overestimates by at most that much.
+//
+// While a line is tracked it keeps exact read/write/switch counters, CPU
+// transitions and offset masks, a HyperLogLog of its distinct threads and a
+// reservoir of touches from which the per-thread offset and writer
+// statistics are estimated.
+class CacheLineSketch {
+public:
+  static constexpr size_t LINE_SIZE      = 64;
+  static constexpr size_t HLL_REGISTERS  = 32;
+  static constexpr size_t RESERVOIR_SIZE = 16;
+  static constexpr size_t DEFAULT_MEMORY = size_t{64} << 20;
+  static constexpr size_t MIN_CAPACITY   = 16;
+
+  // Tracks as many lines as fit in `memory_bytes`, and at least
+  // MIN_CAPACITY.
+  explicit CacheLineSketch(size_t memory_bytes = DEFAULT_MEMORY,
+                           const CpuTopology* topology = nullptr);
+
+  void add(uint64_t addr, uint32_t tid, uint32_t cpu, SampleType type);
+
+  size_t capacity() const { return capacity_; }
+  size_t size() const { return entries_.size(); }
+  uint64_t samples() const { return samples_; }
+  size_t memory_bytes() const;
+  bool saw_stores() const { return saw_stores_; }
+
+  // Most a reported count can exceed the true one by.
+  uint64_t max_count_error() const { return samples_ / capacity_; }
+  // Relative standard error of the thread counts.
+  static double thread_count_error();
+
+  // Metrics of every tracked line whose count may reach `min_samples`,
+  // unordered. sample_count is the guaranteed part: samples seen since the
+  // line was last taken over.
+  std::vector<CacheLine> finish(size_t min_samples) const;
+
+private:
+  struct Touch {
+    uint32_t tid = 0;
+    uint8_t off  = 0;
+    bool store   = false;
+  };
+
+  struct Entry {
+    uint64_t base          = 0;
+    uint64_t count         = 0;  // estimate, >= the true count
+    uint64_t error         = 0;  // count inherited on takeover
+    uint32_t reads         = 0;
+    uint32_t writes        = 0;
+    uint32_t switches      = 0;
+    uint32_t last_tid      = 0;
+    uint32_t last_cpu      = 0;
+    uint32_t heap_pos      = 0;
+    uint64_t offsets       = 0;
+    uint64_t write_offsets = 0;
+    std::array<uint32_t, CPU_DISTANCES> transitions{};
+    std::array<uint8_t, HLL_REGISTERS> hll{};
+    std::array<Touch, RESERVOIR_SIZE> reservoir{};
+  };
+
+  void reset(Entry& e, uint64_t base);
+  void sift_up(size_t pos);
+  void sift_down(size_t pos);
+  void swap_heap(size_t a, size_t b);
+  static double hll_estimate(const std::array<uint8_t, HLL_REGISTERS>& hll);
+  CacheLine metrics(const Entry& e) const;
+
+  const CpuTopology* topology_;
+  size_t capacity_;
+  uint64_t samples_ = 0;
+  bool saw_stores_  = false;
+  std::vector<Entry> entries_;
+  std::vector<uint32_t> heap_;  // entry indices, min-heap by count
+  FlatMap<uint64_t, uint32_t> index_;
+};
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+
+#include "common/Types.hpp"
+#include "runtime/ModuleSet.hpp"
+
+// Which sampled registers beyond sp, bp and ip the CFA rule at a sample's IP
+// reads, decided while samples stream in so a SampleStore keeps only those.
+// Modules come from the ModuleSet stack attribution uses later, so each
+// module's CFI is read and expanded once; its DWARF still waits for load().
+class CfaRegisters {
+public:
+  explicit CfaRegisters(ModuleSet& modules) : modules_(modules) {}
+
+  // Bit n for DWARF register n. 0 when the sample has no mapping (a reader
+  // only sets PerfSample::ip_mapping during its consumer call), its module
+  // has no CFI, or the rule only reads sp, bp or ip.
+  uint32_t needed(const PerfSample& s) const;
+
+private:
+  ModuleSet& modules_;
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <libdwarf/libdwarf.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "common/FlatMap.hpp"
+
+// How to compute the CFA at one PC: register + offset, as nearly every row
+// of compiler-generated CFI says, or a DWARF expression (PLT stubs,
+// realigned stack frames).
+struct CfaRule {
+  enum Kind : uint8_t {
+    NONE,        // no CFI covers the PC
+    REGISTER,    // CFA = reg + offset
+    EXPRESSION,  // DW_CFA_def_cfa_expression: CfaTable::expression()
+  };
+
+  Kind kind      = NONE;
+  uint16_t reg   = 0;  // DWARF register number
+  int32_t offset = 0;  // EXPRESSION: index of the expression in the table
+};
+
+// The CFA rule of every PC a module's FDEs cover, expanded once from the
+// CFI into rows sorted by start PC, so a lookup is a binary search instead
+// of an FDE search plus a CFA program run. Lookups are memoized per PC, as
+// samples repeat the same few hot IPs.
+//
+// Without dwarf_get_fde_info_for_cfa_reg3_b the rows cannot be walked; each
+// new PC is then asked from libdwarf and only the memo applies.
+class CfaTable {
+public:
+  CfaTable() = default;
+  // `fdes` stays owned by the caller and must outlive the table.
+  CfaTable(Dwarf_Fde* fdes, Dwarf_Signed count);
+
+  // Rule at link-time address `pc`; kind NONE when no FDE covers it. The
+  // reference is valid until the next call.
+  const CfaRule& at(uint64_t pc);
+
+  // The bytes of an EXPRESSION rule, owned by the CFI's Dwarf_Debug.
+  std::span<const uint8_t> expression(const CfaRule& rule) const {
+    return exprs_[rule.offset];
+  }
+
+  size_t rows() const { return rows_.size(); }
+
+private:
+  struct Row {
+    uint64_t pc = 0;  // first PC the rule applies to, up to the next row
+    CfaRule rule;
+  };
+
+  CfaRule query(uint64_t pc);
+  CfaRule make_rule(Dwarf_Small value_type, Dwarf_Signed regnum,
+                    Dwarf_Signed offset_or_len, Dwarf_Ptr block);
+
+  Dwarf_Fde* fdes_ = nullptr;
+  std::vector<Row> rows_;  // by pc; NONE rows mark gaps between FDEs
+  std::vector<std::span<const uint8_t>> exprs_;
+  FlatMap<const void*, int32_t> expr_ids_;  // by block address
+  FlatMap<uint64_t, CfaRule> memo_;
+};
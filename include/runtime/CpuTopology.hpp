@@ -0,0 +1,59 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "common/Types.hpp"
+
+// Where each CPU sits (core, package, last-level cache, NUMA node) and what
+// a cache line transfer between two CPUs costs, for weighting line bounces
+// by distance: SMT siblings share L1, cross-socket transfers go over the
+// interconnect.
+//
+// File format, one entry per line, '#' starts a comment:
+//   cpu 0 core=0 package=0 llc=0 node=0
+//   cost smt=10 shared-cache=50 cross-cache=120 cross-node=300 unknown=60
+// Omitted fields of a cpu line are unknown; omitted costs keep the defaults.
+class CpuTopology {
+public:
+  struct Cpu {
+    int core    = -1;  // unique across packages
+    int package = -1;
+    int llc     = -1;  // lowest CPU sharing the last-level cache
+    int node    = -1;
+
+    bool known() const {
+      return core >= 0 || package >= 0 || llc >= 0 || node >= 0;
+    }
+  };
+
+  // Rough cycle costs of a line transfer per CpuDistance.
+  static constexpr std::array<uint32_t, CPU_DISTANCES> DEFAULT_COSTS{
+    0, 10, 50, 120, 300, 60};
+
+  // The running machine, from /sys/devices/system/cpu. Empty (every
+  // distance UNKNOWN) when sysfs cannot be read.
+  static CpuTopology from_sysfs(
+    const std::string& root = "/sys/devices/system/cpu");
+  // Throws std::runtime_error on unreadable files and malformed lines.
+  static CpuTopology from_file(const std::string& path);
+
+  CpuDistance distance(uint32_t a, uint32_t b) const;
+  uint32_t cost(CpuDistance d) const {
+    return costs_[static_cast<size_t>(d)];
+  }
+
+  size_t size() const { return cpus_.size(); }
+  bool empty() const { return cpus_.empty(); }
+  const Cpu* cpu(uint32_t n) const {
+    return n < cpus_.size() && cpus_[n].known() ? &cpus_[n] : nullptr;
+  }
+
+  static const char* name(CpuDistance d);
+
+private:
+  std::vector<Cpu> cpus_;  // by CPU number
+  std::array<uint32_t, CPU_DISTANCES> costs_ = DEFAULT_COSTS;
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Function symbols (.symtab, falling back to .dynsym) of one ELF file, used to
+// symbolize raw sample IPs the way `perf script -F sym` would.
+class ElfSymbolTable {
+public:
+  // Never throws: an unreadable or non-ELF file yields an empty table.
+  explicit ElfSymbolTable(const std::string& path);
+
+  // Demangled name of the function containing `file_offset` (an offset into
+  // the ELF file, i.e. `ip - map_start + pgoff`), or nullptr.
+  const std::string* lookup_file_offset(uint64_t file_offset) const;
+
+  // Translates a file offset to the link-time virtual address using the
+  // PT_LOAD program headers.
+  bool file_offset_to_vaddr(uint64_t file_offset, uint64_t& vaddr) const;
+
+  bool empty() const { return symbols.empty(); }
+
+  // Hex GNU build-id from the PT_NOTE segments of `path`, or empty. Only
+  // reads the program headers and notes.
+  static std::string read_build_id(const std::string& path);
+
+private:
+  struct Segment {
+    uint64_t offset;
+    uint64_t filesz;
+    uint64_t vaddr;
+  };
+
+  struct Symbol {
+    uint64_t addr;
+    uint64_t size;
+    uint32_t name;  // index into names
+  };
+
+  std::vector<Segment> segments;
+  std::vector<Symbol> symbols;  // sorted by addr
+  std::vector<std::string> names;
+};
@@ -1,18 +1,86 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 
 #include "common/Types.hpp"
+#include "runtime/CacheLineAccumulator.hpp"
+#include "runtime/CacheLineSketch.hpp"
 
-struct PerfSample;
+class CpuTopology;
+class SampleStore;
 
 class FalseSharingAnalysis {
 public:
-  static constexpr size_t CACHE_LINE_SIZE = 64;
+  static constexpr size_t CACHE_LINE_SIZE = CacheLineAccumulator::LINE_SIZE;
+  static constexpr size_t PAIR_SIZE = CacheLinePairAccumulator::PAIR_SIZE;
 
+  // Fewest samples a line needs over the whole run to be reported.
+  static constexpr size_t MIN_HOT_SAMPLES = 1000;
+
+  // Below this many samples find_hot_cache_lines() stays on one thread.
+  static constexpr size_t PARALLEL_MIN_SAMPLES = 1 << 16;
+
+  // Every line with at least MIN_HOT_SAMPLES samples, classified. Grouped
+  // in SharingClass order, and within a class by highest estimated
+  // coherence cost (CPU-to-CPU transitions weighted by `topology`) first.
+  // With `jobs` > 1 lines are hashed into `jobs` shards aggregated on their
+  // own threads; the result is identical to the serial pass.
+  static std::vector<CacheLine> find_hot_cache_lines(
+    const SampleStore& samples, unsigned jobs = 1,
+    const CpuTopology* topology = nullptr);
+  static std::vector<CacheLine> find_hot_cache_lines(
+    const CacheLineAccumulator& acc, size_t min_samples = MIN_HOT_SAMPLES);
+  // The same from a fixed-memory sketch; counts and per-thread statistics
+  // are estimates (see CacheLineSketch).
   static std::vector<CacheLine> find_hot_cache_lines(
-    const std::vector<PerfSample>& samples);
+    const CacheLineSketch& sketch, size_t min_samples = MIN_HOT_SAMPLES);
 
+  // The sharing pattern behind a line, from its thread count, bouncing, read
+  // and write split by thread, and per-thread offset overlap. Without
+  // `store_info` (no store samples at all) a line without stores may still
+  // be written, so only bouncing and offsets count.
+  static SharingClass classify(const CacheLine& line, bool store_info);
+  static const char* name(SharingClass c);
+  // What to do about a line of class `c`.
+  static const char* hint(SharingClass c);
+
+  // 128-byte pairs whose halves are written by different threads and that
+  // bounce between the halves, most cross-half bouncing first. Also fills
+  // CacheLine::adjacent_tids for `hot_lines`. With `hot_only` only pairs
+  // holding one of `hot_lines` are tracked, so memory is bounded by the hot
+  // lines instead of every touched pair (--approx).
+  static std::vector<CacheLinePair> find_hot_pairs(
+    const SampleStore& samples, std::vector<CacheLine>& hot_lines,
+    bool hot_only = false);
+
+  // Fills CacheLine::module for each line from the samples' mappings.
+  static void assign_modules(std::vector<CacheLine>& hot_lines,
+                             const SampleStore& samples);
+
+  // Prints the top `max_lines` lines of each class grouped by module,
+  // modules in the order of their best-ranked line. Counts are scaled to
+  // estimated events by `sample_period`.
   static void print(const std::vector<CacheLine>& hot_lines,
-                    size_t max_lines = 10);
+                    uint64_t sample_period, size_t max_lines = 10);
+  // Error bounds of `sketch`, and with `exact` (the exact pass over the same
+  // samples) the lines the sketch missed or misclassified. `stride`: the
+  // later phases see every stride-th sample.
+  static void print_approximation(const CacheLineSketch& sketch,
+                                  const std::vector<CacheLine>& approx,
+                                  uint64_t stride,
+                                  const std::vector<CacheLine>* exact);
+  // `hot_lines` marks the pairs that already have a reported 64-byte line.
+  static void print_pairs(const std::vector<CacheLinePair>& pairs,
+                          const std::vector<CacheLine>& hot_lines,
+                          size_t max_pairs = 10);
+
+private:
+  static void classify_and_rank(std::vector<CacheLine>& lines,
+                                bool store_info);
+  static void rank(std::vector<CacheLine>& lines);
+  static void estimate(CacheLine& line);
+  static void print_line(const CacheLine& line, size_t rank,
+                         uint64_t sample_period);
 };
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <libdwarf/libdwarf.h>
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "dwarf/DwarfContext.hpp"
+#include "dwarf/Extractor.hpp"
+#include "runtime/AddressSpace.hpp"
+#include "runtime/CfaTable.hpp"
+#include "runtime/ElfSymbolTable.hpp"
+
+// One executable or shared library seen in the samples: its DWARF objects,
+// call-frame info and PT_LOAD layout, for attributing samples with the
+// module's own load bias. Nothing is read until load() or load_frames().
+class Module {
+public:
+  // `file` is what to open when `path` (as the kernel reported the mapping)
+  // is not directly readable, e.g. /proc/<pid>/exe for a replaced binary.
+  Module(std::string path, std::string build_id, std::string file = {});
+  ~Module();
+
+  Module(const Module&)            = delete;
+  Module& operator=(const Module&) = delete;
+
+  // Reads DWARF, CFI and program headers. `dwarf` reuses an extraction that
+  // was already done (the binary from Phase 1). Never throws: a file without
+  // readable DWARF or CFI leaves dwarf()/fdes() empty.
+  void load(std::unique_ptr<Extractor> dwarf = nullptr);
+  bool loaded() const { return loaded_; }
+
+  // Reads only the CFI and program headers, for looking at CFA rules while
+  // samples are still being recorded. load() skips them afterwards.
+  void load_frames();
+
+  const std::string& path() const { return path_; }
+  const std::string& build_id() const { return build_id_; }
+
+  const Extractor* dwarf() const { return dwarf_.get(); }
+
+  // .eh_frame, else .debug_frame. nullptr/0 when neither could be read.
+  Dwarf_Fde* fdes() const { return fde_data_; }
+  Dwarf_Signed fde_count() const { return fde_count_; }
+
+  // The FDEs' CFA rules, for stack attribution.
+  CfaTable& cfa() { return cfa_; }
+
+  // Lowest PC any FDE covers, for inferring a bias when a sample has no
+  // mapping.
+  std::optional<uint64_t> min_fde_pc() const;
+
+  // Link-time address of runtime address `addr` inside mapping `m` of this
+  // module. Requires load().
+  std::optional<uint64_t> link_address(const Mapping& m, uint64_t addr) const;
+
+private:
+  std::string path_;
+  std::string build_id_;
+  std::string file_;
+  std::unique_ptr<Extractor> dwarf_;
+  std::unique_ptr<ElfSymbolTable> elf_;
+
+  std::unique_ptr<DwarfContext> frame_ctx_;
+  Dwarf_Cie* cie_data_    = nullptr;
+  Dwarf_Fde* fde_data_    = nullptr;
+  Dwarf_Signed cie_count_ = 0;
+  Dwarf_Signed fde_count_ = 0;
+  CfaTable cfa_;
+  bool loaded_ = false;
+};
+
+// The modules of one recording, keyed by build-id when the MMAP2 record
+// carried one and by path otherwise. Modules are created as samples resolve
+// to them but only read from disk once load() is called, so DWARF is only
+// parsed for DSOs that matter.
+class ModuleSet {
+public:
+  explicit ModuleSet(const AddressSpace& space) : space_(space) {}
+
+  // Registers a module that is already loaded (e.g. the analyzed binary).
+  Module& add(std::unique_ptr<Module> module);
+
+  // Module backing mapping `id`. nullptr for NONE and for anonymous or
+  // pseudo mappings ([heap], [stack], [vdso], //anon).
+  Module* for_mapping(uint32_t id);
+
+  // The same for a mapping that need not be in the set's AddressSpace yet,
+  // e.g. a reader's while samples are still streaming in.
+  Module* for_file(const Mapping& m);
+
+  // Already-loaded module for `path`, or nullptr.
+  Module* find(const std::string& path) const;
+
+  size_t size() const { return modules_.size(); }
+
+private:
+  const AddressSpace& space_;
+  std::vector<std::unique_ptr<Module>> modules_;
+  std::unordered_map<std::string, Module*> by_build_id_;
+  std::unordered_map<std::string, Module*> by_path_;
+
+  // Mapping id -> module, filled in as samples resolve.
+  std::vector<Module*> by_mapping_;
+  std::vector<bool> looked_up_;
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "common/Types.hpp"
+#include "runtime/PerfEventDecoder.hpp"
+
+// Reads perf.data directly: mmaps the file, walks the perf_event_header
+// records of the data section and decodes them with PerfEventDecoder. No
+// `perf` binary is needed. Samples are delivered in timestamp order, using
+// PERF_RECORD_FINISHED_ROUND the same way `perf script` does.
+class PerfDataReader {
+public:
+  // Throws std::runtime_error for files this reader cannot handle (pipe mode,
+  // foreign endianness, compressed records); callers fall back to
+  // `perf script` in that case.
+  explicit PerfDataReader(const std::string& path);
+  ~PerfDataReader();
+
+  PerfDataReader(const PerfDataReader&)            = delete;
+  PerfDataReader& operator=(const PerfDataReader&) = delete;
+
+  void for_each_sample(const SampleConsumer& fn);
+
+  std::vector<PerfSample> read_samples();
+
+  PerfEventDecoder& decoder() { return decoder_; }
+
+private:
+  void read_attrs();
+
+  int fd_{-1};
+  const uint8_t* data_{nullptr};
+  size_t size_{0};
+
+  uint64_t data_offset_{0};
+  uint64_t data_size_{0};
+
+  PerfEventDecoder decoder_;
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <asm/perf_regs.h>
+#include <linux/perf_event.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common/Types.hpp"
+#include "runtime/AddressSpace.hpp"
+#include "runtime/ElfSymbolTable.hpp"
+
+// DWARF number of each x86 perf register (asm/perf_regs.h order); -1 for
+// the IP, flags and segment registers.
+inline constexpr int8_t PERF_TO_DWARF_REG[PERF_REG_X86_64_MAX] = {
+  // AX, BX, CX, DX, SI, DI, BP, SP
+  DWARF_RAX, DWARF_RBX, DWARF_RCX, DWARF_RDX, DWARF_RSI, DWARF_RDI, DWARF_RBP,
+  DWARF_RSP,
+  // IP, FLAGS, CS, SS, DS, ES, FS, GS
+  -1, -1, -1, -1, -1, -1, -1, -1,
+  // R8-R15
+  DWARF_R8, DWARF_R8 + 1, DWARF_R8 + 2, DWARF_R8 + 3, DWARF_R8 + 4,
+  DWARF_R8 + 5, DWARF_R8 + 6, DWARF_R15};
+
+// sample_regs_user for every general-purpose register.
+inline constexpr uint64_t USER_GPR_MASK = [] {
+  uint64_t mask = 0;
+  for (int r = 0; r < PERF_REG_X86_64_MAX; ++r) {
+    if (PERF_TO_DWARF_REG[r] >= 0) mask |= uint64_t{1} << r;
+  }
+  return mask;
+}();
+
+// Decodes raw perf_event records (the layout shared by perf.data files and
+// perf_event_open ring buffers) into PerfSamples. MMAP/MMAP2/COMM/FORK records
+// are tracked in an AddressSpace, so samples carry the same dso/symbol
+// `perf script` would print plus the ids of the mappings their ip and data
+// address fell in at the time.
+class PerfEventDecoder {
+public:
+  // Registers an event. `ids` are the kernel sample ids that belong to it and
+  // are only needed to demultiplex samples when several events are recorded.
+  void add_event(const perf_event_attr& attr, const std::vector<uint64_t>& ids,
+                 const std::string& name);
+
+  // Returns true when `hdr` is a PERF_RECORD_SAMPLE that decoded into `out`.
+  // Side-band records update internal state and return false.
+  bool decode(const perf_event_header* hdr, PerfSample& out);
+
+  // Timestamp of any record: PERF_SAMPLE_TIME for samples, the sample_id
+  // trailer (attr.sample_id_all) for side-band records, 0 when unknown.
+  uint64_t timestamp(const perf_event_header* hdr) const;
+
+  const std::string* comm(uint32_t tid) const;
+
+  // Mappings from MMAP/MMAP2 records; also takes mappings that existed
+  // before recording started (and so have no record), e.g. from /proc.
+  AddressSpace& address_space() { return space; }
+  const AddressSpace& address_space() const { return space; }
+
+private:
+  struct Event {
+    perf_event_attr attr{};
+    std::string name;
+    SampleType type = SampleType::CACHE_LOAD;
+  };
+
+  const Event* event_for(const perf_event_header* hdr) const;
+  bool decode_sample(const perf_event_header* hdr, PerfSample& out);
+  void symbolize(PerfSample& s);
+  const ElfSymbolTable* symbols_for(const std::string& path);
+
+  std::vector<Event> events;
+  std::unordered_map<uint64_t, size_t> id_to_event;
+
+  AddressSpace space;
+  std::unordered_map<uint32_t, std::string> comms;  // per tid
+  std::unordered_map<std::string, std::unique_ptr<ElfSymbolTable>> elf_cache;
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <linux/perf_event.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "common/Types.hpp"
+#include "runtime/PerfEventDecoder.hpp"
+
+// Records memory-access samples in-process with perf_event_open, without the
+// perf tool or a perf.data file. Every event is opened once per CPU for the
+// target (inherited by its threads), each CPU gets one mmap ring buffer, and
+// reader threads drain the buffers while the caller's thread decodes records
+// in timestamp order with PerfEventDecoder.
+class PerfRecorder {
+public:
+  // `events` uses perf's syntax: "mem-loads:pp,mem-stores:pp", "ibs_op//",
+  // "cpu/event=0xcd,umask=0x1,ldlat=3/pp", "cpu-cycles". Names are resolved
+  // through /sys/bus/event_source. Throws std::runtime_error when an event is
+  // unknown.
+  PerfRecorder(const std::string& events, uint64_t period,
+               unsigned reader_threads = 0);
+  ~PerfRecorder();
+
+  PerfRecorder(const PerfRecorder&)            = delete;
+  PerfRecorder& operator=(const PerfRecorder&) = delete;
+
+  // Forks `binary` and opens the counters on it; the child execs once
+  // collect() starts, so nothing before exec is sampled. `env` holds
+  // NAME=value entries that replace the inherited variables of the same
+  // name in the child's environment (LD_PRELOAD).
+  // Throws std::runtime_error (after reaping the child) if the counters
+  // cannot be opened, e.g. because of perf_event_paranoid.
+  void launch(const std::string& binary,
+              const std::vector<std::string>& env = {});
+
+  // Opens the counters on every thread of the running process `pid`
+  // (threads it creates later are inherited) and loads its current mappings
+  // from /proc/<pid>/maps. Throws std::runtime_error like launch().
+  void attach(pid_t pid);
+
+  // Timestamps samples with `clock` (e.g. CLOCK_MONOTONIC, to line them up
+  // with the heap tracer log) instead of the kernel's perf clock. Call
+  // before launch() or attach().
+  void use_clock(clockid_t clock);
+
+  // Starts sampling and hands decoded samples to `fn`. A launched command is
+  // released and recorded until it exits; returns false if it could not be
+  // run or exited unsuccessfully. An attached process is recorded until it
+  // exits or `duration` (when non-zero) has passed.
+  bool collect(const SampleConsumer& fn,
+               std::chrono::milliseconds duration = {});
+
+  // Records dropped because a ring buffer was full.
+  uint64_t lost() const { return lost_; }
+  size_t cpus() const { return rings_.size(); }
+
+  const PerfEventDecoder& decoder() const { return decoder_; }
+  PerfEventDecoder& decoder() { return decoder_; }
+
+  struct EventSpec {
+    std::string name;
+    perf_event_attr attr{};
+    std::vector<int> cpus;  // CPUs the PMU can count on
+  };
+
+private:
+  struct RingBuffer {
+    int cpu         = -1;
+    int fd          = -1;  // first fd opened on this CPU; others redirect here
+    uint8_t* base   = nullptr;
+    size_t map_size = 0;
+  };
+
+  void open_counters(const std::vector<pid_t>& tids);
+  void drain(RingBuffer& rb, std::vector<uint8_t>& out);
+  void close_all();
+
+  std::vector<EventSpec> events_;
+  unsigned reader_threads_;
+
+  std::vector<int> fds_;
+  std::vector<RingBuffer> rings_;
+  size_t ring_pages_;  // data pages of the next ring mapped
+  PerfEventDecoder decoder_;
+
+  pid_t target_{-1};
+  pid_t child_{-1};  // target_ when it was launched by us
+  int go_fd_{-1};  // write end of the pipe the child waits on before exec
+  uint64_t lost_{0};
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "common/Types.hpp"
+#include "runtime/AddressSpace.hpp"
+
+class PipeStream;
+
+// Parses the text printed by `perf script`.
+class PerfScriptParser {
+public:
+  // Field layout parse_line() expects (`perf script -F <FIELDS>`).
+  static constexpr std::string_view FIELDS =
+    "tid,pid,cpu,time,event,ip,addr,sym,dso,uregs";
+
+  // Parses one line into `out`, reusing its symbol/dso string capacity, so a
+  // warm PerfSample makes this allocation-free. Returns false for comments and
+  // lines that do not match the layout.
+  static bool parse_line(std::string_view line, PerfSample& out);
+  static std::optional<PerfSample> parse_line(std::string_view line);
+
+  // Parses a PERF_RECORD_MMAP/MMAP2 line printed by `--show-mmap-events`:
+  //   ... PERF_RECORD_MMAP2 pid/tid: [start(len) @ pgoff ...]: r-xp path
+  static bool parse_mmap_line(std::string_view line, Mapping& out);
+
+  // Parses every line of `pipe` and hands samples to `fn` in output order.
+  // With jobs > 1 the text is cut into newline-aligned blocks that worker
+  // threads parse into their own buffers; finished blocks are delivered in
+  // their original order, so time ordering is unchanged. With `space`, mmap
+  // lines are applied to it in that same order and every sample's ip_map and
+  // addr_map are resolved against the mappings live at that point.
+  static void for_each_sample(PipeStream& pipe, const SampleConsumer& fn,
+                              unsigned jobs = 1, AddressSpace* space = nullptr);
+
+  // Runs `perf script` over `perf_data_file` and hands every sample to `fn`
+  // while perf is still printing. Passing `space` adds --show-mmap-events.
+  static void for_each_sample(const std::string& perf_data_file,
+                              const SampleConsumer& fn, unsigned jobs = 1,
+                              AddressSpace* space = nullptr);
+
+  static std::vector<PerfSample> parse_file(const std::string& perf_data_file);
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "common/Types.hpp"
+
+class CpuTopology;
+class SampleStore;
+
+// A run of consecutive time windows with the same set of contended lines.
+struct Phase {
+  uint64_t start{};  // ns since the first sample
+  uint64_t end{};
+  size_t windows{};
+  size_t samples{};
+  std::vector<CacheLine> hot;  // over the phase's samples, ranked
+};
+
+// Splits a recording into fixed-width windows by PerfSample::time_stamp,
+// scores every window's cache lines on their own, and starts a new phase
+// whenever the window's top lines differ from the previous window's. Bursts
+// of false sharing during startup or a batch step show up as their own phase
+// instead of being averaged into the whole-run ranking.
+class PhaseAnalysis {
+public:
+  // A line needs this many samples inside one window (or phase) to count.
+  static constexpr size_t MIN_WINDOW_SAMPLES = 100;
+  // Lines per window compared between windows.
+  static constexpr size_t SIGNATURE_LINES = 8;
+  // Jaccard similarity of two windows' top lines below which a phase ends.
+  static constexpr double MIN_SIMILARITY = 0.5;
+
+  // Throws std::runtime_error when `window_ns` cuts the recording into an
+  // unreasonable number of windows.
+  static std::vector<Phase> find_phases(
+    const SampleStore& samples, uint64_t window_ns,
+    const CpuTopology* topology = nullptr);
+
+  // Line counts are scaled to estimated events by `sample_period`.
+  static void print(const std::vector<Phase>& phases, uint64_t window_ns,
+                    uint64_t sample_period, size_t max_lines = 5);
+};
@@ -1,10 +1,18 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdio>
+#include <iterator>
+#include <ranges>
 #include <string>
+#include <string_view>
 #include <vector>
 
 class PipeStream {
 public:
+  // Read buffer size; lines longer than this grow the buffer.
+  static constexpr size_t BUFFER_SIZE = 1 << 20;
+
   explicit PipeStream(const std::string& cmd);
   ~PipeStream();
 
@@ -17,6 +25,49 @@ public:
 
   std::vector<std::string> read_lines();
 
+  // Streaming access: yields the next line (without '\n') as a view into the
+  // reusable read buffer. The view is invalidated by the next call. Partial
+  // lines are carried across refills, so memory stays at one buffer no matter
+  // how much the command prints.
+  bool next_line(std::string_view& line);
+
+  // Replaces `out` with at least `min_bytes` of output (unless the stream
+  // ends first), cut at a newline so every line in it is complete. Used to
+  // hand independent chunks to parser threads.
+  bool read_block(std::string& out, size_t min_bytes = BUFFER_SIZE);
+
+  // Input range over next_line(), e.g. `pipe.lines() | views::transform(f)`.
+  class LineIterator {
+  public:
+    using value_type      = std::string_view;
+    using difference_type = std::ptrdiff_t;
+
+    LineIterator() = default;
+    explicit LineIterator(PipeStream* pipe) : pipe_(pipe) { ++*this; }
+
+    std::string_view operator*() const { return line_; }
+    LineIterator& operator++() {
+      if (pipe_ && !pipe_->next_line(line_)) pipe_ = nullptr;
+      return *this;
+    }
+    void operator++(int) { ++*this; }
+    bool operator==(std::default_sentinel_t) const { return pipe_ == nullptr; }
+
+  private:
+    PipeStream* pipe_{nullptr};
+    std::string_view line_;
+  };
+
+  auto lines() {
+    return std::ranges::subrange(LineIterator{this}, std::default_sentinel);
+  }
+
 private:
+  bool refill();
+
   FILE* pipe_;
+  std::vector<char> buf_;
+  size_t begin_{0};
+  size_t end_{0};
+  bool eof_{false};
 };
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One line of /proc/<pid>/maps.
+struct ProcMapping {
+  uint64_t start = 0;
+  uint64_t end   = 0;
+  uint64_t pgoff = 0;
+  std::string perms;
+  std::string path;  // empty for anonymous mappings
+};
+
+// Reads the address space of a live process, for targets that were running
+// before recording started and so never produced MMAP records.
+class ProcMaps {
+public:
+  // Empty if the process does not exist or cannot be read.
+  static std::vector<ProcMapping> read(pid_t pid);
+
+  // Resolved /proc/<pid>/exe, without the " (deleted)" suffix. Throws
+  // std::runtime_error if the link cannot be read.
+  static std::string exe_path(pid_t pid);
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <optional>
+#include <string>
+
+#include "runtime/SampleStore.hpp"
+
+// On-disk copy of a parsed SampleStore (`<perf.data>.cscache`) so re-analysis
+// skips recording and decoding. Fixed-width fields are stored as raw column
+// arrays, timestamps and addresses as zigzag-varint deltas, and symbol/dso
+// names once each in string tables, followed by the recording's address
+// space. The file is stamped with the size and mtime of the perf.data it came
+// from and with the size, mtime and build-id of the analyzed binary, and is
+// ignored once either changes. It also records the DSO filter the samples
+// went through, and a run with a different filter ignores it as well.
+class SampleCache {
+public:
+  struct Contents {
+    SampleStore samples;
+    uint64_t seen = 0;  // samples recorded, before the DSO filter
+  };
+
+  static std::string path_for(const std::string& perf_data_file) {
+    return perf_data_file + ".cscache";
+  }
+
+  // Writes atomically (temp file + rename). `source` may be empty for samples
+  // recorded in-process, which have no perf.data to go stale against;
+  // `binary` is the analyzed binary and `binary_only` whether samples outside
+  // it were dropped. Throws std::runtime_error on I/O errors.
+  static void save(const std::string& cache_path, const SampleStore& samples,
+                   uint64_t seen, const std::string& source,
+                   const std::string& binary, bool binary_only);
+
+  // nullopt when the cache does not exist, `source` or `binary` has changed
+  // since it was written, or it was filtered with another `binary_only`.
+  // Throws std::runtime_error for a corrupt or foreign file.
+  static std::optional<Contents> load(const std::string& cache_path,
+                                      const std::string& source,
+                                      const std::string& binary,
+                                      bool binary_only);
+};
@@ -2,9 +2,8 @@
 
 #include <cstddef>
 #include <iosfwd>
-#include <vector>
 
-struct PerfSample;
+class SampleStore;
 
 class SampleStats {
 public:
@@ -16,7 +15,7 @@ public:
   size_t unique_threads    = 0;
   size_t unique_cpus       = 0;
 
-  static SampleStats compute(const std::vector<PerfSample>& samples);
+  static SampleStats compute(const SampleStore& samples);
 
   friend std::ostream& operator<<(std::ostream& os, const SampleStats& stats);
 };
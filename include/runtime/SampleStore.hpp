@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "common/StringTable.hpp"
+#include "common/Types.hpp"
+#include "runtime/AddressSpace.hpp"
+
+// Struct-of-arrays storage for parsed samples. Each PerfSample field is its
+// own column and symbol/dso strings are interned, so a sample costs ~80 bytes
+// instead of a PerfSample plus two heap strings, and scans that touch one or
+// two fields stream through contiguous memory.
+class SampleStore {
+public:
+  // Registers with columns of their own.
+  static constexpr uint32_t COLUMN_REGS =
+    1u << DWARF_RSP | 1u << DWARF_RBP | 1u << DWARF_RIP;
+  // Column bytes per row, not counting saved registers or strings.
+  static constexpr size_t ROW_BYTES =
+    7 * sizeof(uint32_t) + 5 * sizeof(uint64_t) + sizeof(SampleType);
+
+  // `keep_regs`: registers beyond sp, bp and ip to keep for this row, as
+  // the CFA rule at its IP needs them (CfaRegisters::needed).
+  void push_back(const PerfSample& s, uint32_t keep_regs = 0);
+  void reserve(size_t n);
+
+  // Drops every odd row, halving the store (--approx keeps a bounded,
+  // evenly thinned store this way).
+  void thin();
+
+  size_t size() const { return tids.size(); }
+  bool empty() const { return tids.empty(); }
+
+  const std::string& symbol(size_t i) const {
+    return symbols.get(symbol_ids[i]);
+  }
+  const std::string& dso(size_t i) const { return dsos.get(dso_ids[i]); }
+
+  // Mapping sample `i`'s ip / data address fell in, or nullptr.
+  const Mapping* ip_mapping(size_t i) const {
+    return ip_maps[i] ? &address_space.get(ip_maps[i]) : nullptr;
+  }
+  const Mapping* addr_mapping(size_t i) const {
+    return addr_maps[i] ? &address_space.get(addr_maps[i]) : nullptr;
+  }
+
+  // DWARF register `n` of sample `i` (DWARF_RIP is the IP), or nullopt
+  // when it was not sampled or not kept for the row.
+  std::optional<uint64_t> reg(size_t i, unsigned n) const;
+
+  // Rebuilds row `i` as a PerfSample (for previews/debug output).
+  PerfSample at(size_t i) const;
+
+  size_t memory_bytes() const;
+
+  std::vector<uint32_t> tids;
+  std::vector<uint32_t> pids;
+  std::vector<uint32_t> cpus;
+  std::vector<uint64_t> ips;
+  std::vector<uint64_t> addrs;
+  std::vector<uint64_t> sps;
+  std::vector<uint64_t> bps;
+  std::vector<uint64_t> times;
+  std::vector<SampleType> types;
+  std::vector<uint32_t> symbol_ids;
+  std::vector<uint32_t> dso_ids;
+  std::vector<uint32_t> ip_maps;    // AddressSpace ids
+  std::vector<uint32_t> addr_maps;
+
+  // A register kept beyond the sp/bp/ip columns. Only rows whose CFA rule
+  // reads one have any, so this stays far smaller than a column.
+  struct SavedReg {
+    uint32_t row;
+    uint32_t reg;  // DWARF number
+    uint64_t value;
+  };
+  std::vector<SavedReg> saved_regs;  // by row
+  uint32_t sampled_regs = 0;         // bit n: the recording sampled reg n
+
+  StringTable symbols;
+  StringTable dsos;
+  AddressSpace address_space;  // of the whole recording, not just kept rows
+};
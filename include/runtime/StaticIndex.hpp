@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "common/Types.hpp"
+
+// The globals and function-local statics of one module, sorted by link-time
+// address: finds the object a data address falls in with a binary search.
+class StaticIndex {
+public:
+  explicit StaticIndex(const std::vector<DwarfGlobalObject>& objects);
+
+  // Object containing link-time address `addr`, or nullptr.
+  const StaticRange* find(uint64_t addr) const;
+
+  size_t size() const { return ranges_.size(); }
+  bool empty() const { return ranges_.empty(); }
+
+private:
+  std::vector<StaticRange> ranges_;  // by start, non-overlapping
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common/FlatMap.hpp"
+#include "common/Types.hpp"
+
+class SampleStore;
+
+// Sparse tid x tid transfer counts: cell (a, b) counts consecutive touches of
+// the same data where thread a was followed by thread b. Only non-zero cells
+// are stored, so hundreds of threads cost nothing unless they all interact.
+class TransferMatrix {
+public:
+  struct Cell {
+    uint32_t from  = 0;
+    uint32_t to    = 0;
+    uint64_t count = 0;
+  };
+
+  void add(uint32_t from, uint32_t to, uint64_t n = 1);
+  void merge(const TransferMatrix& other);
+
+  uint64_t at(uint32_t from, uint32_t to) const;
+  uint64_t total() const { return total_; }
+  size_t cells() const { return cells_.size(); }
+  bool empty() const { return cells_.empty(); }
+
+  // Threads in any cell, ascending.
+  std::vector<uint32_t> tids() const;
+  // Non-zero cells, largest first (ties by from, then to).
+  std::vector<Cell> ranked() const;
+
+private:
+  static uint64_t key(uint32_t from, uint32_t to) {
+    return uint64_t{from} << 32 | to;
+  }
+
+  FlatMap<uint64_t, uint64_t> cells_;
+  uint64_t total_ = 0;
+};
+
+// The transfer matrices of one analysis: over every sampled line, per hot
+// line, and per attributed object.
+struct ContentionMatrices {
+  TransferMatrix all;  // over the hot lines only with `hot_only`
+  bool hot_only = false;
+  std::vector<TransferMatrix> lines;  // parallel to the hot lines
+  std::vector<uint64_t> line_addrs;
+  std::vector<std::pair<std::string, TransferMatrix>> objects;
+
+  // One pass over the samples in recorded order. With `hot_only` lines
+  // other than `hot_lines` are skipped, so the last-toucher state is bounded
+  // by the hot lines instead of every touched line (--approx).
+  static ContentionMatrices build(const SampleStore& samples,
+                                  const std::vector<CacheLine>& hot_lines,
+                                  bool hot_only = false);
+
+  // Top `max_cells` transfers of the whole run, then of each of the first
+  // `max_scopes` lines and objects.
+  void print(size_t max_scopes = 10, size_t max_cells = 3) const;
+
+  // Heatmap-ready export. A path ending in ".json" gets
+  //   {"scopes": [{"scope", "tids", "cells": [[from, to, count], ...]}]},
+  // anything else CSV rows "scope,from_tid,to_tid,transfers". Scopes are
+  // "all", "line:0x<addr>" and "object:<name>". Throws std::runtime_error if
+  // the file cannot be written.
+  void save(const std::string& path) const;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common/FlatMap.hpp"
+#include "common/Types.hpp"
+
+// A type flattened to the innermost member at every byte offset: leaf
+// ranges sorted by offset, so resolving an offset inside an object is one
+// binary search per array level.
+//
+// Base classes and anonymous members are transparent, bitfields carry their
+// width, and bytes several members share (union members, bitfields in one
+// byte) name all of them: ".hdr.{ready:1 | state:3}". An array of
+// aggregates stays one leaf holding its element's layout, so
+// `Slot slots[100000]` costs no more than a single Slot.
+class TypeLayout {
+public:
+  // Member path at `offset`, relative to the object:
+  // ".slots[7].stats.hits", "[3]" inside an array of scalars, and empty for
+  // a scalar object or padding.
+  std::string resolve(uint64_t offset) const;
+
+  size_t size() const { return leaves_.size(); }
+
+  struct Leaf {
+    uint64_t begin = 0;  // byte range within the type
+    uint64_t end   = 0;
+    std::string path;
+    // Arrays: elements of `stride` bytes from `origin`, each laid out by
+    // `element` (nullptr for scalars). `origin` stays put when bytes of the
+    // array are shared and the leaf is split.
+    uint64_t stride           = 0;
+    uint64_t origin           = 0;
+    const TypeLayout* element = nullptr;
+  };
+
+private:
+  friend class TypeLayouts;
+
+  std::vector<Leaf> leaves_;  // by begin, non-overlapping
+};
+
+// Layouts by type, each built on first use and kept for the lifetime of the
+// cache.
+class TypeLayouts {
+public:
+  static constexpr int MAX_DEPTH = 32;  // against cyclic type graphs
+
+  const TypeLayout& of(const TypeInfo* type);
+
+private:
+  void flatten(const TypeInfo* type, uint64_t base, const std::string& path,
+               int depth, std::vector<TypeLayout::Leaf>& out);
+
+  FlatMap<const TypeInfo*, std::unique_ptr<TypeLayout>> layouts_;
+};
@@ -0,0 +1,55 @@
+// Samples/sec of the false-sharing cache-line aggregation per thread count,
+// over synthetic samples: `lines` cache lines, each written by four threads
+// at their own offsets, interleaved the way contended lines look in a
+// recording.
+// Usage: aggregation_bench [samples] [lines] [max_jobs]
+#include <chrono>
+#include <format>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "runtime/FalseSharingAnalysis.hpp"
+#include "runtime/SampleStore.hpp"
+
+int main(int argc, char* argv[]) {
+  const size_t n     = argc > 1 ? std::stoull(argv[1]) : 20'000'000;
+  const size_t lines = argc > 2 ? std::stoull(argv[2]) : 10'000;
+  const unsigned max_jobs =
+    argc > 3 ? static_cast<unsigned>(std::stoul(argv[3]))
+             : std::max(1u, std::thread::hardware_concurrency());
+
+  SampleStore samples;
+  samples.reserve(n);
+  uint64_t x = 0x2545f4914f6cdd1dULL;
+  for (size_t i = 0; i < n; ++i) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    const uint64_t line = (x >> 8) % lines;
+    const uint32_t t    = static_cast<uint32_t>(x % 4);
+
+    PerfSample s{};
+    s.tid        = 1000 + t;
+    s.addr       = 0x7f0000000000ULL + line * 64 + t * 8;
+    s.event_type = (x >> 40) % 4 == 0 ? SampleType::CACHE_LOAD
+                                      : SampleType::CACHE_STORE;
+    samples.push_back(s);
+  }
+
+  double base_rate = 0.0;
+  for (unsigned jobs = 1; jobs <= max_jobs; jobs *= 2) {
+    auto t0  = std::chrono::steady_clock::now();
+    auto hot = FalseSharingAnalysis::find_hot_cache_lines(samples, jobs);
+    auto t1  = std::chrono::steady_clock::now();
+
+    const double secs = std::chrono::duration<double>(t1 - t0).count();
+    const double rate = n / secs;
+    if (jobs == 1) base_rate = rate;
+    std::cout << std::format(
+      "jobs={:<3} samples={:<10} {:.3f}s  {:.2f} Msamples/s  speedup={:.2f}x "
+      "(hot lines {})\n",
+      jobs, n, secs, rate / 1e6, rate / base_rate, hot.size());
+  }
+  return 0;
+}
@@ -0,0 +1,142 @@
+// CFA lookups per second for Phase 5: libdwarf's FDE search plus CFA
+// program run for every query (the old per-sample path) against CfaTable's
+// row table and per-PC memo. Queries mimic samples: 90% hit a few hundred
+// hot PCs, the rest are spread over all the code the FDEs cover.
+// Usage: cfa_table_bench <binary> [lookups]
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "dwarf/DwarfContext.hpp"
+#include "runtime/CfaTable.hpp"
+
+namespace {
+
+uint64_t xorshift(uint64_t& x) {
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return x;
+}
+
+struct Range {
+  uint64_t lo, hi;
+};
+
+std::vector<uint64_t> make_queries(const std::vector<Range>& ranges,
+                                   size_t n) {
+  uint64_t x     = 0x9e3779b97f4a7c15ULL;
+  auto random_pc = [&] {
+    const Range& r = ranges[xorshift(x) % ranges.size()];
+    return r.lo + xorshift(x) % (r.hi - r.lo);
+  };
+  std::vector<uint64_t> hot(256);
+  for (auto& pc : hot) pc = random_pc();
+
+  std::vector<uint64_t> out;
+  out.reserve(n);
+  for (size_t i = 0; i < n; ++i)
+    out.push_back(xorshift(x) % 10 ? hot[xorshift(x) % hot.size()]
+                                   : random_pc());
+  return out;
+}
+
+// The rule libdwarf gives for `pc`, as Phase 5 computed it per sample.
+int64_t libdwarf_cfa(Dwarf_Fde* fdes, uint64_t pc) {
+  Dwarf_Fde fde   = nullptr;
+  Dwarf_Addr lopc = 0, hipc = 0;
+  Dwarf_Error err = nullptr;
+  if (dwarf_get_fde_at_pc(fdes, pc, &fde, &lopc, &hipc, &err) != DW_DLV_OK)
+    return 0;
+
+  Dwarf_Small value_type       = 0;
+  Dwarf_Signed offset_relevant = 0;
+  Dwarf_Signed regnum          = 0;
+  Dwarf_Signed offset_or_len   = 0;
+  Dwarf_Ptr block_ptr          = nullptr;
+  Dwarf_Addr row_pc            = 0;
+  if (dwarf_get_fde_info_for_cfa_reg3(fde, pc, &value_type, &offset_relevant,
+                                      &regnum, &offset_or_len, &block_ptr,
+                                      &row_pc, &err) != DW_DLV_OK ||
+      (value_type != DW_EXPR_OFFSET && value_type != DW_EXPR_VAL_OFFSET))
+    return 0;
+  return regnum * 1000 + offset_or_len;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    std::cerr << "usage: cfa_table_bench <binary> [lookups]\n";
+    return 1;
+  }
+  const size_t lookups = argc > 2 ? std::stoull(argv[2]) : 2'000'000;
+  using clock          = std::chrono::steady_clock;
+
+  DwarfContext ctx(argv[1]);
+  Dwarf_Cie* cies        = nullptr;
+  Dwarf_Fde* fdes        = nullptr;
+  Dwarf_Signed cie_count = 0;
+  Dwarf_Signed fde_count = 0;
+  Dwarf_Error err        = nullptr;
+  if (dwarf_get_fde_list_eh(ctx.dbg(), &cies, &cie_count, &fdes, &fde_count,
+                            &err) != DW_DLV_OK &&
+      dwarf_get_fde_list(ctx.dbg(), &cies, &cie_count, &fdes, &fde_count,
+                         &err) != DW_DLV_OK) {
+    std::cerr << std::format("{}: no CFI\n", argv[1]);
+    return 1;
+  }
+
+  std::vector<Range> ranges;
+  for (Dwarf_Signed i = 0; i < fde_count; ++i) {
+    Dwarf_Addr lopc              = 0;
+    Dwarf_Unsigned len           = 0;
+    Dwarf_Ptr fde_bytes          = nullptr;
+    Dwarf_Unsigned fde_bytes_len = 0;
+    Dwarf_Off cie_offset         = 0;
+    Dwarf_Signed cie_index       = 0;
+    Dwarf_Off fde_offset         = 0;
+    if (dwarf_get_fde_range(fdes[i], &lopc, &len, &fde_bytes, &fde_bytes_len,
+                            &cie_offset, &cie_index, &fde_offset,
+                            &err) == DW_DLV_OK &&
+        len > 0)
+      ranges.push_back({lopc, lopc + len});
+  }
+  if (ranges.empty()) {
+    std::cerr << std::format("{}: no FDE covers any code\n", argv[1]);
+    return 1;
+  }
+  const auto queries = make_queries(ranges, lookups);
+
+  auto t0 = clock::now();
+  CfaTable table(fdes, fde_count);
+  auto t1 = clock::now();
+
+  int64_t before = 0;
+  for (uint64_t pc : queries) before += libdwarf_cfa(fdes, pc);
+  auto t2 = clock::now();
+
+  int64_t after = 0;
+  for (uint64_t pc : queries) {
+    const CfaRule& rule = table.at(pc);
+    if (rule.kind == CfaRule::REGISTER) after += rule.reg * 1000 + rule.offset;
+  }
+  auto t3 = clock::now();
+
+  auto secs = [](auto a, auto b) {
+    return std::chrono::duration<double>(b - a).count();
+  };
+  std::cout << std::format("{}: {} FDEs, {} rows, built in {:.3f}s\n",
+                           argv[1], fde_count, table.rows(), secs(t0, t1));
+  std::cout << std::format("  libdwarf  {:10.0f} lookups/s\n",
+                           lookups / secs(t1, t2));
+  std::cout << std::format("  CfaTable  {:10.0f} lookups/s  ({})\n",
+                           lookups / secs(t2, t3),
+                           before == after ? "same rules" : "MISMATCH");
+
+  dwarf_fde_cie_list_dealloc(ctx.dbg(), cies, cie_count, fdes, fde_count);
+  return before == after ? 0 : 1;
+}
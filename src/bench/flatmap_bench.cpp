@@ -0,0 +1,113 @@
+// Insert/lookup throughput and memory of FlatMap against std::unordered_map
+// on the key distributions CacheScope hashes:
+//   lines  64-byte aligned data addresses in a few heap/stack/.data regions
+//   dies   DWARF DIE offsets: increasing with small gaps
+//   tids   small, dense integers
+// Usage: flatmap_bench [keys] [lookups]
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "common/FlatMap.hpp"
+
+namespace {
+
+uint64_t xorshift(uint64_t& x) {
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return x;
+}
+
+std::vector<uint64_t> make_keys(const std::string& dist, size_t n) {
+  std::vector<uint64_t> keys;
+  keys.reserve(n);
+  uint64_t x = 0x9e3779b97f4a7c15ULL;
+  if (dist == "lines") {
+    const uint64_t regions[] = {0x55d4c0a00000ULL, 0x7f3a10000000ULL,
+                                0x7ffc9e000000ULL};
+    for (size_t i = 0; i < n; ++i) {
+      const uint64_t r = regions[xorshift(x) % 3];
+      keys.push_back(r + i * 64);
+    }
+  } else if (dist == "dies") {
+    uint64_t off = 0xc;
+    for (size_t i = 0; i < n; ++i) {
+      off += 2 + xorshift(x) % 24 * 2;
+      keys.push_back(off);
+    }
+  } else {
+    for (size_t i = 0; i < n; ++i) keys.push_back(1000 + 2 * i);
+  }
+  // Every key is even, so `key | 1` is a guaranteed miss. Shuffle so the
+  // insertion order is not sorted.
+  for (size_t i = n; i > 1; --i)
+    std::swap(keys[i - 1], keys[xorshift(x) % i]);
+  return keys;
+}
+
+template <typename Map>
+size_t memory_of(const Map& m) {
+  if constexpr (requires { m.memory_bytes(); }) {
+    return m.memory_bytes();
+  } else {
+    // Node: key, value, next pointer, cached hash; plus the bucket array.
+    return m.size() * (sizeof(typename Map::value_type) + 2 * sizeof(void*)) +
+           m.bucket_count() * sizeof(void*);
+  }
+}
+
+template <typename Map>
+void run(const char* name, const std::vector<uint64_t>& keys,
+         size_t lookups) {
+  using clock = std::chrono::steady_clock;
+  const size_t n = keys.size();
+
+  Map m;
+  auto t0 = clock::now();
+  for (size_t i = 0; i < n; ++i) m[keys[i]] += i;
+  auto t1 = clock::now();
+
+  uint64_t x    = 42;
+  uint64_t sink = 0;
+  for (size_t i = 0; i < lookups; ++i) {
+    auto it = m.find(keys[xorshift(x) % n]);
+    sink += it->second;
+  }
+  auto t2 = clock::now();
+
+  for (size_t i = 0; i < lookups; ++i) {
+    sink += m.count(keys[xorshift(x) % n] | 1);
+  }
+  auto t3 = clock::now();
+
+  auto mops = [](size_t ops, auto a, auto b) {
+    return ops / std::chrono::duration<double>(b - a).count() / 1e6;
+  };
+  std::cout << std::format(
+    "  {:<14} insert {:7.1f} Mops/s  hit {:7.1f} Mops/s  miss {:7.1f} Mops/s  "
+    "{:7.1f} MB (checksum {:x})\n",
+    name, mops(n, t0, t1), mops(lookups, t1, t2), mops(lookups, t2, t3),
+    memory_of(m) / (1024.0 * 1024.0), sink);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const size_t n       = argc > 1 ? std::stoull(argv[1]) : 1'000'000;
+  const size_t lookups = argc > 2 ? std::stoull(argv[2]) : 20'000'000;
+
+  for (const char* dist : {"lines", "dies", "tids"}) {
+    const auto keys = make_keys(dist, n);
+    std::cout << std::format("{} ({} keys):\n", dist, n);
+    run<std::unordered_map<uint64_t, uint64_t>>("unordered_map", keys,
+                                                lookups);
+    run<FlatMap<uint64_t, uint64_t>>("FlatMap", keys, lookups);
+  }
+  return 0;
+}
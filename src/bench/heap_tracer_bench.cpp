@@ -0,0 +1,104 @@
+// Per-call overhead of the heap tracer (libcachescope_heap.so) on an
+// allocation-heavy workload: every thread keeps a ring of live blocks and
+// replaces one per step, alternating malloc/free and new/delete. The
+// workload runs once in this process, then again in a child started with
+// the tracer preloaded, and both are reported with the log size.
+// Usage: heap_tracer_bench [threads] [ops per thread]
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "preload/HeapLog.hpp"
+
+namespace {
+
+constexpr size_t RING = 256;
+
+uint64_t xorshift(uint64_t& x) {
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return x;
+}
+
+void churn(size_t ops, uint64_t seed) {
+  std::vector<void*> ring(RING, nullptr);
+  std::vector<char*> owned(RING, nullptr);
+  uint64_t x = seed;
+  for (size_t i = 0; i < ops; ++i) {
+    const size_t slot = xorshift(x) % RING;
+    const size_t size = 16 + xorshift(x) % 512;
+    // Touch every block so the allocator cannot skip the work.
+    if (i & 1) {
+      delete[] owned[slot];
+      owned[slot]    = new char[size];
+      owned[slot][0] = 1;
+    } else {
+      free(ring[slot]);
+      ring[slot] = std::memset(malloc(size), 1, 1);
+    }
+  }
+  for (void* p : ring) free(p);
+  for (char* p : owned) delete[] p;
+}
+
+// Nanoseconds per allocation or free.
+double run(unsigned threads, size_t ops) {
+  const auto t0 = std::chrono::steady_clock::now();
+  std::vector<std::thread> pool;
+  for (unsigned t = 0; t < threads; ++t) pool.emplace_back(churn, ops, t + 1);
+  for (auto& th : pool) th.join();
+  const std::chrono::duration<double, std::nano> ns =
+    std::chrono::steady_clock::now() - t0;
+  return ns.count() / (2.0 * ops * threads);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const unsigned threads = argc > 1 ? std::stoul(argv[1]) : 4;
+  const size_t ops       = argc > 2 ? std::stoull(argv[2]) : 2'000'000;
+
+  // The traced child prints its own figure only.
+  if (getenv(HEAP_LOG_ENV)) {
+    std::cout << std::format("{:.2f}\n", run(threads, ops));
+    return 0;
+  }
+
+  const double plain = run(threads, ops);
+  std::cout << std::format("{} threads x {} ops\n", threads, ops);
+  std::cout << std::format("  untraced {:7.2f} ns/op\n", plain);
+
+  const auto log = std::filesystem::temp_directory_path() /
+                   std::format("heap_tracer_bench.{}.heap", getpid());
+  const auto cmd = std::format("LD_PRELOAD={} {}={} {} {} {}",
+                               HEAP_TRACER_PATH, HEAP_LOG_ENV, log.string(),
+                               argv[0], threads, ops);
+  FILE* child = popen(cmd.c_str(), "r");
+  double traced = 0;
+  if (!child || fscanf(child, "%lf", &traced) != 1) {
+    std::cerr << std::format("traced run failed: {}\n", cmd);
+    if (child) pclose(child);
+    return 1;
+  }
+  pclose(child);
+
+  std::error_code ec;
+  const auto bytes = std::filesystem::file_size(log, ec);
+  std::filesystem::remove(log, ec);
+  std::cout << std::format("  traced   {:7.2f} ns/op  (+{:.2f} ns/op, "
+                           "log {:.1f} MB, {} B/event)\n",
+                           traced, traced - plain, bytes / (1024.0 * 1024.0),
+                           sizeof(HeapEvent));
+  return 0;
+}
@@ -0,0 +1,48 @@
+// Samples/sec of the perf script text parser per thread count.
+// Usage: parse_scaling_bench <perf-script.txt> [max_jobs]
+//   perf script -F tid,pid,cpu,time,event,ip,addr,sym,dso,uregs > out.txt
+#include <chrono>
+#include <format>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "runtime/PerfScriptParser.hpp"
+#include "runtime/PipeStream.hpp"
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    std::cerr << "usage: parse_scaling_bench <perf-script.txt> [max_jobs]\n";
+    return 1;
+  }
+  const std::string path = argv[1];
+  const unsigned max_jobs =
+    argc > 2 ? static_cast<unsigned>(std::stoul(argv[2]))
+             : std::max(1u, std::thread::hardware_concurrency());
+
+  double base_rate = 0.0;
+  for (unsigned jobs = 1; jobs <= max_jobs; jobs *= 2) {
+    PipeStream pipe(std::format("cat '{}'", path));
+    size_t n      = 0;
+    uint64_t sink = 0;
+
+    auto t0 = std::chrono::steady_clock::now();
+    PerfScriptParser::for_each_sample(
+      pipe,
+      [&](const PerfSample& s) {
+        ++n;
+        sink += s.addr;
+      },
+      jobs);
+    auto t1 = std::chrono::steady_clock::now();
+
+    const double secs = std::chrono::duration<double>(t1 - t0).count();
+    const double rate = n / secs;
+    if (jobs == 1) base_rate = rate;
+    std::cout << std::format(
+      "jobs={:<3} samples={:<10} {:.3f}s  {:.2f} Msamples/s  speedup={:.2f}x "
+      "(checksum {:x})\n",
+      jobs, n, secs, rate / 1e6, rate / base_rate, sink);
+  }
+  return 0;
+}
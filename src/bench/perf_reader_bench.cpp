@@ -0,0 +1,51 @@
+// Decode throughput of the native perf.data reader vs. the `perf script` text
+// path. Usage: perf_reader_bench <perf.data> [iterations]
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <string>
+
+#include "runtime/PerfDataReader.hpp"
+#include "runtime/PerfScriptParser.hpp"
+
+template <typename F>
+static void run(const std::string& name, int iterations, double file_mb,
+                F&& parse) {
+  double best     = 0.0;
+  size_t produced = 0;
+  for (int i = 0; i < iterations; ++i) {
+    auto t0  = std::chrono::steady_clock::now();
+    produced = parse();
+    auto t1  = std::chrono::steady_clock::now();
+    double s = std::chrono::duration<double>(t1 - t0).count();
+    best     = (i == 0) ? s : std::min(best, s);
+  }
+  std::cout << std::format(
+    "{:<8} samples={:<10} best={:.3f}s  {:.2f} Msamples/s  {:.1f} MB/s\n",
+    name, produced, best, produced / best / 1e6, file_mb / best);
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    std::cerr << "usage: perf_reader_bench <perf.data> [iterations]\n";
+    return 1;
+  }
+  const std::string path = argv[1];
+  const int iterations   = argc > 2 ? std::stoi(argv[2]) : 3;
+  const double file_mb =
+    static_cast<double>(std::filesystem::file_size(path)) / (1024.0 * 1024.0);
+
+  std::cout << std::format("{} ({:.1f} MB), {} iterations\n", path, file_mb,
+                           iterations);
+
+  run("native", iterations, file_mb, [&] {
+    PerfDataReader reader(path);
+    return reader.read_samples().size();
+  });
+
+  run("script", iterations, file_mb,
+      [&] { return PerfScriptParser::parse_file(path).size(); });
+
+  return 0;
+}
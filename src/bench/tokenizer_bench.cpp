@@ -0,0 +1,316 @@
+// Lines/sec of the perf script tokenizer: the previous vector + stoull
+// implementation (kept below verbatim) against PerfScriptParser::parse_line.
+// Usage: tokenizer_bench <perf-script.txt> [iterations]
+//   perf script -F tid,pid,cpu,time,event,ip,addr,sym,dso,uregs > out.txt
+#include <cctype>
+#include <chrono>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "common/Utils.hpp"
+#include "runtime/PerfScriptParser.hpp"
+
+namespace legacy {
+
+inline std::optional<uint64_t> parse_hex_u64_stoull(std::string_view sv) {
+  sv = trim(sv);
+  if (sv.starts_with("0x")) sv.remove_prefix(2);
+  if (sv.empty()) return std::nullopt;
+  return std::stoull(std::string(sv), nullptr, 16);
+}
+
+inline std::string lower_copy(std::string_view sv) {
+  std::string out;
+  out.reserve(sv.size());
+  for (char c : sv)
+    out.push_back(
+      static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
+  return out;
+}
+
+void parse_user_regs_from_uregs_tokens(
+  const std::vector<std::string_view>& toks, size_t start_idx, PerfSample& s) {
+  auto try_parse_named_reg = [&](std::string_view tok, std::string_view name,
+                                 uint64_t& out) -> bool {
+    tok = trim(tok);
+    while (!tok.empty() && (tok.back() == ',' || tok.back() == ';'))
+      tok.remove_suffix(1);
+
+    auto lt = lower_copy(tok);
+    auto ln = std::string(name);
+
+    // Accept forms: "sp:", "sp:0x...", "sp=0x..." (and also "rbp:" for bp).
+    if (lt == ln + ":") {
+      return false;  // value is in next token
+    }
+
+    auto starts_with = [&](const std::string& prefix) {
+      return lt.rfind(prefix, 0) == 0;
+    };
+
+    std::string_view val;
+    if (starts_with(ln + ":")) {
+      val = tok.substr(ln.size() + 1);
+    } else if (starts_with(ln + "=")) {
+      val = tok.substr(ln.size() + 1);
+    } else {
+      return false;
+    }
+
+    if (auto v = parse_hex_u64_stoull(val)) {
+      out = *v;
+      return true;
+    }
+    return false;
+  };
+
+  for (size_t i = start_idx; i < toks.size(); ++i) {
+    auto tok = trim(toks[i]);
+    auto lt  = lower_copy(tok);
+
+    // "SP:" or "sp:" with value in next token
+    if (lt == "sp:" && i + 1 < toks.size()) {
+      if (auto v = parse_hex_u64_stoull(toks[i + 1])) s.sp = *v;
+      continue;
+    }
+
+    // "BP:"/"RBP:" or "bp:" with value in next token
+    if ((lt == "bp:" || lt == "rbp:") && i + 1 < toks.size()) {
+      if (auto v = parse_hex_u64_stoull(toks[i + 1])) s.bp = *v;
+      continue;
+    }
+
+    (void)try_parse_named_reg(tok, "sp", s.sp);
+    (void)try_parse_named_reg(tok, "bp", s.bp);
+    (void)try_parse_named_reg(tok, "rbp", s.bp);
+  }
+}
+
+std::optional<PerfSample> parse_line(std::string_view line) {
+  line = trim(line);
+  if (line.empty() || line[0] == '#') return std::nullopt;
+
+  PerfSample s{};
+
+  // Tokenize by whitespace
+  std::vector<std::string_view> toks;
+  size_t pos = 0;
+  while (pos < line.size()) {
+    size_t start = line.find_first_not_of(" \t", pos);
+    if (start == std::string_view::npos) break;
+
+    size_t end = line.find_first_of(" \t", start);
+    toks.push_back(line.substr(start, end - start));
+    pos = end;
+  }
+
+  // Minimum expected:
+  // pid/tid [cpu] ip addr sym...
+  if (toks.size() < 5) return std::nullopt;
+
+  size_t idx = 0;
+
+  // Handle optional comm name (non pid/tid token)
+  if (toks[0].find('/') == std::string_view::npos) {
+    idx++;
+    if (toks.size() - idx < 5) return std::nullopt;
+  }
+
+  // pid/tid
+  auto slash = toks[idx].find('/');
+  if (slash == std::string_view::npos) return std::nullopt;
+
+  s.pid = std::stoul(std::string(toks[idx].substr(0, slash)));
+  s.tid = std::stoul(std::string(toks[idx].substr(slash + 1)));
+  idx++;
+
+  // [cpu]
+  if (toks[idx].front() != '[' || toks[idx].back() != ']') return std::nullopt;
+
+  s.cpu = std::stoul(std::string(toks[idx].substr(1, toks[idx].size() - 2)));
+  idx++;
+
+  // Optional time token (when perf script -F includes time)
+  // Usually formatted like "12345.678901" or "12345.678901:".
+  if (idx < toks.size()) {
+    auto tt = toks[idx];
+    if (!tt.empty() && tt.back() == ':') tt = tt.substr(0, tt.size() - 1);
+
+    if (tt.find_first_not_of("0123456789.") == std::string_view::npos &&
+        tt.find('.') != std::string_view::npos) {
+      auto dot      = tt.find('.');
+      uint64_t secs = 0, nsecs = 0;
+      try {
+        secs      = std::stoull(std::string(tt.substr(0, dot)));
+        auto frac = std::string(tt.substr(dot + 1));
+        if (frac.size() > 9) frac.resize(9);
+        while (frac.size() < 9) frac.push_back('0');
+        nsecs = std::stoull(frac);
+      } catch (...) {
+        secs  = 0;
+        nsecs = 0;
+      }
+      s.time_stamp = secs * 1000000000ULL + nsecs;
+      idx++;
+    }
+  }
+
+  // event types (often ends with ':')
+  std::string event_str = std::string(toks[idx]);
+  if (!event_str.empty() && event_str.back() == ':') event_str.pop_back();
+  idx++;
+
+  if (event_str == "mem-stores:pp" ||
+      event_str.find("store") != std::string::npos)
+    s.event_type = SampleType::CACHE_STORE;
+  else if (event_str == "mem-loads:pp" ||
+           event_str.find("load") != std::string::npos)
+    s.event_type = SampleType::CACHE_LOAD;
+  else
+    s.event_type = SampleType::CACHE_LOAD;  // Generic / IBS: treat as access
+
+  // perf prints two addresses for these events; for memory-access sampling
+  // (ibs_op, mem-loads/stores) the first is typically the accessed address and
+  // the second is the instruction pointer.
+  s.addr = std::stoull(std::string(toks[idx]), nullptr, 16);
+  idx++;
+  s.ip = std::stoull(std::string(toks[idx]), nullptr, 16);
+  idx++;
+
+  // Remaining tokens contain sym and dso, but sym can include whitespace (e.g.
+  // "thread_method(PaddedCounter*, int)"). dso is reliably a single token like
+  // "(/path/to/bin)" or "([kernel.kallsyms])".
+  size_t dso_idx = toks.size();
+  for (size_t i = idx; i < toks.size(); ++i) {
+    auto t = trim(toks[i]);
+    if (t.size() >= 2 && t.front() == '(' && t.back() == ')') {
+      dso_idx = i;
+      break;
+    }
+  }
+
+  if (dso_idx != toks.size()) {
+    // symbol is everything between idx and dso_idx
+    std::string sym;
+    for (size_t i = idx; i < dso_idx; ++i) {
+      if (!sym.empty()) sym.push_back(' ');
+      sym += std::string(toks[i]);
+    }
+    s.symbol = sym;
+
+    auto dso_tok = trim(toks[dso_idx]);
+    dso_tok.remove_prefix(1);
+    dso_tok.remove_suffix(1);
+    s.dso = std::string(dso_tok);
+
+    idx = dso_idx + 1;
+  } else {
+    // Fallback: old behavior
+    if (idx < toks.size()) {
+      s.symbol = std::string(toks[idx]);
+      idx++;
+    }
+    if (idx < toks.size()) {
+      s.dso = std::string(toks[idx]);
+      idx++;
+    }
+  }
+
+  // Optional sampled user registers (we record SP/BP via perf record
+  // --user-regs=sp,bp). perf formatting varies across versions.
+  parse_user_regs_from_uregs_tokens(toks, idx, s);
+
+  return s;
+}
+
+}  // namespace legacy
+
+static bool same_sample(const PerfSample& a, const PerfSample& b) {
+  return a.tid == b.tid && a.pid == b.pid && a.cpu == b.cpu && a.ip == b.ip &&
+         a.addr == b.addr && a.sp == b.sp && a.bp == b.bp &&
+         a.time_stamp == b.time_stamp && a.event_type == b.event_type &&
+         a.symbol == b.symbol && a.dso == b.dso;
+}
+
+template <typename F>
+static double run(const std::string& name, int iterations, size_t lines,
+                  F&& parse) {
+  double best   = 0.0;
+  uint64_t sink = 0;
+  for (int i = 0; i < iterations; ++i) {
+    auto t0  = std::chrono::steady_clock::now();
+    sink     = parse();
+    auto t1  = std::chrono::steady_clock::now();
+    double s = std::chrono::duration<double>(t1 - t0).count();
+    best     = (i == 0) ? s : std::min(best, s);
+  }
+  const double rate = lines / best;
+  std::cout << std::format(
+    "{:<8} lines={:<10} best={:.3f}s  {:.2f} Mlines/s  (checksum {:x})\n",
+    name, lines, best, rate / 1e6, sink);
+  return rate;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    std::cerr << "usage: tokenizer_bench <perf-script.txt> [iterations]\n";
+    return 1;
+  }
+  const int iterations = argc > 2 ? std::stoi(argv[2]) : 5;
+
+  std::ifstream in(argv[1], std::ios::binary);
+  if (!in) {
+    std::cerr << std::format("cannot open {}\n", argv[1]);
+    return 1;
+  }
+  std::stringstream ss;
+  ss << in.rdbuf();
+  const std::string text = ss.str();
+
+  std::vector<std::string_view> lines;
+  std::string_view rest = text;
+  while (!rest.empty()) {
+    auto nl = rest.find('\n');
+    lines.push_back(rest.substr(0, nl));
+    rest = (nl == std::string_view::npos) ? std::string_view{}
+                                          : rest.substr(nl + 1);
+  }
+
+  size_t mismatches = 0;
+  PerfSample sample{};
+  for (auto line : lines) {
+    auto old_sample = legacy::parse_line(line);
+    bool ok         = PerfScriptParser::parse_line(line, sample);
+    if (old_sample.has_value() != ok ||
+        (ok && !same_sample(*old_sample, sample)))
+      ++mismatches;
+  }
+  if (mismatches) {
+    std::cout << std::format("warning: {} lines parse differently\n",
+                             mismatches);
+  }
+
+  const double before = run("legacy", iterations, lines.size(), [&] {
+    uint64_t sink = 0;
+    for (auto line : lines) {
+      if (auto s = legacy::parse_line(line)) sink += s->addr ^ s->sp;
+    }
+    return sink;
+  });
+  const double after = run("current", iterations, lines.size(), [&] {
+    uint64_t sink = 0;
+    PerfSample s{};
+    for (auto line : lines) {
+      if (PerfScriptParser::parse_line(line, s)) sink += s.addr ^ s.sp;
+    }
+    return sink;
+  });
+  std::cout << std::format("speedup: {:.2f}x\n", after / before);
+  return 0;
+}
@@ -0,0 +1,384 @@
+#include "dwarf/DwarfExpr.hpp"
+
+#include <libdwarf/dwarf.h>
+
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Bounds-checked reader over the expression bytes.
+struct ExprCursor {
+  const uint8_t* begin;
+  const uint8_t* p;
+  const uint8_t* end;
+  bool ok = true;
+
+  template <typename T>
+  T fixed() {
+    T v{};
+    if (static_cast<size_t>(end - p) < sizeof(T)) {
+      ok = false;
+      return v;
+    }
+    std::memcpy(&v, p, sizeof(T));
+    p += sizeof(T);
+    return v;
+  }
+
+  uint64_t uleb() {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (p >= end) break;
+      const uint8_t byte = *p++;
+      v |= uint64_t(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) return v;
+    }
+    ok = false;
+    return v;
+  }
+
+  int64_t sleb() {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (p >= end) break;
+      const uint8_t byte = *p++;
+      v |= uint64_t(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) {
+        if (shift + 7 < 64 && (byte & 0x40)) v |= ~uint64_t{0} << (shift + 7);
+        return static_cast<int64_t>(v);
+      }
+    }
+    ok = false;
+    return static_cast<int64_t>(v);
+  }
+
+  // DW_OP_skip/bra: a signed 2-byte offset from the end of the operand.
+  void branch(int16_t offset) {
+    const ptrdiff_t target = (p - begin) + offset;
+    if (target < 0 || target > end - begin)
+      ok = false;
+    else
+      p = begin + target;
+  }
+};
+
+}  // namespace
+
+// `a op b`, where `b` was pushed last (DW_OP_minus is a - b). nullopt on
+// division by zero.
+static std::optional<uint64_t> binary(uint8_t op, uint64_t a, uint64_t b) {
+  const auto sa = static_cast<int64_t>(a);
+  const auto sb = static_cast<int64_t>(b);
+  switch (op) {
+    case DW_OP_and:
+      return a & b;
+    case DW_OP_or:
+      return a | b;
+    case DW_OP_xor:
+      return a ^ b;
+    case DW_OP_plus:
+      return a + b;
+    case DW_OP_minus:
+      return a - b;
+    case DW_OP_mul:
+      return a * b;
+    case DW_OP_div:
+      if (b == 0 || (sa == INT64_MIN && sb == -1)) return std::nullopt;
+      return static_cast<uint64_t>(sa / sb);
+    case DW_OP_mod:
+      if (b == 0) return std::nullopt;
+      return a % b;
+    case DW_OP_shl:
+      return b < 64 ? a << b : 0;
+    case DW_OP_shr:
+      return b < 64 ? a >> b : 0;
+    case DW_OP_shra:
+      return static_cast<uint64_t>(sa >> (b < 64 ? b : 63));
+    case DW_OP_eq:
+      return sa == sb;
+    case DW_OP_ne:
+      return sa != sb;
+    case DW_OP_lt:
+      return sa < sb;
+    case DW_OP_le:
+      return sa <= sb;
+    case DW_OP_gt:
+      return sa > sb;
+    case DW_OP_ge:
+      return sa >= sb;
+    default:
+      return std::nullopt;
+  }
+}
+
+std::optional<uint64_t> DwarfExpr::evaluate(std::span<const uint8_t> expr,
+                                            const RegReader& reg,
+                                            std::optional<uint64_t> initial) {
+  std::vector<uint64_t> stack;
+  stack.reserve(16);
+  if (initial) stack.push_back(*initial);
+
+  ExprCursor c{expr.data(), expr.data(), expr.data() + expr.size()};
+  auto push = [&](uint64_t v) {
+    if (stack.size() >= MAX_STACK)
+      c.ok = false;
+    else
+      stack.push_back(v);
+  };
+  auto pop = [&]() -> uint64_t {
+    if (stack.empty()) {
+      c.ok = false;
+      return 0;
+    }
+    const uint64_t v = stack.back();
+    stack.pop_back();
+    return v;
+  };
+  auto breg = [&](unsigned n, int64_t offset) {
+    const auto base = reg(n);
+    if (!base)
+      c.ok = false;
+    else
+      push(*base + static_cast<uint64_t>(offset));
+  };
+
+  for (size_t steps = 0; c.ok && c.p < c.end; ++steps) {
+    if (steps == MAX_STEPS) return std::nullopt;
+    const uint8_t op = *c.p++;
+
+    if (op >= DW_OP_lit0 && op <= DW_OP_lit31) {
+      push(op - DW_OP_lit0);
+      continue;
+    }
+    if (op >= DW_OP_breg0 && op <= DW_OP_breg31) {
+      breg(op - DW_OP_breg0, c.sleb());
+      continue;
+    }
+
+    switch (op) {
+      case DW_OP_addr:
+        push(c.fixed<uint64_t>());
+        break;
+      case DW_OP_const1u:
+        push(c.fixed<uint8_t>());
+        break;
+      case DW_OP_const1s:
+        push(static_cast<uint64_t>(int64_t{c.fixed<int8_t>()}));
+        break;
+      case DW_OP_const2u:
+        push(c.fixed<uint16_t>());
+        break;
+      case DW_OP_const2s:
+        push(static_cast<uint64_t>(int64_t{c.fixed<int16_t>()}));
+        break;
+      case DW_OP_const4u:
+        push(c.fixed<uint32_t>());
+        break;
+      case DW_OP_const4s:
+        push(static_cast<uint64_t>(int64_t{c.fixed<int32_t>()}));
+        break;
+      case DW_OP_const8u:
+      case DW_OP_const8s:
+        push(c.fixed<uint64_t>());
+        break;
+      case DW_OP_constu:
+        push(c.uleb());
+        break;
+      case DW_OP_consts:
+        push(static_cast<uint64_t>(c.sleb()));
+        break;
+      case DW_OP_bregx: {
+        const uint64_t n = c.uleb();
+        breg(static_cast<unsigned>(n), c.sleb());
+        break;
+      }
+
+      case DW_OP_dup: {
+        const uint64_t a = pop();
+        push(a);
+        push(a);
+        break;
+      }
+      case DW_OP_drop:
+        pop();
+        break;
+      case DW_OP_over:
+        if (stack.size() < 2)
+          c.ok = false;
+        else
+          push(stack[stack.size() - 2]);
+        break;
+      case DW_OP_pick: {
+        const uint8_t i = c.fixed<uint8_t>();
+        if (i >= stack.size())
+          c.ok = false;
+        else
+          push(stack[stack.size() - 1 - i]);
+        break;
+      }
+      case DW_OP_swap:
+        if (stack.size() < 2)
+          c.ok = false;
+        else
+          std::swap(stack[stack.size() - 1], stack[stack.size() - 2]);
+        break;
+      case DW_OP_rot: {
+        // The top entry moves under the next two.
+        const uint64_t a = pop();
+        const uint64_t b = pop();
+        const uint64_t d = pop();
+        push(a);
+        push(d);
+        push(b);
+        break;
+      }
+
+      case DW_OP_abs: {
+        const auto a = static_cast<int64_t>(pop());
+        push(static_cast<uint64_t>(a < 0 ? -a : a));
+        break;
+      }
+      case DW_OP_neg:
+        push(-pop());
+        break;
+      case DW_OP_not:
+        push(~pop());
+        break;
+      case DW_OP_plus_uconst:
+        push(pop() + c.uleb());
+        break;
+
+      case DW_OP_and:
+      case DW_OP_or:
+      case DW_OP_xor:
+      case DW_OP_plus:
+      case DW_OP_minus:
+      case DW_OP_mul:
+      case DW_OP_div:
+      case DW_OP_mod:
+      case DW_OP_shl:
+      case DW_OP_shr:
+      case DW_OP_shra:
+      case DW_OP_eq:
+      case DW_OP_ne:
+      case DW_OP_lt:
+      case DW_OP_le:
+      case DW_OP_gt:
+      case DW_OP_ge: {
+        const uint64_t b = pop();
+        const uint64_t a = pop();
+        const auto v     = binary(op, a, b);
+        if (!v) return std::nullopt;
+        push(*v);
+        break;
+      }
+
+      case DW_OP_skip:
+        c.branch(c.fixed<int16_t>());
+        break;
+      case DW_OP_bra: {
+        const int16_t offset = c.fixed<int16_t>();
+        if (pop() != 0) c.branch(offset);
+        break;
+      }
+      case DW_OP_nop:
+        break;
+
+      default:
+        // DW_OP_deref*, DW_OP_reg*, DW_OP_fbreg, DW_OP_call*, ...
+        return std::nullopt;
+    }
+  }
+
+  if (!c.ok || stack.empty()) return std::nullopt;
+  return stack.back();
+}
+
+uint32_t DwarfExpr::registers(std::span<const uint8_t> expr) {
+  uint32_t mask = 0;
+  auto read     = [&](uint64_t n) {
+    if (n < 32) mask |= 1u << n;
+  };
+
+  // Every operation once, skipping operands; branches need not be followed.
+  ExprCursor c{expr.data(), expr.data(), expr.data() + expr.size()};
+  while (c.ok && c.p < c.end) {
+    const uint8_t op = *c.p++;
+    if (op >= DW_OP_lit0 && op <= DW_OP_lit31) continue;
+    if (op >= DW_OP_breg0 && op <= DW_OP_breg31) {
+      read(op - DW_OP_breg0);
+      c.sleb();
+      continue;
+    }
+
+    switch (op) {
+      case DW_OP_addr:
+      case DW_OP_const8u:
+      case DW_OP_const8s:
+        c.fixed<uint64_t>();
+        break;
+      case DW_OP_const1u:
+      case DW_OP_const1s:
+      case DW_OP_pick:
+        c.fixed<uint8_t>();
+        break;
+      case DW_OP_const2u:
+      case DW_OP_const2s:
+      case DW_OP_skip:
+      case DW_OP_bra:
+        c.fixed<uint16_t>();
+        break;
+      case DW_OP_const4u:
+      case DW_OP_const4s:
+        c.fixed<uint32_t>();
+        break;
+      case DW_OP_constu:
+      case DW_OP_plus_uconst:
+        c.uleb();
+        break;
+      case DW_OP_consts:
+        c.sleb();
+        break;
+      case DW_OP_bregx:
+        read(c.uleb());
+        c.sleb();
+        break;
+
+      case DW_OP_dup:
+      case DW_OP_drop:
+      case DW_OP_over:
+      case DW_OP_swap:
+      case DW_OP_rot:
+      case DW_OP_abs:
+      case DW_OP_neg:
+      case DW_OP_not:
+      case DW_OP_and:
+      case DW_OP_or:
+      case DW_OP_xor:
+      case DW_OP_plus:
+      case DW_OP_minus:
+      case DW_OP_mul:
+      case DW_OP_div:
+      case DW_OP_mod:
+      case DW_OP_shl:
+      case DW_OP_shr:
+      case DW_OP_shra:
+      case DW_OP_eq:
+      case DW_OP_ne:
+      case DW_OP_lt:
+      case DW_OP_le:
+      case DW_OP_gt:
+      case DW_OP_ge:
+      case DW_OP_nop:
+        break;
+
+      default:
+        // evaluate() fails here, whatever the registers hold.
+        return mask;
+    }
+  }
+  return mask;
+}
@@ -7,7 +7,6 @@
 #include <cstdint>
 #include <cstring>
 #include <memory>
-#include <unordered_map>
 
 #include "dwarf/DwarfContext.hpp"
 
@@ -75,6 +74,48 @@ static TypeKind tag_to_kind(Dwarf_Half tag) {
   }
 }
 
+static bool udata_attr(Dwarf_Debug dbg, Dwarf_Die die, Dwarf_Half name,
+                       Dwarf_Unsigned& out) {
+  Dwarf_Attribute attr = nullptr;
+  if (dwarf_attr(die, name, &attr, nullptr) != DW_DLV_OK) return false;
+  const bool ok = dwarf_formudata(attr, &out, nullptr) == DW_DLV_OK;
+  dwarf_dealloc(dbg, attr, DW_DLA_ATTR);
+  return ok;
+}
+
+// DW_AT_data_member_location: a constant, or (DWARF 2 producers) an
+// expression that is a single DW_OP_plus_uconst.
+static bool member_location(Dwarf_Debug dbg, Dwarf_Die die,
+                            Dwarf_Unsigned& out) {
+  Dwarf_Attribute attr = nullptr;
+  if (dwarf_attr(die, DW_AT_data_member_location, &attr, nullptr) !=
+      DW_DLV_OK)
+    return false;
+  bool ok = dwarf_formudata(attr, &out, nullptr) == DW_DLV_OK;
+
+  Dwarf_Unsigned exprlen = 0;
+  Dwarf_Ptr expr         = nullptr;
+  if (!ok && dwarf_formexprloc(attr, &exprlen, &expr, nullptr) == DW_DLV_OK) {
+    const uint8_t* p   = static_cast<const uint8_t*>(expr);
+    const uint8_t* end = p + exprlen;
+    if (p < end && *p++ == DW_OP_plus_uconst) {
+      out       = 0;
+      int shift = 0;
+      while (p < end && shift < 64) {
+        const uint8_t byte = *p++;
+        out |= Dwarf_Unsigned(byte & 0x7f) << shift;
+        shift += 7;
+        if ((byte & 0x80) == 0) {
+          ok = true;
+          break;
+        }
+      }
+    }
+  }
+  dwarf_dealloc(dbg, attr, DW_DLA_ATTR);
+  return ok;
+}
+
 /* ============================================================
  * DW_OP_fbreg extraction
  * ============================================================ */
@@ -317,8 +358,9 @@ TypeInfo* Extractor::get_or_create_type(Dwarf_Die die, int depth) {
                                         : (base ? base->name : "<unknown>"));
   }
 
-  // ---------- Struct / Class ----------
-  else if (raw->kind == TypeKind::Struct || raw->kind == TypeKind::Class) {
+  // ---------- Struct / Class / Union ----------
+  else if (raw->kind == TypeKind::Struct || raw->kind == TypeKind::Class ||
+           raw->kind == TypeKind::Union) {
     Dwarf_Bool is_decl = 0;
     if (dwarf_hasattr(die, DW_AT_declaration, &is_decl, nullptr) != DW_DLV_OK)
       is_decl = 0;
@@ -423,7 +465,8 @@ void Extractor::process_subprogram_die(Dwarf_Die die) {
 void Extractor::process_struct_die(Dwarf_Die die) {
   TypeInfo* type = get_or_create_type(die);
   if (!type ||
-      (type->kind != TypeKind::Struct && type->kind != TypeKind::Class))
+      (type->kind != TypeKind::Struct && type->kind != TypeKind::Class &&
+       type->kind != TypeKind::Union))
     return;
 
   StructInfo info;
@@ -437,40 +480,68 @@ void Extractor::process_struct_die(Dwarf_Die die) {
     return;
   }
 
+  Dwarf_Debug dbg = context.dbg();
   for (Dwarf_Die cur = child; cur;) {
     Dwarf_Half tag = 0;
     dwarf_tag(cur, &tag, nullptr);
 
-    if (tag == DW_TAG_member) {
-      auto field  = std::make_unique<FieldInfo>();
-      field->name = die_name(context.dbg(), cur);
+    // Static data members are declarations (DWARF 4) and take no space.
+    Dwarf_Bool is_decl = 0;
+    if (dwarf_hasattr(cur, DW_AT_declaration, &is_decl, nullptr) != DW_DLV_OK)
+      is_decl = 0;
+
+    if (!is_decl && (tag == DW_TAG_member || tag == DW_TAG_inheritance)) {
+      auto field = std::make_unique<FieldInfo>();
 
-      // Member offset within the struct
-      Dwarf_Attribute off_attr = nullptr;
+      // Member offset within the struct; union members have none.
       Dwarf_Unsigned off = 0;
-      if (dwarf_attr(cur, DW_AT_data_member_location, &off_attr, nullptr) ==
-            DW_DLV_OK &&
-          dwarf_formudata(off_attr, &off, nullptr) == DW_DLV_OK) {
-        field->offset = static_cast<size_t>(off);
-      }
-      if (off_attr) dwarf_dealloc(context.dbg(), off_attr, DW_DLA_ATTR);
+      member_location(dbg, cur, off);
+      field->offset = static_cast<size_t>(off);
 
-      Dwarf_Die type_die = resolve_type_die(context.dbg(), cur);
+      Dwarf_Die type_die = resolve_type_die(dbg, cur);
       field->type        = get_or_create_type(type_die);
       field->size        = field->type ? field->type->size : 0;
 
-      type->fields.push_back(field.get());
-      info.fields.push_back(*field);
-      owned_fields.emplace_back(std::move(field));
+      if (tag == DW_TAG_inheritance) {
+        field->name = field->type ? field->type->name : "<anonymous>";
+        type->bases.push_back(field.get());
+        owned_fields.emplace_back(std::move(field));
+      } else {
+        field->name = die_name(dbg, cur);
+
+        // Bitfields: DWARF 4 gives the bit offset from the start of the
+        // struct, DWARF 2/3 from the most significant bit of a storage unit
+        // at the member location. Little-endian only, like the rest.
+        Dwarf_Unsigned bits = 0;
+        if (udata_attr(dbg, cur, DW_AT_bit_size, bits) && bits > 0) {
+          Dwarf_Unsigned first = off * 8;
+          Dwarf_Unsigned value = 0;
+          if (udata_attr(dbg, cur, DW_AT_data_bit_offset, value)) {
+            first = value;
+          } else if (udata_attr(dbg, cur, DW_AT_bit_offset, value)) {
+            Dwarf_Unsigned unit = field->size;
+            udata_attr(dbg, cur, DW_AT_byte_size, unit);
+            first = off * 8 + unit * 8 - value - bits;
+          }
+          field->bit_size   = bits;
+          field->bit_offset = first % 8;
+          field->offset     = static_cast<size_t>(first / 8);
+          field->size =
+            static_cast<size_t>((field->bit_offset + bits + 7) / 8);
+        }
+
+        type->fields.push_back(field.get());
+        info.fields.push_back(*field);
+        owned_fields.emplace_back(std::move(field));
+      }
     }
 
     Dwarf_Die sib = nullptr;
-    if (dwarf_siblingof_b(context.dbg(), cur, true, &sib, nullptr) !=
-        DW_DLV_OK) {
-      dwarf_dealloc(context.dbg(), cur, DW_DLA_DIE);
+    if (dwarf_siblingof_b(dbg, cur, true, &sib, nullptr) != DW_DLV_OK) {
+      dwarf_dealloc(dbg, cur, DW_DLA_DIE);
       break;
     }
-    dwarf_dealloc(context.dbg(), cur, DW_DLA_DIE);
+    dwarf_dealloc(dbg, cur, DW_DLA_DIE);
     cur = sib;
   }
 
@@ -485,8 +556,10 @@ void Extractor::process_die_tree(Dwarf_Die die) {
   Dwarf_Half tag = 0;
   dwarf_tag(die, &tag, nullptr);
 
-  if (tag == DW_TAG_structure_type || tag == DW_TAG_class_type)
-    process_struct_die(die);
+  // Creating the type fills in its members, once per DIE.
+  if (tag == DW_TAG_structure_type || tag == DW_TAG_class_type ||
+      tag == DW_TAG_union_type)
+    get_or_create_type(die);
   else if (tag == DW_TAG_subprogram) {
     process_subprogram_die(die);
     return;
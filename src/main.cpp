@@ -3,26 +3,48 @@
 
 #include <CLI/CLI.hpp>
 #include <algorithm>
-#include <array>
-#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
 #include <cstdio>
 #include <filesystem>
 #include <format>
 #include <fstream>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <numbers>
 #include <optional>
 #include <ranges>
 #include <string>
 #include <string_view>
+#include <unordered_set>
 #include <vector>
 
+#include "common/FlatMap.hpp"
 #include "common/Types.hpp"
+#include "common/Utils.hpp"
+#include "dwarf/DwarfExpr.hpp"
 #include "dwarf/Extractor.hpp"
+#include "preload/HeapLog.hpp"
+#include "runtime/AllocationTracker.hpp"
+#include "runtime/CfaRegisters.hpp"
+#include "runtime/CpuTopology.hpp"
+#include "runtime/ElfSymbolTable.hpp"
 #include "runtime/FalseSharingAnalysis.hpp"
+#include "runtime/ModuleSet.hpp"
+#include "runtime/PerfDataReader.hpp"
+#include "runtime/PerfRecorder.hpp"
+#include "runtime/PerfScriptParser.hpp"
+#include "runtime/PhaseAnalysis.hpp"
 #include "runtime/PipeStream.hpp"
+#include "runtime/ProcMaps.hpp"
+#include "runtime/SampleCache.hpp"
 #include "runtime/SampleStats.hpp"
+#include "runtime/SampleStore.hpp"
+#include "runtime/StaticIndex.hpp"
+#include "runtime/TransferMatrix.hpp"
+#include "runtime/TypeLayout.hpp"
 
 // Detect CPU vendor from /proc/cpuinfo
 static std::string detect_cpu_vendor() {
@@ -51,13 +73,6 @@ static std::string get_default_mem_events() {
   return "cpu-cycles";
 }
 
-static inline std::string_view trim(std::string_view sv) {
-  auto b = sv.find_first_not_of(" \t\n");
-  auto e = sv.find_last_not_of(" \t\n");
-  if (b == std::string_view::npos) return {};
-  return sv.substr(b, e - b + 1);
-}
-
 static inline std::string_view base_symbol(std::string_view sym) {
   sym = trim(sym);
   // perf often prints "foo+0xNN"; DWARF subprogram DIE names are just "foo".
@@ -69,394 +84,940 @@ static inline std::string_view base_symbol(std::string_view sym) {
   return trim(sym);
 }
 
-static std::optional<uint64_t> parse_hex_u64(std::string_view sv) {
-  sv = trim(sv);
-  if (sv.starts_with("0x")) sv.remove_prefix(2);
-  if (sv.empty()) return std::nullopt;
-  uint64_t v = 0;
-  v          = std::stoull(std::string(sv), nullptr, 16);
-  return v;
-}
+static std::optional<uint64_t> compute_cfa_for_sample(CfaTable& cfa,
+                                                      const SampleStore& s,
+                                                      size_t i,
+                                                      uint64_t pc_query) {
+  const CfaRule rule = cfa.at(pc_query);
+  if (rule.kind == CfaRule::EXPRESSION) {
+    // DW_CFA_def_cfa_expression: the expression's value is the CFA.
+    auto reg = [&](unsigned n) { return s.reg(i, n); };
+    return DwarfExpr::evaluate(cfa.expression(rule), reg);
+  }
+  if (rule.kind != CfaRule::REGISTER) return std::nullopt;
 
-static inline std::string lower_copy(std::string_view sv) {
-  std::string out;
-  out.reserve(sv.size());
-  for (char c : sv)
-    out.push_back(
-      static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
-  return out;
-}
+  const auto base = s.reg(i, rule.reg);
+  if (!base) return std::nullopt;
 
-static void parse_user_regs_from_uregs_tokens(
-  const std::vector<std::string_view>& toks, size_t start_idx, PerfSample& s) {
-  auto try_parse_named_reg = [&](std::string_view tok, std::string_view name,
-                                 uint64_t& out) -> bool {
-    tok = trim(tok);
-    while (!tok.empty() && (tok.back() == ',' || tok.back() == ';'))
-      tok.remove_suffix(1);
+  const int64_t base_i64 = static_cast<int64_t>(*base);
+  const int64_t cfa_i64  = base_i64 + rule.offset;
+  if (cfa_i64 < 0) return std::nullopt;
+  return static_cast<uint64_t>(cfa_i64);
+}
 
-    auto lt = lower_copy(tok);
-    auto ln = std::string(name);
+static bool run_perf_record(const std::string& binary,
+                            const std::string& output_file,
+                            const std::string& event, int sample_rate,
+                            const std::vector<std::string>& env = {}) {
+  auto count_str = std::to_string(sample_rate);
+
+  std::vector<const char*> args = {
+    "perf", "record", "-e", event.c_str(),
+    "-d",                 // Record addresses
+    "--sample-cpu",       // Record CPU
+    // Every general-purpose register, for CFA rules on any of them
+    "--user-regs=ax,bx,cx,dx,si,di,bp,sp,r8,r9,r10,r11,r12,r13,r14,r15",
+    "-c", count_str.c_str(),  // Sample period
+    "-o", output_file.c_str()};
+  // Extra variables (LD_PRELOAD) go to the workload through env(1), so that
+  // perf itself does not load them; its timestamps then have to match the
+  // heap tracer's clock.
+  if (!env.empty()) {
+    args.insert(args.end(), {"-k", "CLOCK_MONOTONIC", "--", "env"});
+    for (const auto& v : env) args.push_back(v.c_str());
+  } else {
+    args.push_back("--");
+  }
+  args.push_back(binary.c_str());
+  args.push_back(nullptr);
 
-    // Accept forms: "sp:", "sp:0x...", "sp=0x..." (and also "rbp:" for bp).
-    if (lt == ln + ":") {
-      return false;  // value is in next token
-    }
+  pid_t perf_pid = fork();
 
-    auto starts_with = [&](const std::string& prefix) {
-      return lt.rfind(prefix, 0) == 0;
-    };
+  if (perf_pid == 0) {
+    // Child: exec perf record
+    execvp("perf", const_cast<char* const*>(args.data()));
 
-    std::string_view val;
-    if (starts_with(ln + ":")) {
-      val = tok.substr(ln.size() + 1);
-    } else if (starts_with(ln + "=")) {
-      val = tok.substr(ln.size() + 1);
-    } else {
-      return false;
-    }
+    // If exec fails
+    perror("execvp perf");
+    _exit(127);
+  }
 
-    if (auto v = parse_hex_u64(val)) {
-      out = *v;
-      return true;
-    }
-    return false;
-  };
+  // Parent: wait for perf to finish
+  int status;
+  waitpid(perf_pid, &status, 0);
 
-  for (size_t i = start_idx; i < toks.size(); ++i) {
-    auto tok = trim(toks[i]);
-    auto lt  = lower_copy(tok);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
 
-    // "SP:" or "sp:" with value in next token
-    if (lt == "sp:" && i + 1 < toks.size()) {
-      if (auto v = parse_hex_u64(toks[i + 1])) s.sp = *v;
-      continue;
+// Decode perf.data natively, or through `perf script` when requested or when
+// the file uses a layout the native reader does not handle. Samples are
+// handed to `fn` as they are decoded, already resolved against `space`,
+// which ends up holding every mapping of the recording. Returns the reader
+// that did the work: "native", or "script" after a fallback too.
+std::string_view parse_perf_data(const std::string& perf_data_file,
+                                 bool native, unsigned jobs, bool verbose,
+                                 const SampleConsumer& fn,
+                                 AddressSpace& space) {
+  if (native) {
+    std::optional<PerfDataReader> reader;
+    try {
+      reader.emplace(perf_data_file);
+    } catch (const std::exception& e) {
+      std::cerr << std::format(
+        "WARNING: native perf.data reader failed ({}); falling back to perf "
+        "script\n",
+        e.what());
     }
-
-    // "BP:"/"RBP:" or "bp:" with value in next token
-    if ((lt == "bp:" || lt == "rbp:") && i + 1 < toks.size()) {
-      if (auto v = parse_hex_u64(toks[i + 1])) s.bp = *v;
-      continue;
+    if (reader) {
+      reader->for_each_sample(fn);
+      space = std::move(reader->decoder().address_space());
+      return "native";
     }
-
-    (void)try_parse_named_reg(tok, "sp", s.sp);
-    (void)try_parse_named_reg(tok, "bp", s.bp);
-    (void)try_parse_named_reg(tok, "rbp", s.bp);
+  } else if (verbose) {
+    std::cout << std::format("Parsing samples with perf script (jobs={})\n",
+                             jobs);
   }
-}
 
-static std::optional<uint64_t> get_load_bias_from_perf_mmaps(
-  const std::string& perf_data_file, const std::string& binary_path,
-  uint32_t pid) {
-  const auto bin_name = std::filesystem::path(binary_path).filename().string();
-  std::string cmd     = std::format(
-    "perf script --show-mmap-events --pid {} -i {} 2>/dev/null | head -n 5000",
-    pid, perf_data_file);
-
-  FILE* pipe = popen(cmd.c_str(), "r");
-  if (!pipe) return std::nullopt;
-
-  std::optional<uint64_t> any_start;
-  std::array<char, 4096> buffer{};
-  int count{};
-  bool found = false;
-
-  while (fgets(buffer.data(), buffer.size(), pipe)) {
-    ++count;
-    std::string line(buffer.data());
-    if (line.find("PERF_RECORD_MMAP") == std::string::npos) continue;
-    if (line.find(binary_path) == std::string::npos &&
-        line.find(bin_name) == std::string::npos)
-      continue;
-
-    auto lb = line.find('[');
-    auto rb = line.find(']', lb);
-    if (lb == std::string::npos || rb == std::string::npos) continue;
+  PerfScriptParser::for_each_sample(perf_data_file, fn, jobs, &space);
+  return "script";
+}
 
-    auto inside    = std::string_view(line).substr(lb + 1, rb - lb - 1);
-    auto start_end = inside.find('(');
-    if (start_end == std::string::npos) continue;
-    auto at_pos = inside.find('@');
-    if (at_pos == std::string::npos) continue;
+void parse_perf_data_ranges(const std::string& perf_data_file,
+                            const SampleConsumer& fn) {
+  std::string cmd = std::format(
+    "perf script -i {} -F tid,pid,cpu,time,ip,addr,sym,dso,uregs 2>/dev/null",
+    perf_data_file);
 
-    auto start_sv = trim(inside.substr(0, start_end));
-    auto pgoff_sv = trim(inside.substr(at_pos + 1));
-    auto sp       = pgoff_sv.find(' ');
-    if (sp != std::string_view::npos) pgoff_sv = pgoff_sv.substr(0, sp);
+  PipeStream pipe(cmd);
+  // Use ranges to transform and filter, one line at a time
+  auto samples =
+    pipe.lines() | std::views::transform([](std::string_view line) {
+      return PerfScriptParser::parse_line(line);
+    }) |
+    std::views::filter([](const auto& opt) { return opt.has_value(); });
+  for (const auto& s : samples) fn(*s);
+}
 
-    auto start = parse_hex_u64(start_sv);
-    auto pgoff = parse_hex_u64(pgoff_sv);
-    if (!start || !pgoff) continue;
+// Phase 1: DWARF extraction
+static void run_dwarf_phase(Extractor& ext, bool verbose) {
+  std::cout << "=== Phase 1: DWARF Analysis ===\n";
+  ext.create_registry();
 
-    any_start = *start;
-    if (*pgoff == 0) {
-      found = true;
-      break;
+  if (verbose) {
+    for (const auto& [k, v] : ext.get_registry().get_map()) {
+      std::cout << std::format("{}: {} bytes\n", k, v.size);
     }
   }
 
-  int status = pclose(pipe);
-  (void)status;  // Optionally handle status
+  std::cout << std::format("Found {} stack objects\n\n",
+                           ext.get_stack_objects().size());
+}
 
-  if (found) return any_start;
-  return any_start;
+// Settings shared by analyze and attach for Phases 4-7.
+struct AnalysisOptions {
+  unsigned jobs    = 1;
+  double window_ms = 0;  // 0: no per-window phase report
+  bool verbose     = false;
+  std::string topology;            // file; empty: this machine's sysfs
+  std::string matrix;              // transfer matrix export; empty: none
+  size_t approx_mb       = 0;      // 0: exact per-line aggregation
+  bool validate_approx   = false;  // also run the exact pass and compare
+  uint64_t sample_period = 1;      // -c: events per sample
+  std::string heap_log;            // heap tracer log; empty: no Phase 7
+};
+
+// The CPU topology the coherence cost model uses: --topology's file, else
+// this machine's. Distances stay unknown when neither can be read.
+static CpuTopology load_topology(const AnalysisOptions& opts) {
+  CpuTopology topology;
+  try {
+    topology = opts.topology.empty()
+                 ? CpuTopology::from_sysfs()
+                 : CpuTopology::from_file(opts.topology);
+  } catch (const std::exception& e) {
+    std::cerr << std::format("WARNING: {}; CPU distances unknown\n",
+                             e.what());
+  }
+  if (opts.verbose) {
+    std::cout << std::format("CPU topology: {} cpus ({})\n", topology.size(),
+                             opts.topology.empty() ? "sysfs" : opts.topology);
+  }
+  return topology;
 }
 
-static std::optional<uint64_t> dwarf_reg_value(const PerfSample& s,
-                                               Dwarf_Signed dwarf_regnum) {
-  // x86_64 DWARF register numbers: 6=RBP, 7=RSP
-  switch (dwarf_regnum) {
-    case 6:
-      return s.bp;
-    case 7:
-      return s.sp;
-    default:
-      return std::nullopt;
+// --approx state, fed while samples stream in. Every sample is counted in
+// the sketch, but only every `stride`-th is stored for the later phases;
+// when the store fills it is thinned and the stride doubles, so memory
+// stays within the budget however long the capture runs. Half the budget
+// goes to the sketch, half to the store. With --validate-approx every
+// sample is stored for the exact pass.
+struct ApproxIngest {
+  ApproxIngest(const AnalysisOptions& opts, const CpuTopology& topology,
+               SampleStore& store)
+    : sketch((opts.approx_mb << 20) / 2, &topology),
+      samples(store),
+      max_rows(opts.validate_approx
+                 ? SIZE_MAX
+                 : std::max<size_t>(
+                     (opts.approx_mb << 20) / 2 / SampleStore::ROW_BYTES, 2)) {
+    if (max_rows != SIZE_MAX) samples.reserve(max_rows);
+  }
+
+  // Counts `s` in the sketch; true when it should also be stored.
+  bool admit(const PerfSample& s) {
+    if (s.addr != 0) sketch.add(s.addr, s.tid, s.cpu, s.event_type);
+    if (offered++ % stride != 0) return false;
+    if (samples.size() < max_rows) return true;
+    samples.thin();
+    stride *= 2;
+    return (offered - 1) % stride == 0;
+  }
+
+  // Feeds rows loaded whole (a sample cache) through admit().
+  void replay(SampleStore loaded) {
+    samples.address_space = std::move(loaded.address_space);
+    samples.sampled_regs  = loaded.sampled_regs;
+    for (size_t i = 0; i < loaded.size(); ++i) {
+      const auto s = loaded.at(i);
+      if (admit(s)) samples.push_back(s, s.regs_mask);
+    }
   }
+
+  CacheLineSketch sketch;
+  SampleStore& samples;
+  size_t max_rows;
+  uint64_t stride  = 1;
+  uint64_t offered = 0;
+};
+
+// Filters samples as they stream in, so dropped samples are never stored.
+// Kernel samples are dropped; with `binary_only`, so is everything not
+// attributed to `binary` (shared libraries, libc/pthread noise). Samples with
+// an unknown dso are kept. `seen` counts every sample. Of the registers
+// beyond sp/bp, only those the CFA rule at a sample's IP reads are stored.
+// With `approx`, kept samples go through its sketch and thinning. CFI is
+// read into `modules`, for Phase 5 to reuse.
+static SampleConsumer keep_user_samples(const std::string& binary,
+                                        bool binary_only, SampleStore& samples,
+                                        size_t& seen, ModuleSet& modules,
+                                        ApproxIngest* approx) {
+  return [&samples, &seen, binary, binary_only, approx,
+          bin_name = std::filesystem::path(binary).filename().string(),
+          cfa_regs = CfaRegisters(modules)](const PerfSample& s) {
+    ++seen;
+    if (s.dso.starts_with("[kernel")) return;
+    if (binary_only && !s.dso.empty() &&
+        s.dso.find(bin_name) == std::string::npos &&
+        s.dso.find(binary) == std::string::npos)
+      return;
+    if (approx && !approx->admit(s)) return;
+    samples.push_back(s, cfa_regs.needed(s));
+  };
 }
 
-static std::optional<uint64_t> compute_cfa_for_sample(Dwarf_Fde* fde_data,
-                                                      const PerfSample& s,
-                                                      uint64_t pc_query) {
-  if (!fde_data) return std::nullopt;
+static void report_in_process(const PerfRecorder& rec, size_t seen,
+                              double secs) {
+  std::cout << std::format(
+    "Recording completed in-process: {} samples in {:.2f}s ({} CPUs, {} "
+    "lost)\n\n",
+    seen, secs, rec.cpus(), rec.lost());
+  std::cout << "=== Phase 3: Sample Parsing ===\n";
+  std::cout << "Samples were decoded from the ring buffers while recording "
+               "(recorder=builtin)\n";
+}
 
-  Dwarf_Fde fde   = nullptr;
-  Dwarf_Addr lopc = 0, hipc = 0;
-  Dwarf_Error err = nullptr;
-  if (dwarf_get_fde_at_pc(fde_data, pc_query, &fde, &lopc, &hipc, &err) !=
-      DW_DLV_OK) {
+// "30s", "500ms", "2m", "1h"; a bare number is seconds.
+static std::optional<std::chrono::milliseconds> parse_duration(
+  std::string_view sv) {
+  double value   = 0;
+  auto [ptr, ec] = std::from_chars(sv.data(), sv.data() + sv.size(), value);
+  if (ec != std::errc{} || value <= 0) return std::nullopt;
+
+  const std::string_view unit(ptr, sv.data() + sv.size() - ptr);
+  double ms = 0;
+  if (unit.empty() || unit == "s") {
+    ms = value * 1e3;
+  } else if (unit == "ms") {
+    ms = value;
+  } else if (unit == "m") {
+    ms = value * 60e3;
+  } else if (unit == "h") {
+    ms = value * 3600e3;
+  } else {
     return std::nullopt;
   }
+  return std::chrono::milliseconds(static_cast<int64_t>(ms));
+}
 
-  Dwarf_Small value_type       = 0;
-  Dwarf_Signed offset_relevant = 0;
-  Dwarf_Signed regnum          = 0;
-  Dwarf_Signed offset_or_len   = 0;
-  Dwarf_Ptr block_ptr          = nullptr;
-  Dwarf_Addr row_pc            = 0;
+// Environment that makes a launched workload load the heap tracer and log to
+// `log`, keeping any LD_PRELOAD it already had.
+static std::vector<std::string> heap_tracer_env(const std::string& log) {
+  std::string preload = CACHESCOPE_HEAP_TRACER;
+  if (const char* old = getenv("LD_PRELOAD"); old && *old)
+    preload += std::format(":{}", old);
+  return {"LD_PRELOAD=" + preload, std::format("{}={}", HEAP_LOG_ENV, log)};
+}
 
-  if (dwarf_get_fde_info_for_cfa_reg3(fde, pc_query, &value_type,
-                                      &offset_relevant, &regnum, &offset_or_len,
-                                      &block_ptr, &row_pc, &err) != DW_DLV_OK) {
-    return std::nullopt;
+// Phase 7: the heap block each sample touched, from the heap tracer log.
+// Shared hot lines are broken down by allocation site and offset into the
+// block; a line whose samples fall in several blocks is allocator-made false
+// sharing. Returns transfer matrices per allocation site.
+static std::map<std::string, TransferMatrix> run_heap_phase(
+  const SampleStore& samples, const std::vector<CacheLine>& hot_lines,
+  const std::string& log) {
+  std::cout << "=== Phase 7: Heap Attribution ===\n";
+  std::map<std::string, TransferMatrix> by_site;
+  std::optional<AllocationTracker> heap;
+  try {
+    heap = AllocationTracker::load(log);
+  } catch (const std::exception& e) {
+    std::cerr << std::format("WARNING: {}; heap attribution skipped\n",
+                             e.what());
+    return by_site;
   }
+  std::cout << std::format("Loaded {} heap events ({} blocks) from {}\n",
+                           heap->events(), heap->allocations().size(), log);
+
+  // Allocation sites are named once each, by the function they return to.
+  std::unordered_map<std::string, std::unique_ptr<ElfSymbolTable>> symtabs;
+  std::unordered_map<uint64_t, std::string> site_names;
+  auto site_name = [&](uint32_t pid, uint64_t site) -> const std::string& {
+    auto [it, inserted] = site_names.try_emplace(site);
+    if (!inserted) return it->second;
+    it->second = std::format("0x{:x}", site);
+    const uint32_t id = samples.address_space.resolve(pid, site);
+    if (id == AddressSpace::NONE) return it->second;
+    const Mapping& m = samples.address_space.get(id);
+    if (!m.file_backed()) return it->second;
+    auto& symtab = symtabs[m.path];
+    if (!symtab) symtab = std::make_unique<ElfSymbolTable>(m.path);
+    const auto file = std::filesystem::path(m.path).filename().string();
+    const std::string* sym = symtab->lookup_file_offset(m.file_offset(site));
+    it->second = sym ? std::format("{} ({})", *sym, file)
+                     : std::format("0x{:x} ({})", site, file);
+    return it->second;
+  };
 
-  if (value_type != DW_EXPR_OFFSET && value_type != DW_EXPR_VAL_OFFSET) {
-    // CFA expressions (DW_CFA_def_cfa_expression) are possible but uncommon.
-    return std::nullopt;
+  FlatMap<uint64_t, size_t> hot_index;
+  for (size_t i = 0; i < hot_lines.size(); ++i) {
+    if (hot_lines[i].sharing != SharingClass::PRIVATE)
+      hot_index.emplace(hot_lines[i].base_addr, i);
   }
 
-  auto base = dwarf_reg_value(s, regnum);
-  if (!base || *base == 0) return std::nullopt;
+  struct BlockStats {
+    uint64_t site   = 0;
+    uint64_t size   = 0;
+    uint64_t offset = 0;  // of the first sampled byte in the block
+    uint32_t pid    = 0;
+    size_t samples  = 0;
+    size_t writes   = 0;
+    std::vector<uint32_t> tids;
+    std::vector<const Allocation*> blocks;
+  };
+  std::vector<std::vector<BlockStats>> by_line(hot_lines.size());
+  // Last thread per block, and matrices by allocation site.
+  FlatMap<const Allocation*, uint32_t> last_toucher;
+  FlatMap<uint64_t, TransferMatrix> site_transfers;
+  FlatMap<uint64_t, uint32_t> site_pid;
+
+  size_t heap_hits = 0;
+  for (size_t i = 0; i < samples.size(); ++i) {
+    const uint64_t addr = samples.addrs[i];
+    if (addr == 0) continue;
+    const Allocation* a = heap->find(samples.pids[i], addr, samples.times[i]);
+    if (!a) continue;
+    ++heap_hits;
+
+    const uint32_t tid = samples.tids[i];
+    uint32_t& prev     = last_toucher[a];
+    if (prev != 0 && prev != tid) site_transfers[a->site].add(prev, tid);
+    prev              = tid;
+    site_pid[a->site] = a->pid;
+
+    constexpr uint64_t line_size = FalseSharingAnalysis::CACHE_LINE_SIZE;
+    auto hot = hot_index.find(addr / line_size * line_size);
+    if (hot == hot_index.end()) continue;
+    auto& rows = by_line[hot->second];
+    auto row   = std::ranges::find_if(rows, [&](const BlockStats& r) {
+      return r.site == a->site && r.size == a->size;
+    });
+    if (row == rows.end()) {
+      rows.push_back(
+        {a->site, a->size, addr - a->addr, a->pid, 0, 0, {}, {}});
+      row = rows.end() - 1;
+    }
+    row->offset = std::min(row->offset, addr - a->addr);
+    ++row->samples;
+    if (samples.types[i] == SampleType::CACHE_STORE) ++row->writes;
+    if (std::ranges::find(row->tids, tid) == row->tids.end())
+      row->tids.push_back(tid);
+    if (std::ranges::find(row->blocks, a) == row->blocks.end())
+      row->blocks.push_back(a);
+  }
+  std::cout << std::format("Heap-attributed samples: {} / {}\n\n", heap_hits,
+                           samples.size());
+
+  size_t shown = 0;
+  for (size_t i = 0; i < hot_lines.size() && shown < 10; ++i) {
+    auto& rows = by_line[i];
+    if (rows.empty()) continue;
+    ++shown;
+    std::ranges::sort(rows, {}, &BlockStats::offset);
+    std::cout << std::format("Cache line 0x{:x} ({}):\n",
+                             hot_lines[i].base_addr,
+                             FalseSharingAnalysis::name(hot_lines[i].sharing));
+    size_t blocks = 0;
+    for (auto& row : rows) {
+      blocks += row.blocks.size();
+      std::ranges::sort(row.tids);
+      std::string tids;
+      for (const uint32_t tid : row.tids)
+        tids += std::format("{}{}", tids.empty() ? "" : " ", tid);
+      std::cout << std::format(
+        "  {}-byte block from {} (+{}): {} samples (writes={}), {} block(s), "
+        "threads [{}]\n",
+        row.size, site_name(row.pid, row.site), row.offset, row.samples,
+        row.writes, row.blocks.size(), tids);
+    }
+    if (blocks > 1) {
+      std::cout << "  -> separate allocations share this line: allocate "
+                   "them cache-line aligned (aligned_alloc(64, ...)) or "
+                   "padded\n";
+    }
+    std::cout << "\n";
+  }
+  if (shown == 0 && !hot_index.empty())
+    std::cout << "No shared hot line falls in a traced heap block.\n\n";
 
-  const int64_t base_i64 = static_cast<int64_t>(*base);
-  const int64_t cfa_i64  = base_i64 + static_cast<int64_t>(offset_or_len);
-  if (cfa_i64 < 0) return std::nullopt;
-  return static_cast<uint64_t>(cfa_i64);
+  for (auto& [site, m] : site_transfers)
+    by_site["heap:" + site_name(site_pid[site], site)].merge(m);
+  return by_site;
 }
 
-// Parse a single perf script line
-static std::optional<PerfSample> parse_perf_line(std::string_view line) {
-  line = trim(line);
-  if (line.empty() || line[0] == '#') return std::nullopt;
+// Phases 4-6 over the samples collected for `main_mod` (`seen` counts them
+// before the DSO filter). Stack attribution runs for the binary and for every
+// other module in `modules` that owns samples on a hot line, each with its
+// own DWARF and load bias. `approx` is set under --approx and already holds
+// the sketch.
+static void analyze_samples(ModuleSet& modules, Module& main_mod,
+                            std::unique_ptr<Extractor> ext,
+                            const SampleStore& samples, size_t seen,
+                            const CpuTopology& topology,
+                            const ApproxIngest* approx,
+                            const AnalysisOptions& opts) {
+  const bool verbose = opts.verbose;
+  const auto binary   = main_mod.path();
+  const auto bin_name = std::filesystem::path(binary).filename().string();
+
+  if (verbose) {
+    std::cout << std::format("Filtered samples by DSO: {} -> {}\n", seen,
+                             samples.size());
+    std::cout << std::format(
+      "Sample store: {:.1f} MB ({:.1f} bytes/sample, {} symbols, {} dsos)\n",
+      samples.memory_bytes() / (1024.0 * 1024.0),
+      samples.empty() ? 0.0
+                      : static_cast<double>(samples.memory_bytes()) /
+                          static_cast<double>(samples.size()),
+      samples.symbols.size(), samples.dsos.size());
+    std::cout << std::format("Address space: {} mappings\n",
+                             samples.address_space.size());
+  }
 
-  PerfSample s{};
+  if (samples.empty()) {
+    std::cerr << "No samples collected. Try:\n"
+              << "  - Lower sample rate (-c)\n"
+              << "  - Different event (-e)\n"
+              << "  - Check available events: perf list\n"
+              << "  - Intel: mem-loads:pp, mem-stores:pp\n"
+              << "  - AMD: ibs_op//\n";
+    return;
+  }
 
-  // Tokenize by whitespace
-  std::vector<std::string_view> toks;
-  size_t pos = 0;
-  while (pos < line.size()) {
-    size_t start = line.find_first_not_of(" \t", pos);
-    if (start == std::string_view::npos) break;
+  // Compute statistics
+  auto stats = SampleStats::compute(samples);
+  std::cout << stats;
 
-    size_t end = line.find_first_of(" \t", start);
-    toks.push_back(line.substr(start, end - start));
-    pos = end;
+  // Show sample preview
+  if (verbose || samples.size() <= 20) {
+    std::cout << "\n=== Sample Preview ===\n";
+    for (size_t i = 0; i < std::min(samples.size(), size_t{10}); ++i) {
+      std::cout << std::format("Sample #{}:\n{}\n", i + 1, samples.symbol(i));
+    }
+  }
+
+  // Phase 4: False sharing analysis
+  std::vector<CacheLine> hot_lines;
+  if (approx) {
+    hot_lines = FalseSharingAnalysis::find_hot_cache_lines(approx->sketch);
+    std::vector<CacheLine> exact;
+    if (opts.validate_approx) {
+      exact = FalseSharingAnalysis::find_hot_cache_lines(samples, opts.jobs,
+                                                         &topology);
+    }
+    FalseSharingAnalysis::print_approximation(
+      approx->sketch, hot_lines, approx->stride,
+      opts.validate_approx ? &exact : nullptr);
+  } else {
+    hot_lines = FalseSharingAnalysis::find_hot_cache_lines(samples, opts.jobs,
+                                                           &topology);
+  }
+  FalseSharingAnalysis::assign_modules(hot_lines, samples);
+  const auto hot_pairs = FalseSharingAnalysis::find_hot_pairs(
+    samples, hot_lines, approx != nullptr);
+  FalseSharingAnalysis::print(hot_lines, opts.sample_period);
+  FalseSharingAnalysis::print_pairs(hot_pairs, hot_lines);
+  auto matrices =
+    ContentionMatrices::build(samples, hot_lines, approx != nullptr);
+
+  if (opts.window_ms > 0) {
+    const auto window_ns = static_cast<uint64_t>(opts.window_ms * 1e6);
+    try {
+      PhaseAnalysis::print(
+        PhaseAnalysis::find_phases(samples, window_ns, &topology), window_ns,
+        opts.sample_period);
+    } catch (const std::exception& e) {
+      std::cerr << std::format("WARNING: phase analysis skipped: {}\n",
+                               e.what());
+    }
   }
 
-  // Minimum expected:
-  // pid/tid [cpu] ip addr sym...
-  if (toks.size() < 5) return std::nullopt;
+  // Phase 5: Runtime attribution (stack locals)
+  std::cout << "=== Phase 5: Runtime Attribution (Stack) ===\n";
 
-  size_t idx = 0;
+  main_mod.load(std::move(ext));
 
-  // Handle optional comm name (non pid/tid token)
-  if (toks[0].find('/') == std::string_view::npos) {
-    idx++;
-    if (toks.size() - idx < 5) return std::nullopt;
+  // Per-dso answers are computed once per interned string, not per sample.
+  std::vector<bool> target_dso(samples.dsos.size());
+  for (uint32_t id = 0; id < samples.dsos.size(); ++id) {
+    const auto& dso = samples.dsos.get(id);
+    target_dso[id]  = !dso.empty() &&
+                     (dso.find(bin_name) != std::string::npos ||
+                      dso.find(binary) != std::string::npos);
   }
 
-  // pid/tid
-  auto slash = toks[idx].find('/');
-  if (slash == std::string_view::npos) return std::nullopt;
-
-  s.pid = std::stoul(std::string(toks[idx].substr(0, slash)));
-  s.tid = std::stoul(std::string(toks[idx].substr(slash + 1)));
-  idx++;
+  // Samples without a mapping (perf script output from a perf that lacks
+  // --show-mmap-events) fall back to the dso name.
+  auto module_of = [&](size_t i) -> Module* {
+    if (samples.ip_maps[i] != AddressSpace::NONE)
+      return modules.for_mapping(samples.ip_maps[i]);
+    return target_dso[samples.dso_ids[i]] ? &main_mod : nullptr;
+  };
 
-  // [cpu]
-  if (toks[idx].front() != '[' || toks[idx].back() != ']') return std::nullopt;
+  // Only modules whose code touched a shared hot line get their DWARF
+  // loaded.
+  std::unordered_set<uint64_t> hot_bases;
+  for (const auto& line : hot_lines) {
+    if (line.sharing != SharingClass::PRIVATE)
+      hot_bases.insert(line.base_addr);
+  }
+  for (size_t i = 0; i < samples.size() && !hot_bases.empty(); ++i) {
+    constexpr uint64_t line_size = FalseSharingAnalysis::CACHE_LINE_SIZE;
+    if (!hot_bases.contains(samples.addrs[i] / line_size * line_size))
+      continue;
+    if (Module* mod = module_of(i)) mod->load();
+  }
 
-  s.cpu = std::stoul(std::string(toks[idx].substr(1, toks[idx].size() - 2)));
-  idx++;
+  // The image base of the first sampled process and the FDE-vs-IP guess
+  // only serve the binary's samples that have no mapping.
+  uint64_t load_bias = 0;
+  for (size_t i = 0; i < samples.size(); ++i) {
+    const Mapping* m = samples.ip_mapping(i);
+    if (!m || m->path != binary) continue;
+    load_bias = samples.address_space.image_base(m->pid, binary).value_or(0);
+    break;
+  }
+  if (verbose && load_bias) {
+    std::cout << std::format("Detected load bias: 0x{:x}\n", load_bias);
+  }
 
-  // Optional time token (when perf script -F includes time)
-  // Usually formatted like "12345.678901" or "12345.678901:".
-  if (idx < toks.size()) {
-    auto tt = toks[idx];
-    if (!tt.empty() && tt.back() == ':') tt = tt.substr(0, tt.size() - 1);
+  uint64_t inferred_bias = 0;
+  if (auto min_fde_lopc = main_mod.min_fde_pc()) {
+    std::optional<uint64_t> min_ip;
+    for (size_t i = 0; i < samples.size(); ++i) {
+      const uint64_t ip = samples.ips[i];
+      if (ip == 0 || !target_dso[samples.dso_ids[i]]) continue;
+      min_ip = std::min(min_ip.value_or(ip), ip);
+    }
 
-    if (tt.find_first_not_of("0123456789.") == std::string_view::npos &&
-        tt.find('.') != std::string_view::npos) {
-      auto dot      = tt.find('.');
-      uint64_t secs = 0, nsecs = 0;
-      try {
-        secs      = std::stoull(std::string(tt.substr(0, dot)));
-        auto frac = std::string(tt.substr(dot + 1));
-        if (frac.size() > 9) frac.resize(9);
-        while (frac.size() < 9) frac.push_back('0');
-        nsecs = std::stoull(frac);
-      } catch (...) {
-        secs  = 0;
-        nsecs = 0;
+    if (min_ip && *min_ip > *min_fde_lopc) {
+      inferred_bias = *min_ip - *min_fde_lopc;
+      if (verbose) {
+        std::cout << std::format(
+          "Inferred load bias (FDE vs runtime IP): 0x{:x}\n", inferred_bias);
       }
-      s.time_stamp = secs * 1000000000ULL + nsecs;
-      idx++;
-    }
-  }
-
-  // event types (often ends with ':')
-  std::string event_str = std::string(toks[idx]);
-  if (!event_str.empty() && event_str.back() == ':') event_str.pop_back();
-  idx++;
-
-  if (event_str == "mem-stores:pp" ||
-      event_str.find("store") != std::string::npos)
-    s.event_type = SampleType::CACHE_STORE;
-  else if (event_str == "mem-loads:pp" ||
-           event_str.find("load") != std::string::npos)
-    s.event_type = SampleType::CACHE_LOAD;
-  else
-    s.event_type = SampleType::CACHE_LOAD;  // Generic / IBS: treat as access
-
-  // perf prints two addresses for these events; for memory-access sampling
-  // (ibs_op, mem-loads/stores) the first is typically the accessed address and
-  // the second is the instruction pointer.
-  s.addr = std::stoull(std::string(toks[idx]), nullptr, 16);
-  idx++;
-  s.ip = std::stoull(std::string(toks[idx]), nullptr, 16);
-  idx++;
-
-  // Remaining tokens contain sym and dso, but sym can include whitespace (e.g.
-  // "thread_method(PaddedCounter*, int)"). dso is reliably a single token like
-  // "(/path/to/bin)" or "([kernel.kallsyms])".
-  size_t dso_idx = toks.size();
-  for (size_t i = idx; i < toks.size(); ++i) {
-    auto t = trim(toks[i]);
-    if (t.size() >= 2 && t.front() == '(' && t.back() == ')') {
-      dso_idx = i;
-      break;
-    }
-  }
-
-  if (dso_idx != toks.size()) {
-    // symbol is everything between idx and dso_idx
-    std::string sym;
-    for (size_t i = idx; i < dso_idx; ++i) {
-      if (!sym.empty()) sym.push_back(' ');
-      sym += std::string(toks[i]);
-    }
-    s.symbol = sym;
-
-    auto dso_tok = trim(toks[dso_idx]);
-    dso_tok.remove_prefix(1);
-    dso_tok.remove_suffix(1);
-    s.dso = std::string(dso_tok);
-
-    idx = dso_idx + 1;
-  } else {
-    // Fallback: old behavior
-    if (idx < toks.size()) {
-      s.symbol = std::string(toks[idx]);
-      idx++;
-    }
-    if (idx < toks.size()) {
-      s.dso = std::string(toks[idx]);
-      idx++;
     }
   }
 
-  // Optional sampled user registers (we record SP/BP via perf record
-  // --user-regs=sp,bp). perf formatting varies across versions.
-  parse_user_regs_from_uregs_tokens(toks, idx, s);
+  if (!main_mod.fdes()) {
+    std::cerr
+      << "WARNING: Failed to read DWARF CFI (.eh_frame/.debug_frame); stack "
+         "attribution will be skipped.\n";
+  }
 
-  return s;
-}
+  // Stack objects by function, and each interned symbol resolved to its
+  // DWARF function once, per module.
+  struct ModuleFrames {
+    std::unordered_map<std::string, std::vector<const DwarfStackObject*>>
+      by_function;
+    std::vector<const std::vector<const DwarfStackObject*>*> sym_objects;
+    FlatMap<const DwarfStackObject*, size_t> var_hits;
+    // Hits per offset into each variable, named only when printed.
+    FlatMap<const DwarfStackObject*, FlatMap<uint64_t, size_t>> offset_hits;
+    FlatMap<const DwarfStackObject*, TransferMatrix> var_transfers;
+    size_t stack_hits = 0;
+  };
+  std::unordered_map<const Module*, ModuleFrames> frames;
+  auto frames_for = [&](const Module& mod) -> ModuleFrames& {
+    auto [it, inserted] = frames.try_emplace(&mod);
+    if (!inserted || !mod.dwarf()) return it->second;
+    auto& f = it->second;
+    for (const auto& o : mod.dwarf()->get_stack_objects())
+      f.by_function[o.function].push_back(&o);
+    f.sym_objects.assign(samples.symbols.size(), nullptr);
+    for (uint32_t id = 1; id < samples.symbols.size(); ++id) {
+      auto fit = f.by_function.find(
+        std::string(base_symbol(samples.symbols.get(id))));
+      if (fit != f.by_function.end()) f.sym_objects[id] = &fit->second;
+    }
+    return f;
+  };
 
-static bool run_perf_record(const std::string& binary,
-                            const std::string& output_file,
-                            const std::string& event, int sample_rate) {
-  pid_t perf_pid = fork();
+  size_t stack_hits = 0;
+  // Last thread to touch each object instance, by its address.
+  FlatMap<uint64_t, uint32_t> last_toucher;
 
-  if (perf_pid == 0) {
-    // Child: exec perf record
-    auto count_str = std::to_string(sample_rate);
+  size_t cfa_ok   = 0;
+  size_t cfa_miss = 0;
 
-    execlp(
-      "perf", "perf", "record", "-e", event.c_str(),
-      "-d",                 // Record addresses
-      "--sample-cpu",       // Record CPU
-      "--user-regs=sp,bp",  // Sample stack + frame pointers for runtime vars
-      "-c", count_str.c_str(),  // Sample period
-      "-o", output_file.c_str(), "--", binary.c_str(), nullptr);
+  const auto attribution_start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < samples.size(); ++i) {
+    const uint64_t ip   = samples.ips[i];
+    const uint64_t addr = samples.addrs[i];
+    if (ip == 0 || samples.sps[i] == 0 || addr == 0) continue;
 
-    // If exec fails
-    perror("execlp perf");
-    _exit(127);
+    Module* mod = module_of(i);
+    if (!mod || !mod->loaded() || !mod->fdes()) continue;
+
+    auto& f = frames_for(*mod);
+    const auto* objects =
+      f.sym_objects.empty() ? nullptr : f.sym_objects[samples.symbol_ids[i]];
+    if (!objects) continue;
+
+    // Map runtime IP to a DWARF PC for CFI lookup: through the sample's own
+    // mapping first, so every module uses its own load bias.
+    auto try_cfa = [&](uint64_t pc) {
+      return compute_cfa_for_sample(mod->cfa(), samples, i, pc);
+    };
+
+    std::optional<uint64_t> cfa;
+    if (const Mapping* m = samples.ip_mapping(i)) {
+      if (auto pc = mod->link_address(*m, ip)) cfa = try_cfa(*pc);
+    }
+    // Then the raw runtime IP (non-PIE / already-relocated FDEs)
+    if (!cfa) cfa = try_cfa(ip);
+    // Then subtracting known/perf-inferred biases of the binary.
+    if (mod == &main_mod) {
+      if (!cfa && load_bias && ip >= load_bias) cfa = try_cfa(ip - load_bias);
+      if (!cfa && inferred_bias && ip >= inferred_bias)
+        cfa = try_cfa(ip - inferred_bias);
+    }
+
+    if (!cfa) {
+      ++cfa_miss;
+      continue;
+    }
+    ++cfa_ok;
+
+    for (const auto* obj : *objects) {
+      const int64_t cfa_i64 = static_cast<int64_t>(*cfa);
+      const int64_t loc     = cfa_i64 + obj->frame_offset;
+      if (loc < 0) continue;
+      const uint64_t var_addr = static_cast<uint64_t>(loc);
+      const uint64_t var_end  = var_addr + obj->size;
+
+      if (addr >= var_addr && addr < var_end) {
+        ++stack_hits;
+        ++f.stack_hits;
+        ++f.var_hits[obj];
+        ++f.offset_hits[obj][addr - var_addr];
+        const uint32_t tid = samples.tids[i];
+        uint32_t& prev     = last_toucher[var_addr];
+        if (prev != 0 && prev != tid) f.var_transfers[obj].add(prev, tid);
+        prev = tid;
+        break;
+      }
+    }
   }
 
-  // Parent: wait for perf to finish
-  int status;
-  waitpid(perf_pid, &status, 0);
+  const std::chrono::duration<double> attribution_secs =
+    std::chrono::steady_clock::now() - attribution_start;
+  std::cout << std::format(
+    "Attributed {} samples in {:.3f}s ({:.0f} samples/s)\n", samples.size(),
+    attribution_secs.count(),
+    samples.size() / std::max(attribution_secs.count(), 1e-9));
+  if (cfa_ok + cfa_miss > 0) {
+    std::cout << std::format(
+      "CFA computed for {} of {} candidate samples ({:.1f}%)\n", cfa_ok,
+      cfa_ok + cfa_miss, 100.0 * cfa_ok / (cfa_ok + cfa_miss));
+  }
 
-  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
-}
+  if (verbose) {
+    std::cout << std::format("DWARF loaded for {} module(s):\n",
+                             frames.size());
+    for (const auto& [mod, f] : frames) {
+      std::cout << std::format("  {}: {} stack objects, {} hits\n",
+                               mod->path(),
+                               mod->dwarf()
+                                 ? mod->dwarf()->get_stack_objects().size()
+                                 : 0,
+                               f.stack_hits);
+    }
+  }
 
-// Parse perf script output
-std::vector<PerfSample> parse_perf_data(const std::string& perf_data_file) {
-  std::string cmd = std::format(
-    "perf script -i {} -F tid,pid,cpu,time,event,ip,addr,sym,dso,uregs "
-    "2>/dev/null",
-    perf_data_file);
+  std::cout << std::format("Stack-attributed samples: {} / {}\n\n",
+                           stack_hits, samples.size());
+
+  // Member paths of stack and global objects, one table per type. Heap
+  // blocks have no DWARF type (the tracer only logs sizes and call sites), so
+  // Phase 7 reports them by offset.
+  TypeLayouts layouts;
+
+  if (stack_hits > 0) {
+    // Variables are only named here, once per object rather than per hit.
+    // Non-main modules get a "lib.so: " prefix. Per-variable totals are
+    // printed with --verbose only.
+    std::unordered_map<std::string, size_t> by_name;
+    std::unordered_map<std::string, size_t> by_member;
+    for (const auto& [mod, f] : frames) {
+      const auto prefix =
+        mod == &main_mod
+          ? std::string{}
+          : std::filesystem::path(mod->path()).filename().string() + ": ";
+      if (verbose) {
+        for (const auto& [obj, n] : f.var_hits)
+          by_name[prefix + obj->function + "::" + obj->name] += n;
+      }
+      for (const auto& [obj, offsets] : f.offset_hits) {
+        const auto& layout = layouts.of(obj->type);
+        for (const auto& [off, n] : offsets) {
+          const auto path = layout.resolve(off);
+          if (!path.empty())
+            by_member[prefix + obj->function + "::" + obj->name + path] += n;
+        }
+      }
+    }
 
-  PipeStream pipe(cmd);
-  auto lines = pipe.read_lines();
+    auto print_top = [](const char* title, const auto& counts) {
+      std::vector<std::pair<std::string, size_t>> ranked(counts.begin(),
+                                                         counts.end());
+      std::ranges::sort(ranked, [](const auto& a, const auto& b) {
+        if (a.second != b.second) return a.second > b.second;
+        return a.first < b.first;
+      });
+      std::cout << title;
+      for (size_t i = 0; i < std::min<size_t>(ranked.size(), 10); ++i) {
+        std::cout << std::format("  {}: {}\n", ranked[i].first,
+                                 ranked[i].second);
+      }
+      std::cout << "\n";
+    };
+    if (verbose) print_top("Top stack variables by hits:\n", by_name);
+    if (!by_member.empty())
+      print_top("Top stack members by hits:\n", by_member);
+  }
 
-  std::vector<PerfSample> samples;
-  samples.reserve(lines.size());  // Optimize allocation
+  // Object matrices merge by name like the hit counts above.
+  std::map<std::string, TransferMatrix> transfers_by_name;
+  for (const auto& [mod, f] : frames) {
+    const auto prefix =
+      mod == &main_mod
+        ? std::string{}
+        : std::filesystem::path(mod->path()).filename().string() + ": ";
+    for (const auto& [obj, m] : f.var_transfers)
+      transfers_by_name[prefix + obj->function + "::" + obj->name].merge(m);
+  }
 
-  for (const auto& line : lines) {
-    if (auto sample = parse_perf_line(line)) {
-      samples.push_back(std::move(*sample));
+  // Phase 6: Static attribution (globals)
+  std::cout << "=== Phase 6: Static Attribution ===\n";
+
+  // Every loaded module with DWARF globals gets an index, and every process
+  // that mapped it the distance between its runtime and link-time addresses
+  // (PIE/ASLR load bias). .bss lies past the file-backed part of the data
+  // mapping, so the bias comes from the mapping start rather than from
+  // translating each address through its own mapping.
+  struct StaticModule {
+    const Module* mod;
+    StaticIndex index;
+  };
+  std::vector<StaticModule> statics;
+  std::unordered_map<const Module*, size_t> static_of;
+  std::unordered_map<uint32_t, std::vector<std::pair<size_t, uint64_t>>>
+    biases;  // pid -> (statics index, bias)
+  const auto& mappings = samples.address_space.mappings();
+  for (size_t k = 0; k < mappings.size(); ++k) {
+    Module* mod = modules.for_mapping(static_cast<uint32_t>(k + 1));
+    if (!mod || !mod->loaded() || !mod->dwarf()) continue;
+    auto [it, inserted] = static_of.try_emplace(mod, statics.size());
+    if (inserted)
+      statics.push_back({mod, StaticIndex(mod->dwarf()->get_global_objects())});
+    if (statics[it->second].index.empty()) continue;
+
+    const Mapping& m = mappings[k];
+    const auto link  = mod->link_address(m, m.start);
+    if (!link) continue;
+    auto& list       = biases[m.pid];
+    const bool known = std::ranges::any_of(
+      list, [&](const auto& e) { return e.first == it->second; });
+    if (!known) list.emplace_back(it->second, m.start - *link);
+  }
+  // Samples of processes without mappings try the binary, unrelocated and
+  // at the detected load bias.
+  std::vector<std::pair<size_t, uint64_t>> fallback;
+  if (main_mod.dwarf()) {
+    auto [it, inserted] = static_of.try_emplace(&main_mod, statics.size());
+    if (inserted) {
+      statics.push_back(
+        {&main_mod, StaticIndex(main_mod.dwarf()->get_global_objects())});
     }
+    fallback.emplace_back(it->second, 0);
+    if (load_bias) fallback.emplace_back(it->second, load_bias);
   }
 
-  return samples;
-}
+  size_t indexed = 0;
+  for (const auto& s : statics) indexed += s.index.size();
+  std::cout << std::format("Indexed {} globals/statics in {} module(s)\n",
+                           indexed, statics.size());
 
-auto parse_perf_data_ranges(const std::string& perf_data_file) {
-  std::string cmd = std::format(
-    "perf script -i {} -F tid,pid,cpu,time,ip,addr,sym,dso,uregs 2>/dev/null",
-    perf_data_file);
+  struct StaticHit {
+    const StaticRange* range;
+    uint64_t offset;  // into the object
+  };
+  auto find_static = [&](uint32_t pid,
+                         uint64_t addr) -> std::optional<StaticHit> {
+    auto it           = biases.find(pid);
+    const auto& tries = it != biases.end() ? it->second : fallback;
+    for (const auto& [k, bias] : tries) {
+      if (addr < bias) continue;
+      if (const StaticRange* r = statics[k].index.find(addr - bias))
+        return StaticHit{r, addr - bias - r->start};
+    }
+    return std::nullopt;
+  };
 
-  PipeStream pipe(cmd);
-  auto lines = pipe.read_lines();
-  // Use ranges to transform and filter
-  return lines | std::views::transform([](const auto& line) {
-           return parse_perf_line(line);
-         }) |
-         std::views::filter([](const auto& opt) { return opt.has_value(); }) |
-         std::views::transform([](auto&& opt) { return std::move(*opt); });
+  // Per sampled address of a shared hot line: how it was touched.
+  struct AddressStats {
+    size_t samples = 0;
+    size_t writes  = 0;
+    uint32_t pid   = 0;
+    std::vector<uint32_t> tids;
+  };
+  FlatMap<uint64_t, size_t> hot_index;
+  for (size_t i = 0; i < hot_lines.size(); ++i) {
+    if (hot_lines[i].sharing != SharingClass::PRIVATE)
+      hot_index.emplace(hot_lines[i].base_addr, i);
+  }
+  FlatMap<uint64_t, AddressStats> hot_addrs;
+  // Last thread per global instance, for its transfer matrix.
+  FlatMap<uint64_t, uint32_t> last_global_toucher;
+  std::map<std::string, TransferMatrix> global_transfers;
+
+  size_t static_hits = 0;
+  for (size_t i = 0; i < samples.size(); ++i) {
+    const uint64_t addr = samples.addrs[i];
+    if (addr == 0) continue;
+    const auto hit = find_static(samples.pids[i], addr);
+    if (!hit) continue;
+    ++static_hits;
+
+    const uint32_t tid = samples.tids[i];
+    uint32_t& prev     = last_global_toucher[addr - hit->offset];
+    if (prev != 0 && prev != tid)
+      global_transfers[hit->range->obj->name].add(prev, tid);
+    prev = tid;
+
+    constexpr uint64_t line_size = FalseSharingAnalysis::CACHE_LINE_SIZE;
+    if (!hot_index.contains(addr / line_size * line_size)) continue;
+    auto& a = hot_addrs[addr];
+    ++a.samples;
+    if (samples.types[i] == SampleType::CACHE_STORE) ++a.writes;
+    a.pid = samples.pids[i];
+    if (std::ranges::find(a.tids, tid) == a.tids.end()) a.tids.push_back(tid);
+  }
+  std::cout << std::format("Static-attributed samples: {} / {}\n\n",
+                           static_hits, samples.size());
+
+  // Each hot line's addresses, resolved once per address and merged by
+  // field, in line rank order.
+  struct FieldStats {
+    std::string field;
+    uint64_t offset = 0;  // of the first sampled byte in the object
+    size_t samples  = 0;
+    size_t writes   = 0;
+    std::vector<uint32_t> tids;
+  };
+  std::vector<std::vector<FieldStats>> by_line(hot_lines.size());
+  for (const auto& [addr, a] : hot_addrs) {
+    const auto hit   = find_static(a.pid, addr);
+    const auto& obj  = *hit->range->obj;
+    const auto path  = layouts.of(obj.type).resolve(hit->offset);
+    const auto field = std::format("`{}{}`", obj.name, path);
+    constexpr uint64_t line_size = FalseSharingAnalysis::CACHE_LINE_SIZE;
+    auto& rows = by_line[hot_index.find(addr / line_size * line_size)->second];
+    auto row   = std::ranges::find(rows, field, &FieldStats::field);
+    if (row == rows.end()) {
+      rows.push_back({field, hit->offset, 0, 0, {}});
+      row = rows.end() - 1;
+    }
+    row->offset = std::min(row->offset, hit->offset);
+    row->samples += a.samples;
+    row->writes += a.writes;
+    for (const uint32_t tid : a.tids) {
+      if (std::ranges::find(row->tids, tid) == row->tids.end())
+        row->tids.push_back(tid);
+    }
+  }
+
+  size_t shown = 0;
+  for (size_t i = 0; i < hot_lines.size() && shown < 10; ++i) {
+    auto& rows = by_line[i];
+    if (rows.empty()) continue;
+    ++shown;
+    std::ranges::sort(rows, {}, &FieldStats::offset);
+    std::cout << std::format("Cache line 0x{:x} ({}):\n",
+                             hot_lines[i].base_addr,
+                             FalseSharingAnalysis::name(hot_lines[i].sharing));
+    for (auto& row : rows) {
+      std::ranges::sort(row.tids);
+      std::string tids;
+      for (const uint32_t tid : row.tids)
+        tids += std::format("{}{}", tids.empty() ? "" : " ", tid);
+      std::cout << std::format(
+        "  {} (+{}): {} samples (writes={}), threads [{}]\n", row.field,
+        row.offset, row.samples, row.writes, tids);
+    }
+    std::cout << "\n";
+  }
+  if (shown == 0 && !hot_index.empty())
+    std::cout << "No shared hot line falls in a global or static.\n\n";
+
+  for (auto& [name, m] : transfers_by_name)
+    matrices.objects.emplace_back(name, std::move(m));
+  for (auto& [name, m] : global_transfers)
+    matrices.objects.emplace_back(name, std::move(m));
+  if (!opts.heap_log.empty()) {
+    for (auto& [name, m] : run_heap_phase(samples, hot_lines, opts.heap_log))
+      matrices.objects.emplace_back(name, std::move(m));
+  }
+  matrices.print();
+  if (!opts.matrix.empty()) {
+    try {
+      matrices.save(opts.matrix);
+      std::cout << std::format("Wrote transfer matrices to {}\n\n",
+                               opts.matrix);
+    } catch (const std::exception& e) {
+      std::cerr << std::format("WARNING: {}\n", e.what());
+    }
+  }
 }
 
 // Statistics helper
@@ -472,276 +1033,333 @@ int main(int argc, char* argv[]) {
   std::string output_file    = "perf.data";
   std::string default_events = get_default_mem_events();
   int sample_rate            = 10000;
+  std::string reader         = "native";
+  std::string recorder       = "builtin";
+  unsigned jobs              = 1;
+  bool save_cache            = false;
+  bool from_cache            = false;
+  bool binary_only           = false;
+  double window_ms           = 0;
+  std::string topology_file;
+  std::string matrix_file;
+  size_t approx_mb     = 0;
+  bool validate_approx = false;
+  bool heap            = false;
 
   auto* analyze = app.add_subcommand("analyze", "Analyze cache behavior");
   analyze->add_option("binary", binary)->required()->check(CLI::ExistingFile);
   analyze->add_option("-o,--output", output_file, "Output perf data file");
   analyze->add_option("-e,--event", default_events, "Perf event to record");
   analyze->add_option("-c,--count", sample_rate, "Sample period");
+  analyze
+    ->add_option("--reader", reader,
+                 "perf.data decoder: native (default) or script (perf script)")
+    ->check(CLI::IsMember({"native", "script"}));
+  analyze
+    ->add_option("--recorder", recorder,
+                 "builtin (perf_event_open, default) or perf (perf record)")
+    ->check(CLI::IsMember({"builtin", "perf"}));
+  analyze->add_flag("--save-cache", save_cache,
+                    "Write the parsed samples to <output>.cscache");
+  analyze->add_flag("--from-cache", from_cache,
+                    "Analyze <output>.cscache instead of recording; re-parses "
+                    "<output> when the cache is missing or stale");
+  analyze->add_option(
+    "-j,--jobs", jobs,
+    "Ring-buffer reader threads, or parser threads for the perf script path; "
+    "also shards cache-line aggregation");
+  analyze->add_flag("--binary-only", binary_only,
+                    "Ignore samples from shared libraries");
+  analyze
+    ->add_option("--window", window_ms,
+                 "Also score lines per <ms> window and report contention "
+                 "phases")
+    ->check(CLI::PositiveNumber);
+  analyze
+    ->add_option("--topology", topology_file,
+                 "CPU topology file for the coherence cost model (default: "
+                 "this machine's /sys/devices/system/cpu)")
+    ->check(CLI::ExistingFile);
+  analyze->add_option("--matrix", matrix_file,
+                      "Write tid x tid transfer matrices (all lines, hot "
+                      "lines, objects) to <file>: .json for JSON, else CSV");
+  analyze
+    ->add_option("--approx", approx_mb,
+                 "Aggregate cache lines in a fixed-memory sketch while "
+                 "recording and keep a thinned sample store, <MB> MiB in "
+                 "all, for very long captures")
+    ->check(CLI::PositiveNumber);
+  analyze->add_flag("--validate-approx", validate_approx,
+                    "With --approx, also run the exact pass and list the "
+                    "lines the sketch missed");
+  analyze->add_flag("--heap", heap,
+                    "Run the binary under the heap tracer (<output>.heap) "
+                    "and attribute hot lines to heap blocks");
 
   analyze->callback([&]() {
-    // Phase 1: DWARF extraction
-    std::cout << "=== Phase 1: DWARF Analysis ===\n";
-    Extractor ext{binary};
-    ext.create_registry();
-
-    if (verbose) {
-      for (const auto& [k, v] : ext.get_registry().get_map()) {
-        std::cout << std::format("{}: {} bytes\n", k, v.size);
-      }
-    }
+    auto ext = std::make_unique<Extractor>(binary);
+    run_dwarf_phase(*ext, verbose);
 
-    const auto& stack_objects = ext.get_stack_objects();
-    std::cout << std::format("Found {} stack objects\n\n",
-                             stack_objects.size());
-
-    // Phase 2: Run perf record
+    // Phase 2: Record samples
     std::cout << "=== Phase 2: Performance Recording ===\n";
-    std::cout << std::format("Recording {} with event '{}' (period={})\n",
-                             binary, default_events, sample_rate);
-
-    if (!run_perf_record(binary, output_file, default_events, sample_rate)) {
-      std::cerr << "Perf recording failed\n";
-      return;
+    if (!from_cache) {
+      std::cout << std::format("Recording {} with event '{}' (period={})\n",
+                               binary, default_events, sample_rate);
     }
 
-    std::cout << std::format("Recording completed: {}\n\n", output_file);
-
-    // Phase 3: Parse samples
-    std::cout << "=== Phase 3: Sample Parsing ===\n";
-
-    auto samples = parse_perf_data(output_file);
-
-    // Filter to samples attributed to the target binary (reduces libc/pthread
-    // noise).
-    const auto bin_name = std::filesystem::path(binary).filename().string();
-    size_t before       = samples.size();
-    std::erase_if(samples, [&](const PerfSample& s) {
-      if (s.dso.empty()) return false;  // keep unknown
-      if (s.dso.find(bin_name) != std::string::npos) return false;
-      if (s.dso.find(binary) != std::string::npos) return false;
-      return true;
-    });
-    if (verbose) {
-      std::cout << std::format("Filtered samples by DSO: {} -> {}\n", before,
-                               samples.size());
-    }
-
-    if (samples.empty()) {
-      std::cerr << "No samples collected. Try:\n"
-                << "  - Lower sample rate (-c)\n"
-                << "  - Different event (-e)\n"
-                << "  - Check available events: perf list\n"
-                << "  - Intel: mem-loads:pp, mem-stores:pp\n"
-                << "  - AMD: ibs_op//\n";
-      return;
+    // The tracer appends: a fresh recording starts a fresh log.
+    const auto heap_log = heap ? output_file + ".heap" : std::string{};
+    std::vector<std::string> heap_env;
+    if (heap && !from_cache) {
+      std::filesystem::remove(heap_log);
+      heap_env = heap_tracer_env(heap_log);
     }
 
-    // Compute statistics
-    auto stats = SampleStats::compute(samples);
-    std::cout << stats;
-
-    // Show sample preview
-    if (verbose || samples.size() <= 20) {
-      std::cout << "\n=== Sample Preview ===\n";
-      for (size_t i = 0; i < std::min(samples.size(), size_t{10}); ++i) {
-        std::cout << std::format("Sample #{}:\n{}\n", i + 1, samples[i].symbol);
+    const AnalysisOptions opts{jobs,
+                               window_ms,
+                               verbose,
+                               topology_file,
+                               matrix_file,
+                               approx_mb,
+                               validate_approx,
+                               static_cast<uint64_t>(sample_rate),
+                               heap_log};
+    const auto topology = load_topology(opts);
+
+    size_t before = 0;
+    SampleStore samples;
+    // Mappings carry the kernel's resolved path.
+    ModuleSet modules(samples.address_space);
+    Module& main_mod = modules.add(std::make_unique<Module>(
+      std::filesystem::canonical(binary).string(), std::string{}, binary));
+    std::optional<ApproxIngest> approx;
+    if (approx_mb > 0) approx.emplace(opts, topology, samples);
+    const auto keep_sample =
+      keep_user_samples(binary, binary_only, samples, before, modules,
+                        approx ? &*approx : nullptr);
+    const auto cache_path = SampleCache::path_for(output_file);
+
+    bool cached = false;
+    if (from_cache) {
+      const auto start = std::chrono::steady_clock::now();
+      try {
+        if (auto c = SampleCache::load(cache_path, output_file, binary,
+                                       binary_only)) {
+          before = c->seen;
+          if (approx) {
+            approx->replay(std::move(c->samples));
+          } else {
+            samples = std::move(c->samples);
+          }
+          cached = true;
+        }
+      } catch (const std::exception& e) {
+        std::cerr << std::format("WARNING: {}\n", e.what());
       }
-    }
-
-    // Phase 4: False sharing analysis
-    auto hot_lines = FalseSharingAnalysis::find_hot_cache_lines(samples);
-    FalseSharingAnalysis::print(hot_lines);
-
-    // Phase 5: Runtime attribution (stack locals)
-    std::cout << "=== Phase 5: Runtime Attribution (Stack) ===\n";
-
-    uint64_t load_bias = 0;
-    if (auto lb =
-          get_load_bias_from_perf_mmaps(output_file, binary, samples[0].pid)) {
-      load_bias = *lb;
-      if (verbose) {
-        std::cout << std::format("Detected load bias (perf mmaps): 0x{:x}\n",
-                                 load_bias);
+      const std::chrono::duration<double> secs =
+        std::chrono::steady_clock::now() - start;
+      if (cached) {
+        std::cout << std::format(
+          "Skipped recording: loaded {} samples from {} in {:.3f}s\n\n",
+          approx ? approx->offered : samples.size(), cache_path,
+          secs.count());
+      } else if (std::filesystem::exists(output_file)) {
+        std::cout << std::format(
+          "No valid cache at {}; re-parsing {} without recording\n\n",
+          cache_path, output_file);
+      } else {
+        std::cerr << std::format(
+          "--from-cache: neither {} nor {} is usable\n", cache_path,
+          output_file);
+        return;
       }
     }
 
-    std::unique_ptr<DwarfContext> frame_ctx;
-    try {
-      frame_ctx = std::make_unique<DwarfContext>(binary);
-    } catch (...) {
-      frame_ctx.reset();
-    }
-
-    Dwarf_Cie* cie_data    = nullptr;
-    Dwarf_Fde* fde_data    = nullptr;
-    Dwarf_Signed cie_count = 0;
-    Dwarf_Signed fde_count = 0;
-    Dwarf_Error frame_err  = nullptr;
-
-    bool have_frames = false;
-    if (frame_ctx) {
-      have_frames =
-        dwarf_get_fde_list_eh(frame_ctx->dbg(), &cie_data, &cie_count,
-                              &fde_data, &fde_count, &frame_err) == DW_DLV_OK;
-      if (!have_frames) {
-        have_frames =
-          dwarf_get_fde_list(frame_ctx->dbg(), &cie_data, &cie_count, &fde_data,
-                             &fde_count, &frame_err) == DW_DLV_OK;
+    std::unique_ptr<PerfRecorder> in_process;
+    if (!from_cache && recorder == "builtin") {
+      try {
+        in_process = std::make_unique<PerfRecorder>(default_events,
+                                                    sample_rate, jobs);
+        if (heap) in_process->use_clock(CLOCK_MONOTONIC);
+        in_process->launch(binary, heap_env);
+      } catch (const std::exception& e) {
+        std::cerr << std::format(
+          "WARNING: in-process recording unavailable ({}); falling back to "
+          "perf record\n",
+          e.what());
+        in_process.reset();
       }
     }
 
-    uint64_t inferred_bias = 0;
-    if (have_frames && fde_data && fde_count > 0) {
-      uint64_t min_fde_lopc = 0;
-      bool have_any = false;
-      for (Dwarf_Signed i = 0; i < fde_count; ++i) {
-        Dwarf_Fde fde = fde_data[i];
-        if (!fde) continue;
-
-        Dwarf_Addr lopc = 0;
-        Dwarf_Unsigned len = 0;
-        Dwarf_Ptr fde_bytes = nullptr;
-        Dwarf_Unsigned fde_bytes_len = 0;
-        Dwarf_Off cie_offset = 0;
-        Dwarf_Signed cie_index = 0;
-        Dwarf_Off fde_offset = 0;
-        Dwarf_Error e = nullptr;
-
-        if (dwarf_get_fde_range(fde, &lopc, &len, &fde_bytes, &fde_bytes_len,
-                                &cie_offset, &cie_index, &fde_offset, &e) !=
-            DW_DLV_OK)
-          continue;
-
-        if (!have_any) {
-          min_fde_lopc = lopc;
-          have_any = true;
-        } else {
-          min_fde_lopc = std::min<uint64_t>(min_fde_lopc, lopc);
-        }
+    if (in_process) {
+      const auto start = std::chrono::steady_clock::now();
+      if (!in_process->collect(keep_sample)) {
+        std::cerr << "Recording failed\n";
+        return;
       }
-
-      if (have_any) {
-        uint64_t min_ip = 0;
-        bool have_ip = false;
-        for (const auto& smp : samples) {
-          if (smp.ip == 0 || smp.dso.empty()) continue;
-          if (smp.dso.find(bin_name) == std::string::npos &&
-              smp.dso.find(binary) == std::string::npos)
-            continue;
-          if (!have_ip) {
-            min_ip = smp.ip;
-            have_ip = true;
-          } else {
-            min_ip = std::min(min_ip, smp.ip);
-          }
-        }
-
-        if (have_ip && min_ip > min_fde_lopc) {
-          inferred_bias = min_ip - min_fde_lopc;
-          if (verbose) {
-            std::cout << std::format(
-              "Inferred load bias (FDE vs runtime IP): 0x{:x}\n", inferred_bias);
-          }
+      const std::chrono::duration<double> secs =
+        std::chrono::steady_clock::now() - start;
+      report_in_process(*in_process, before, secs.count());
+      samples.address_space =
+        std::move(in_process->decoder().address_space());
+    } else if (!cached) {
+      if (!from_cache) {
+        if (!run_perf_record(binary, output_file, default_events,
+                             sample_rate, heap_env)) {
+          std::cerr << "Perf recording failed\n";
+          return;
         }
+        std::cout << std::format("Recording completed: {}\n\n", output_file);
       }
-    }
 
-    if (!have_frames) {
-      std::cerr
-        << "WARNING: Failed to read DWARF CFI (.eh_frame/.debug_frame); stack "
-           "attribution will be skipped.\n";
+      // Phase 3: Parse samples
+      std::cout << "=== Phase 3: Sample Parsing ===\n";
+      const auto start = std::chrono::steady_clock::now();
+      const auto used =
+        parse_perf_data(output_file, reader == "native", jobs, verbose,
+                        keep_sample, samples.address_space);
+      const std::chrono::duration<double> parse_secs =
+        std::chrono::steady_clock::now() - start;
+      std::cout << std::format(
+        "Parsed {} samples in {:.2f}s ({:.0f} samples/s, reader={}, "
+        "jobs={})\n",
+        before, parse_secs.count(),
+        before / std::max(parse_secs.count(), 1e-9), used,
+        used == "native" ? 1 : jobs);
     }
 
-    std::unordered_map<std::string, std::vector<const DwarfStackObject*>>
-      by_function;
-    by_function.reserve(stack_objects.size());
-    for (const auto& o : stack_objects) {
-      by_function[o.function].push_back(&o);
-    }
-
-    size_t stack_hits = 0;
-    std::unordered_map<std::string, size_t> var_hits;
-
-    size_t cfa_ok = 0;
-    size_t cfa_miss = 0;
-
-    for (const auto& s : samples) {
-      if (!have_frames || s.ip == 0 || s.sp == 0 || s.addr == 0 || s.symbol.empty())
-        continue;
-
-      // Only do stack attribution when IP is from the target binary.
-      if (s.dso.empty() ||
-          (s.dso.find(bin_name) == std::string::npos &&
-           s.dso.find(binary) == std::string::npos))
-        continue;
-
-      auto fn = std::string(base_symbol(s.symbol));
-      auto it = by_function.find(fn);
-      if (it == by_function.end()) continue;
-
-      // Map runtime IP to a DWARF PC for CFI lookup (handle PIE/ASLR via
-      // load_bias).
-      auto try_cfa = [&](uint64_t pc) { return compute_cfa_for_sample(fde_data, s, pc); };
-
-      std::optional<uint64_t> cfa;
-      // Try raw runtime IP first (non-PIE / already-relocated FDEs)
-      cfa = try_cfa(s.ip);
-      // Then try subtracting known/perf-inferred biases.
-      if (!cfa && load_bias && s.ip >= load_bias) cfa = try_cfa(s.ip - load_bias);
-      if (!cfa && inferred_bias && s.ip >= inferred_bias) cfa = try_cfa(s.ip - inferred_bias);
-
-      if (!cfa) {
-        ++cfa_miss;
-        continue;
-      }
-      ++cfa_ok;
-
-      for (const auto* obj : it->second) {
-        const int64_t cfa_i64 = static_cast<int64_t>(*cfa);
-        const int64_t loc     = cfa_i64 + obj->frame_offset;
-        if (loc < 0) continue;
-        const uint64_t var_addr = static_cast<uint64_t>(loc);
-        const uint64_t var_end  = var_addr + obj->size;
-
-        if (s.addr >= var_addr && s.addr < var_end) {
-          ++stack_hits;
-          ++var_hits[obj->function + "::" + obj->name];
-          break;
-        }
+    // A --from-cache run that had to re-parse refreshes the cache too. An
+    // --approx store is thinned, so it is not worth caching.
+    if (approx && save_cache) {
+      std::cerr << "WARNING: --save-cache is ignored with --approx\n";
+    } else if (!cached && !approx && (save_cache || from_cache)) {
+      try {
+        SampleCache::save(cache_path, samples, before,
+                          in_process ? std::string{} : output_file, binary,
+                          binary_only);
+        std::cout << std::format("Saved sample cache: {} ({} bytes)\n",
+                                 cache_path,
+                                 std::filesystem::file_size(cache_path));
+      } catch (const std::exception& e) {
+        std::cerr << std::format("WARNING: {}\n", e.what());
       }
     }
 
-    if (have_frames && frame_ctx) {
-      dwarf_fde_cie_list_dealloc(frame_ctx->dbg(), cie_data, cie_count,
-                                 fde_data, fde_count);
-    }
+    analyze_samples(modules, main_mod, std::move(ext), samples, before,
+                    topology, approx ? &*approx : nullptr, opts);
+  });
 
-    if (verbose) {
-      std::cout << std::format("CFA computed: {}  CFA miss: {}\n", cfa_ok, cfa_miss);
+  int attach_pid              = 0;
+  std::string attach_duration = "10s";
+  std::string attach_heap_log;
+
+  auto* attach = app.add_subcommand(
+    "attach", "Sample a running process (all threads) for a time window");
+  attach->add_option("-p,--pid", attach_pid, "Process to attach to")
+    ->required();
+  attach->add_option("-d,--duration", attach_duration,
+                     "Sampling window, e.g. 30s, 500ms, 2m (default 10s)");
+  attach->add_option("-e,--event", default_events, "Perf event to record");
+  attach->add_option("-c,--count", sample_rate, "Sample period");
+  attach->add_option("-j,--jobs", jobs,
+                     "Ring-buffer reader and cache-line aggregation threads");
+  attach->add_flag("--binary-only", binary_only,
+                   "Ignore samples from shared libraries");
+  attach
+    ->add_option("--window", window_ms,
+                 "Also score lines per <ms> window and report contention "
+                 "phases")
+    ->check(CLI::PositiveNumber);
+  attach
+    ->add_option("--topology", topology_file,
+                 "CPU topology file for the coherence cost model (default: "
+                 "this machine's /sys/devices/system/cpu)")
+    ->check(CLI::ExistingFile);
+  attach->add_option("--matrix", matrix_file,
+                     "Write tid x tid transfer matrices (all lines, hot "
+                     "lines, objects) to <file>: .json for JSON, else CSV");
+  attach
+    ->add_option("--approx", approx_mb,
+                 "Aggregate cache lines in a fixed-memory sketch while "
+                 "recording and keep a thinned sample store, <MB> MiB in "
+                 "all, for very long captures")
+    ->check(CLI::PositiveNumber);
+  attach->add_flag("--validate-approx", validate_approx,
+                   "With --approx, also run the exact pass and list the "
+                   "lines the sketch missed");
+  attach->add_option("--heap-log", attach_heap_log,
+                     "Heap tracer log of the process (started with "
+                     "LD_PRELOAD=libcachescope_heap.so and "
+                     "CACHESCOPE_HEAP_LOG=<file>)");
+
+  attach->callback([&]() {
+    const auto window = parse_duration(attach_duration);
+    if (!window) {
+      std::cerr << std::format("Invalid --duration '{}'\n", attach_duration);
+      return;
     }
 
-    std::cout << std::format("Stack-attributed samples: {} / {}\n\n",
-                             stack_hits, samples.size());
+    std::string exe;
+    try {
+      exe = ProcMaps::exe_path(attach_pid);
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << "\n";
+      return;
+    }
 
-    if (verbose && !var_hits.empty()) {
-      std::vector<std::pair<std::string, size_t>> ranked(var_hits.begin(),
-                                                         var_hits.end());
-      std::ranges::sort(ranked, [](const auto& a, const auto& b) {
-        if (a.second != b.second) return a.second > b.second;
-        return a.first < b.first;
-      });
+    // /proc/<pid>/exe stays readable even if the file on disk was replaced.
+    const auto proc_exe = std::format("/proc/{}/exe", attach_pid);
+    auto ext            = std::make_unique<Extractor>(proc_exe);
+    run_dwarf_phase(*ext, verbose);
 
-      std::cout << "Top stack variables by hits:\n";
-      for (size_t i = 0; i < std::min<size_t>(ranked.size(), 10); ++i) {
-        std::cout << std::format("  {}: {}\n", ranked[i].first,
-                                 ranked[i].second);
-      }
-      std::cout << "\n";
+    // Phase 2: Record samples
+    std::cout << "=== Phase 2: Performance Recording ===\n";
+    std::cout << std::format(
+      "Attaching to pid {} ({}) with event '{}' (period={}) for {}\n",
+      attach_pid, exe, default_events, sample_rate, attach_duration);
+
+    const AnalysisOptions opts{jobs,
+                               window_ms,
+                               verbose,
+                               topology_file,
+                               matrix_file,
+                               approx_mb,
+                               validate_approx,
+                               static_cast<uint64_t>(sample_rate),
+                               attach_heap_log};
+    const auto topology = load_topology(opts);
+
+    size_t before = 0;
+    SampleStore samples;
+    ModuleSet modules(samples.address_space);
+    Module& main_mod = modules.add(
+      std::make_unique<Module>(exe, std::string{}, proc_exe));
+    std::optional<ApproxIngest> approx;
+    if (approx_mb > 0) approx.emplace(opts, topology, samples);
+    const auto keep_sample =
+      keep_user_samples(exe, binary_only, samples, before, modules,
+                        approx ? &*approx : nullptr);
+
+    std::unique_ptr<PerfRecorder> rec;
+    try {
+      rec = std::make_unique<PerfRecorder>(default_events, sample_rate, jobs);
+      if (!attach_heap_log.empty()) rec->use_clock(CLOCK_MONOTONIC);
+      rec->attach(attach_pid);
+    } catch (const std::exception& e) {
+      std::cerr << std::format("Cannot attach to pid {}: {}\n", attach_pid,
+                               e.what());
+      return;
     }
 
-    // Phase 6: Static attribution (globals)
-    std::cout << "=== Phase 6: Static Attribution ===\n";
+    const auto start = std::chrono::steady_clock::now();
+    rec->collect(keep_sample, *window);
+    const std::chrono::duration<double> secs =
+      std::chrono::steady_clock::now() - start;
+    report_in_process(*rec, before, secs.count());
+    samples.address_space = std::move(rec->decoder().address_space());
+
+    analyze_samples(modules, main_mod, std::move(ext), samples, before,
+                    topology, approx ? &*approx : nullptr, opts);
   });
 
   CLI11_PARSE(app, argc, argv);
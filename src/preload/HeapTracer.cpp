@@ -0,0 +1,433 @@
+// LD_PRELOAD heap tracer (libcachescope_heap.so): interposes the C
+// allocation functions and the replaceable operator new/delete, and logs
+// every allocation and free with its size, time, thread and caller to the
+// file named by $CACHESCOPE_HEAP_LOG (see preload/HeapLog.hpp).
+//
+// Each thread fills a batch of its own, without locks, and appends it to the
+// log with a single write() when it is full, when the thread exits and when
+// the process exits. Nothing on the traced path may allocate: batches are
+// mmap()ed, and the real allocator is found with dlsym(), whose own
+// allocations come from a small static arena.
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "preload/HeapLog.hpp"
+
+#define TRACER_API __attribute__((visibility("default")))
+
+namespace {
+
+// Events per thread batch: 192 KiB, one write() per 4096 calls.
+constexpr size_t BATCH_EVENTS    = 4096;
+constexpr size_t BOOTSTRAP_BYTES = 16384;
+
+struct Batch {
+  HeapEvent events[BATCH_EVENTS];
+  std::atomic<size_t> used{0};
+  std::atomic<bool> owned{true};      // by a running thread
+  std::atomic<bool> flushing{false};  // one flush() at a time
+  Batch* next = nullptr;              // every batch, for the exit flush
+};
+
+using MallocFn   = void* (*)(size_t);
+using CallocFn   = void* (*)(size_t, size_t);
+using ReallocFn  = void* (*)(void*, size_t);
+using FreeFn     = void (*)(void*);
+using MemalignFn = void* (*)(size_t, size_t);
+
+MallocFn real_malloc     = nullptr;
+CallocFn real_calloc     = nullptr;
+ReallocFn real_realloc   = nullptr;
+FreeFn real_free         = nullptr;
+MemalignFn real_memalign = nullptr;
+bool resolving           = false;
+
+int log_fd   = -1;  // -1: not tracing
+uint32_t pid = 0;
+pthread_key_t exit_key;
+std::atomic<Batch*> batches{nullptr};
+
+alignas(16) char bootstrap[BOOTSTRAP_BYTES];
+std::atomic<size_t> bootstrap_used{0};
+
+[[gnu::tls_model("initial-exec")]] thread_local Batch* batch = nullptr;
+[[gnu::tls_model("initial-exec")]] thread_local uint32_t tid = 0;
+// Inside the tracer (or its setup): allocations are not traced.
+[[gnu::tls_model("initial-exec")]] thread_local bool busy = false;
+
+// dlsym() allocates before the real allocator is known. The arena is never
+// reused, so it is also already zeroed for calloc().
+void* bootstrap_alloc(size_t size) {
+  size             = (size + 15) & ~size_t{15};
+  const size_t off = bootstrap_used.fetch_add(size);
+  return off + size <= BOOTSTRAP_BYTES ? bootstrap + off : nullptr;
+}
+
+bool in_bootstrap(const void* p) {
+  return p >= bootstrap && p < bootstrap + BOOTSTRAP_BYTES;
+}
+
+void resolve() {
+  if (resolving) return;
+  resolving    = true;
+  real_calloc  = reinterpret_cast<CallocFn>(dlsym(RTLD_NEXT, "calloc"));
+  real_malloc  = reinterpret_cast<MallocFn>(dlsym(RTLD_NEXT, "malloc"));
+  real_realloc = reinterpret_cast<ReallocFn>(dlsym(RTLD_NEXT, "realloc"));
+  real_free    = reinterpret_cast<FreeFn>(dlsym(RTLD_NEXT, "free"));
+  real_memalign =
+    reinterpret_cast<MemalignFn>(dlsym(RTLD_NEXT, "memalign"));
+  resolving = false;
+}
+
+uint64_t now() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000 +
+         static_cast<uint64_t>(ts.tv_nsec);
+}
+
+void write_all(const void* data, size_t n) {
+  const char* p = static_cast<const char*>(data);
+  while (n > 0) {
+    const ssize_t w = write(log_fd, p, n);
+    if (w < 0 && errno == EINTR) continue;
+    if (w <= 0) return;
+    p += w;
+    n -= static_cast<size_t>(w);
+  }
+}
+
+// Writes the batch's events and empties it. The exit flush runs while other
+// threads may still append, so `used` is only reset by a compare-exchange
+// against the count just written: events appended meanwhile are written on
+// the next round instead of being dropped or overwritten.
+void flush(Batch* b) {
+  while (b->flushing.exchange(true, std::memory_order_acquire)) {
+  }
+  size_t done = 0;
+  size_t n    = b->used.load(std::memory_order_acquire);
+  for (;;) {
+    if (n > done && log_fd >= 0)
+      write_all(b->events + done, (n - done) * sizeof(HeapEvent));
+    done = n;
+    if (b->used.compare_exchange_weak(n, 0, std::memory_order_acq_rel,
+                                      std::memory_order_acquire))
+      break;
+  }
+  b->flushing.store(false, std::memory_order_release);
+}
+
+// The batch of an exited thread, else a new one.
+Batch* claim_batch() {
+  for (Batch* b = batches.load(std::memory_order_acquire); b; b = b->next) {
+    bool owned = false;
+    if (b->owned.compare_exchange_strong(owned, true)) return b;
+  }
+  void* mem = mmap(nullptr, sizeof(Batch), PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) return nullptr;
+  Batch* b = new (mem) Batch;
+  b->next  = batches.load(std::memory_order_relaxed);
+  while (!batches.compare_exchange_weak(b->next, b, std::memory_order_release,
+                                        std::memory_order_relaxed)) {
+  }
+  return b;
+}
+
+void release_batch(void* p) {
+  auto* b = static_cast<Batch*>(p);
+  busy    = true;
+  flush(b);
+  b->owned.store(false, std::memory_order_release);
+  batch = nullptr;
+  busy  = false;
+}
+
+void record(HeapEventKind kind, const void* addr, size_t size,
+            const void* site) {
+  if (log_fd < 0 || busy) return;
+  busy     = true;
+  Batch* b = batch;
+  if (!b && (b = claim_batch())) {
+    batch = b;
+    tid   = static_cast<uint32_t>(syscall(SYS_gettid));
+    pthread_setspecific(exit_key, b);
+  }
+  if (b) {
+    size_t n = b->used.load(std::memory_order_acquire);
+    for (;;) {
+      if (n == BATCH_EVENTS) {
+        flush(b);
+        n = b->used.load(std::memory_order_acquire);
+        continue;
+      }
+      HeapEvent& e = b->events[n];
+      e.time       = now();
+      e.addr       = reinterpret_cast<uint64_t>(addr);
+      e.size       = size;
+      e.site       = reinterpret_cast<uint64_t>(site);
+      e.pid        = pid;
+      e.tid        = tid;
+      e.kind       = kind;
+      e.reserved   = 0;
+      // Fails when the exit flush emptied the batch meanwhile.
+      if (b->used.compare_exchange_strong(n, n + 1,
+                                          std::memory_order_release,
+                                          std::memory_order_acquire))
+        break;
+    }
+  }
+  busy = false;
+}
+
+// The child keeps only the forking thread, and the parent still owns (and
+// will write) every event buffered before the fork.
+void after_fork() {
+  pid = static_cast<uint32_t>(getpid());
+  tid = static_cast<uint32_t>(syscall(SYS_gettid));
+  for (Batch* b = batches.load(std::memory_order_acquire); b; b = b->next) {
+    b->used.store(0, std::memory_order_relaxed);
+    b->owned.store(b == batch, std::memory_order_relaxed);
+  }
+}
+
+void* allocate(size_t size, size_t align, const void* site) {
+  if (!real_malloc) resolve();
+  void* p = nullptr;
+  if (align > 0)
+    p = real_memalign ? real_memalign(align, size) : nullptr;
+  else
+    p = real_malloc ? real_malloc(size) : bootstrap_alloc(size);
+  if (p) record(HeapEventKind::ALLOC, p, size, site);
+  return p;
+}
+
+void release(void* p, const void* site) {
+  if (!p || in_bootstrap(p)) return;
+  // Before the block can be handed out again.
+  record(HeapEventKind::FREE, p, 0, site);
+  if (!real_free) resolve();
+  if (real_free) real_free(p);
+}
+
+void* new_impl(size_t size, size_t align, const void* site) {
+  for (;;) {
+    if (void* p = allocate(size ? size : 1, align, site)) return p;
+    std::new_handler handler = std::get_new_handler();
+    if (!handler) throw std::bad_alloc();
+    handler();
+  }
+}
+
+void* new_nothrow(size_t size, size_t align, const void* site) noexcept {
+  try {
+    return new_impl(size, align, site);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+__attribute__((constructor)) void start() {
+  busy = true;
+  resolve();
+  const char* path = getenv(HEAP_LOG_ENV);
+  if (path && *path) {
+    const int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0) {
+      log_fd = fd;
+      if (st.st_size == 0) write_all(HEAP_LOG_MAGIC, sizeof(HEAP_LOG_MAGIC));
+      pid = static_cast<uint32_t>(getpid());
+      pthread_key_create(&exit_key, release_batch);
+      pthread_atfork(nullptr, nullptr, after_fork);
+    } else if (fd >= 0) {
+      close(fd);
+    }
+  }
+  busy = false;
+  record(HeapEventKind::START, nullptr, 0, nullptr);
+}
+
+// Batches of exited threads are idle; those of threads still running are
+// emptied with flush()'s compare-exchange, so their owners' appends are
+// neither lost nor written twice.
+__attribute__((destructor)) void stop() {
+  busy = true;
+  for (Batch* b = batches.load(std::memory_order_acquire); b; b = b->next)
+    flush(b);
+  busy = false;
+}
+
+}  // namespace
+
+/* ============================================================
+ * C allocation functions
+ * ============================================================ */
+
+extern "C" TRACER_API void* malloc(size_t size) noexcept {
+  return allocate(size, 0, __builtin_return_address(0));
+}
+
+extern "C" TRACER_API void free(void* p) noexcept {
+  release(p, __builtin_return_address(0));
+}
+
+extern "C" TRACER_API void* calloc(size_t n, size_t size) noexcept {
+  size_t bytes = 0;
+  if (__builtin_mul_overflow(n, size, &bytes)) {
+    errno = ENOMEM;
+    return nullptr;
+  }
+  if (!real_calloc) resolve();
+  void* p = real_calloc ? real_calloc(n, size) : bootstrap_alloc(bytes);
+  if (p) record(HeapEventKind::ALLOC, p, bytes, __builtin_return_address(0));
+  return p;
+}
+
+extern "C" TRACER_API void* realloc(void* old, size_t size) noexcept {
+  const void* site = __builtin_return_address(0);
+  if (in_bootstrap(old)) {
+    void* p = allocate(size, 0, site);
+    const auto left = static_cast<size_t>(bootstrap + BOOTSTRAP_BYTES -
+                                          static_cast<char*>(old));
+    if (p) std::memcpy(p, old, size < left ? size : left);
+    return p;
+  }
+  if (!real_realloc) resolve();
+  if (!real_realloc) return nullptr;
+
+  // As in release(): logged before the block can be handed out again.
+  if (old) record(HeapEventKind::FREE, old, 0, site);
+  void* p = real_realloc(old, size);
+  if (p) {
+    record(HeapEventKind::ALLOC, p, size, site);
+  } else if (old && size != 0) {
+    // A failed realloc leaves the old block allocated; realloc(p, 0) freed it.
+    record(HeapEventKind::ALLOC, old, malloc_usable_size(old), site);
+  }
+  return p;
+}
+
+extern "C" TRACER_API void* aligned_alloc(size_t align, size_t size) noexcept {
+  return allocate(size, align, __builtin_return_address(0));
+}
+
+extern "C" TRACER_API void* memalign(size_t align, size_t size) noexcept {
+  return allocate(size, align, __builtin_return_address(0));
+}
+
+extern "C" TRACER_API int posix_memalign(void** out, size_t align,
+                                         size_t size) noexcept {
+  if (align < sizeof(void*) || (align & (align - 1)) != 0) return EINVAL;
+  void* p = allocate(size, align, __builtin_return_address(0));
+  if (!p) return ENOMEM;
+  *out = p;
+  return 0;
+}
+
+/* ============================================================
+ * Replaceable operator new / delete
+ * ============================================================ */
+
+TRACER_API void* operator new(size_t size) {
+  return new_impl(size, 0, __builtin_return_address(0));
+}
+
+TRACER_API void* operator new[](size_t size) {
+  return new_impl(size, 0, __builtin_return_address(0));
+}
+
+TRACER_API void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return new_nothrow(size, 0, __builtin_return_address(0));
+}
+
+TRACER_API void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return new_nothrow(size, 0, __builtin_return_address(0));
+}
+
+TRACER_API void* operator new(size_t size, std::align_val_t align) {
+  return new_impl(size, static_cast<size_t>(align),
+                  __builtin_return_address(0));
+}
+
+TRACER_API void* operator new[](size_t size, std::align_val_t align) {
+  return new_impl(size, static_cast<size_t>(align),
+                  __builtin_return_address(0));
+}
+
+TRACER_API void* operator new(size_t size, std::align_val_t align,
+                              const std::nothrow_t&) noexcept {
+  return new_nothrow(size, static_cast<size_t>(align),
+                     __builtin_return_address(0));
+}
+
+TRACER_API void* operator new[](size_t size, std::align_val_t align,
+                                const std::nothrow_t&) noexcept {
+  return new_nothrow(size, static_cast<size_t>(align),
+                     __builtin_return_address(0));
+}
+
+TRACER_API void operator delete(void* p) noexcept {
+  release(p, __builtin_return_address(0));
+}
+
+TRACER_API void operator delete[](void* p) noexcept {
+  release(p, __builtin_return_address(0));
+}
+
+TRACER_API void operator delete(void* p, size_t) noexcept {
+  release(p, __builtin_return_address(0));
+}
+
+TRACER_API void operator delete[](void* p, size_t) noexcept {
+  release(p, __builtin_return_address(0));
+}
+
+TRACER_API void operator delete(void* p, std::align_val_t) noexcept {
+  release(p, __builtin_return_address(0));
+}
+
+TRACER_API void operator delete[](void* p, std::align_val_t) noexcept {
+  release(p, __builtin_return_address(0));
+}
+
+TRACER_API void operator delete(void* p, size_t, std::align_val_t) noexcept {
+  release(p, __builtin_return_address(0));
+}
+
+TRACER_API void operator delete[](void* p, size_t, std::align_val_t) noexcept {
+  release(p, __builtin_return_address(0));
+}
+
+TRACER_API void operator delete(void* p, const std::nothrow_t&) noexcept {
+  release(p, __builtin_return_address(0));
+}
+
+TRACER_API void operator delete[](void* p, const std::nothrow_t&) noexcept {
+  release(p, __builtin_return_address(0));
+}
+
+TRACER_API void operator delete(void* p, std::align_val_t,
+                                const std::nothrow_t&) noexcept {
+  release(p, __builtin_return_address(0));
+}
+
+TRACER_API void operator delete[](void* p, std::align_val_t,
+                                  const std::nothrow_t&) noexcept {
+  release(p, __builtin_return_address(0));
+}
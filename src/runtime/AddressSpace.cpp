@@ -0,0 +1,86 @@
+#include "runtime/AddressSpace.hpp"
+
+uint32_t AddressSpace::add(Mapping m) {
+  mappings_.push_back(std::move(m));
+  return static_cast<uint32_t>(mappings_.size());
+}
+
+uint32_t AddressSpace::map(uint32_t pid, uint64_t start, uint64_t len,
+                           uint64_t pgoff, std::string path,
+                           std::string build_id) {
+  if (len == 0) return NONE;
+  auto& table        = live_[pid];
+  const uint64_t end = start + len;
+
+  // Older mappings keep their ids (samples already resolved to them stay
+  // valid); the pieces that survive the overlap become new mappings.
+  auto it = table.upper_bound(start);
+  if (it != table.begin()) --it;
+  while (it != table.end() && get(it->second).start < end) {
+    const Mapping& old = get(it->second);
+    if (old.end <= start) {
+      ++it;
+      continue;
+    }
+    const uint32_t old_id = it->second;
+    it                    = table.erase(it);
+    if (old.start < start) {
+      Mapping head = get(old_id);
+      head.end     = start;
+      table.emplace(head.start, add(std::move(head)));
+    }
+    if (get(old_id).end > end) {
+      Mapping tail = get(old_id);
+      tail.pgoff += end - tail.start;
+      tail.start = end;
+      it         = table.emplace(tail.start, add(std::move(tail))).first;
+      ++it;
+    }
+  }
+
+  const uint32_t id = add(Mapping{pid, start, end, pgoff, std::move(path),
+                                  std::move(build_id)});
+  table.emplace(start, id);
+  return id;
+}
+
+void AddressSpace::clear(uint32_t pid) { live_.erase(pid); }
+
+void AddressSpace::fork(uint32_t parent, uint32_t child) {
+  auto it = live_.find(parent);
+  if (it == live_.end()) return;
+  // The child shares the parent's mapping ids; its own mmaps split them
+  // into new ones like any other overlap.
+  live_[child] = it->second;
+}
+
+uint32_t AddressSpace::resolve(uint32_t pid, uint64_t addr) const {
+  auto pit = live_.find(pid);
+  if (pit == live_.end()) return NONE;
+  const auto& table = pit->second;
+  auto it           = table.upper_bound(addr);
+  if (it == table.begin()) return NONE;
+  --it;
+  return addr < get(it->second).end ? it->second : NONE;
+}
+
+std::optional<uint64_t> AddressSpace::image_base(
+  uint32_t pid, std::string_view name) const {
+  auto pit = live_.find(pid);
+  if (pit == live_.end()) return std::nullopt;
+
+  std::optional<uint64_t> lowest;
+  for (const auto& [start, id] : pit->second) {
+    const Mapping& m = get(id);
+    if (m.path.find(name) == std::string::npos) continue;
+    if (m.pgoff == 0) return start;
+    if (!lowest) lowest = start;
+  }
+  return lowest;
+}
+
+void AddressSpace::restore(std::vector<Mapping> mappings,
+                           std::unordered_map<uint32_t, Intervals> live) {
+  mappings_ = std::move(mappings);
+  live_     = std::move(live);
+}
@@ -0,0 +1,128 @@
+#include "runtime/AllocationTracker.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include "preload/HeapLog.hpp"
+
+AllocationTracker AllocationTracker::load(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) throw std::runtime_error(std::format("cannot read {}", path));
+
+  char magic[sizeof(HEAP_LOG_MAGIC)] = {};
+  in.read(magic, sizeof(magic));
+  if (!in || std::memcmp(magic, HEAP_LOG_MAGIC, sizeof(magic)) != 0)
+    throw std::runtime_error(std::format("{}: not a heap tracer log", path));
+
+  // A batch cut short by a crash leaves a partial record at the end.
+  std::vector<HeapEvent> events;
+  HeapEvent e;
+  while (in.read(reinterpret_cast<char*>(&e), sizeof(e))) events.push_back(e);
+
+  // Batches of different threads interleave in the file.
+  std::ranges::stable_sort(events, {}, &HeapEvent::time);
+
+  AllocationTracker out;
+  out.events_ = events.size();
+  std::map<Key, uint32_t> open;
+  auto close = [&](std::map<Key, uint32_t>::iterator it, uint64_t time) {
+    out.allocations_[it->second].free_time = time;
+    return open.erase(it);
+  };
+
+  for (const HeapEvent& ev : events) {
+    switch (ev.kind) {
+      case HeapEventKind::START: {
+        // exec(): whatever the old image allocated is gone.
+        auto it = open.lower_bound({ev.pid, 0});
+        while (it != open.end() && it->first.first == ev.pid)
+          it = close(it, ev.time);
+        break;
+      }
+
+      case HeapEventKind::ALLOC: {
+        // A block overlapping a live one means its free was missed (or
+        // logged after the reuse, as realloc does): it ended here.
+        auto it = open.lower_bound({ev.pid, ev.addr});
+        if (it != open.begin()) {
+          auto prev     = std::prev(it);
+          const auto& a = out.allocations_[prev->second];
+          if (prev->first.first == ev.pid && a.addr + a.size > ev.addr)
+            close(prev, ev.time);
+        }
+        while (it != open.end() && it->first.first == ev.pid &&
+               it->first.second < ev.addr + ev.size)
+          it = close(it, ev.time);
+
+        open[{ev.pid, ev.addr}] =
+          static_cast<uint32_t>(out.allocations_.size());
+        out.allocations_.push_back(
+          {ev.addr, ev.size, ev.site, ev.time, Allocation::LIVE, ev.pid,
+           ev.tid});
+        break;
+      }
+
+      case HeapEventKind::FREE:
+        if (auto it = open.find({ev.pid, ev.addr}); it != open.end())
+          close(it, ev.time);
+        break;
+    }
+  }
+
+  for (uint32_t i = 0; i < out.allocations_.size(); ++i) {
+    if (out.allocations_[i].free_time != Allocation::LIVE)
+      out.by_free_.push_back(i);
+  }
+  std::ranges::stable_sort(out.by_free_, {}, [&](uint32_t i) {
+    return out.allocations_[i].free_time;
+  });
+  return out;
+}
+
+void AllocationTracker::rewind() {
+  live_.clear();
+  next_alloc_ = 0;
+  next_free_  = 0;
+  now_        = 0;
+}
+
+const Allocation* AllocationTracker::find(uint32_t pid, uint64_t addr,
+                                          uint64_t time) {
+  if (time < now_) rewind();
+  now_ = time;
+
+  // Replay up to `time`. At equal times a free goes first, unless it is of
+  // a block not allocated yet.
+  for (;;) {
+    const bool alloc_left = next_alloc_ < allocations_.size();
+    const bool free_left  = next_free_ < by_free_.size();
+    const uint64_t ta =
+      alloc_left ? allocations_[next_alloc_].alloc_time : Allocation::LIVE;
+    const uint64_t tf = free_left
+                          ? allocations_[by_free_[next_free_]].free_time
+                          : Allocation::LIVE;
+    if (free_left && tf <= time &&
+        (tf < ta || (tf == ta && by_free_[next_free_] < next_alloc_))) {
+      const uint32_t idx = by_free_[next_free_++];
+      const auto& a      = allocations_[idx];
+      auto it            = live_.find({a.pid, a.addr});
+      if (it != live_.end() && it->second == idx) live_.erase(it);
+    } else if (alloc_left && ta <= time) {
+      const auto& a          = allocations_[next_alloc_];
+      live_[{a.pid, a.addr}] = static_cast<uint32_t>(next_alloc_++);
+    } else {
+      break;
+    }
+  }
+
+  auto it = live_.upper_bound({pid, addr});
+  if (it == live_.begin()) return nullptr;
+  --it;
+  if (it->first.first != pid) return nullptr;
+  const Allocation& a = allocations_[it->second];
+  return addr < a.addr + a.size ? &a : nullptr;
+}
@@ -0,0 +1,233 @@
+#include "runtime/CacheLineAccumulator.hpp"
+
+#include <bit>
+
+#include "runtime/CpuTopology.hpp"
+
+size_t CacheLineAccumulator::slot_for(LineState& line, uint32_t tid) {
+  for (size_t i = 0; i < line.threads; ++i) {
+    if (slot(line, i).tid == tid) return i;
+  }
+  if (line.threads == THREAD_SLOTS) return THREAD_SLOTS;
+
+  const size_t i = line.threads++;
+  if (i >= 2 && line.extra == NO_EXTRA) {
+    line.extra = static_cast<uint32_t>(extra_.size());
+    extra_.emplace_back();
+  }
+  slot(line, i).tid = tid;
+  return i;
+}
+
+CacheLineAccumulator::ThreadSlot& CacheLineAccumulator::slot(LineState& line,
+                                                             size_t i) {
+  return i < 2 ? line.slots[i] : extra_[line.extra][i - 2];
+}
+
+const CacheLineAccumulator::ThreadSlot& CacheLineAccumulator::slot(
+  const LineState& line, size_t i) const {
+  return i < 2 ? line.slots[i] : extra_[line.extra][i - 2];
+}
+
+void CacheLineAccumulator::add(uint64_t addr, uint32_t tid, uint32_t cpu,
+                               SampleType type) {
+  const uint64_t base = addr / LINE_SIZE * LINE_SIZE;
+  const auto off      = static_cast<uint8_t>(addr - base);
+  auto& line          = lines_[base];
+
+  if (line.samples > 0) {
+    if (tid != line.last_tid) ++line.switches;
+    if (cpu != line.last_cpu) {
+      const auto d = topology_ ? topology_->distance(line.last_cpu, cpu)
+                               : CpuDistance::UNKNOWN;
+      ++line.transitions[static_cast<size_t>(d)];
+    }
+  }
+  line.last_tid = tid;
+  line.last_cpu = cpu;
+  ++line.samples;
+  const bool writes = type == SampleType::CACHE_STORE;
+  if (writes) {
+    ++line.writes;
+    line.write_offsets |= uint64_t{1} << off;
+    saw_stores_ = true;
+  } else {
+    ++line.reads;
+  }
+
+  const size_t i = slot_for(line, tid);
+  if (i == THREAD_SLOTS) {
+    line.overflow = true;
+    line.overflow_offsets |= uint64_t{1} << off;
+    return;
+  }
+  ThreadSlot& s = slot(line, i);
+  s.offsets |= uint64_t{1} << off;
+  if (writes) line.wrote |= static_cast<uint8_t>(1u << i);
+
+  // Space-saving top-1 estimate: exact while the thread touches at most two
+  // offsets of the line, which is the false-sharing pattern of interest.
+  auto& cnt = s.top_count;
+  auto& at  = s.top_offset;
+  for (size_t k = 0; k < 2; ++k) {
+    if (cnt[k] != 0 && at[k] == off) {
+      ++cnt[k];
+      return;
+    }
+  }
+  const size_t victim = cnt[0] <= cnt[1] ? 0 : 1;
+  at[victim]          = off;
+  cnt[victim] += 1;
+}
+
+CacheLine CacheLineAccumulator::metrics(uint64_t base,
+                                        const LineState& line) const {
+  CacheLine out;
+  out.base_addr       = base;
+  out.sample_count    = line.samples;
+  out.sample_reads    = line.reads;
+  out.sample_writes   = line.writes;
+  out.thread_count    = line.threads + (line.overflow ? 1 : 0);
+  out.thread_overflow = line.overflow;
+
+  out.thread_switches = line.switches;
+  if (line.samples > 1) {
+    out.bounce_score = static_cast<double>(line.switches) /
+                       static_cast<double>(line.samples - 1);
+  }
+
+  for (size_t d = 0; d < CPU_DISTANCES; ++d) {
+    const uint32_t cost = topology_
+                            ? topology_->cost(static_cast<CpuDistance>(d))
+                            : CpuTopology::DEFAULT_COSTS[d];
+    out.transitions[d] = line.transitions[d];
+    out.coherence_cycles += static_cast<double>(line.transitions[d]) * cost;
+  }
+
+  // Offsets touched by any thread, and by at least two.
+  uint64_t any    = line.overflow_offsets;
+  uint64_t shared = line.overflow_offsets;
+  uint64_t tops   = 0;
+  out.tids.reserve(line.threads);
+  for (size_t i = 0; i < line.threads; ++i) {
+    const auto& s = slot(line, i);
+    out.tids.push_back(s.tid);
+    shared |= any & s.offsets;
+    any |= s.offsets;
+    if ((line.wrote >> i) & 1)
+      ++out.writer_count;
+    else
+      out.reader_mask |= s.offsets;
+
+    // Highest count wins; ties go to the lower offset.
+    size_t k = 0;
+    if (s.top_count[1] > s.top_count[0] ||
+        (s.top_count[1] == s.top_count[0] && s.top_offset[1] < s.top_offset[0]))
+      k = 1;
+    if (s.top_count[k] != 0) tops |= uint64_t{1} << s.top_offset[k];
+  }
+
+  out.offset_mask         = any;
+  out.write_mask          = line.write_offsets;
+  out.total_offset_count  = static_cast<size_t>(std::popcount(any));
+  out.shared_offset_count = static_cast<size_t>(std::popcount(shared));
+  out.unique_top_offsets  = static_cast<size_t>(std::popcount(tops));
+  out.private_offset_fraction =
+    out.total_offset_count == 0
+      ? 0.0
+      : static_cast<double>(out.total_offset_count -
+                            out.shared_offset_count) /
+          static_cast<double>(out.total_offset_count);
+  return out;
+}
+
+std::vector<CacheLine> CacheLineAccumulator::finish(size_t min_samples) const {
+  std::vector<CacheLine> out;
+  for (const auto& [base, line] : lines_) {
+    if (line.samples >= min_samples) out.push_back(metrics(base, line));
+  }
+  return out;
+}
+
+size_t CacheLineAccumulator::memory_bytes() const {
+  return lines_.memory_bytes() + extra_.capacity() * sizeof(ExtraSlots);
+}
+
+void CacheLinePairAccumulator::add(uint64_t addr, uint32_t tid,
+                                   SampleType type) {
+  const uint64_t base = addr / PAIR_SIZE * PAIR_SIZE;
+  const uint8_t h     = addr - base >= PAIR_SIZE / 2 ? 1 : 0;
+  auto& pair          = pairs_[base];
+
+  if (pair.samples > 0 && tid != pair.last_tid) {
+    ++pair.switches;
+    if (h != pair.last_half) ++pair.cross_switches;
+  }
+  pair.last_tid  = tid;
+  pair.last_half = h;
+  ++pair.samples;
+
+  auto& half        = pair.halves[h];
+  const bool writes = type == SampleType::CACHE_STORE;
+  ++half.samples;
+  if (writes) ++half.writes;
+
+  size_t i = 0;
+  while (i < half.threads && half.tids[i] != tid) ++i;
+  if (i == half.threads) {
+    if (half.threads == HALF_THREADS) {
+      half.overflow = true;
+      return;
+    }
+    half.tids[half.threads++] = tid;
+  }
+  if (writes) half.wrote |= static_cast<uint8_t>(1u << i);
+}
+
+CacheLinePair CacheLinePairAccumulator::metrics(uint64_t base,
+                                                const PairState& pair) const {
+  CacheLinePair out;
+  out.base_addr    = base;
+  out.sample_count = pair.samples;
+
+  // Without any store in the pair (e.g. AMD IBS loads only) every toucher
+  // counts as a writer.
+  const bool has_writes = pair.halves[0].writes + pair.halves[1].writes > 0;
+  for (size_t h = 0; h < 2; ++h) {
+    const auto& half    = pair.halves[h];
+    out.half_samples[h] = half.samples;
+    out.half_writes[h]  = half.writes;
+    for (size_t i = 0; i < half.threads; ++i) {
+      if (!has_writes || (half.wrote >> i) & 1)
+        out.half_tids[h].push_back(half.tids[i]);
+    }
+  }
+  for (const uint32_t a : out.half_tids[0]) {
+    for (const uint32_t b : out.half_tids[1]) out.split_writers |= a != b;
+  }
+
+  out.thread_switches = pair.switches;
+  out.cross_switches  = pair.cross_switches;
+  if (pair.samples > 1) {
+    const auto gaps  = static_cast<double>(pair.samples - 1);
+    out.bounce_score = static_cast<double>(pair.switches) / gaps;
+    out.cross_bounce = static_cast<double>(pair.cross_switches) / gaps;
+  }
+  return out;
+}
+
+std::vector<CacheLinePair> CacheLinePairAccumulator::finish(
+  size_t min_samples) const {
+  std::vector<CacheLinePair> out;
+  for (const auto& [base, pair] : pairs_) {
+    if (pair.samples >= min_samples) out.push_back(metrics(base, pair));
+  }
+  return out;
+}
+
+std::optional<CacheLinePair> CacheLinePairAccumulator::find(
+  uint64_t base) const {
+  auto it = pairs_.find(base);
+  if (it == pairs_.end()) return std::nullopt;
+  return metrics(base, it->second);
+}
@@ -0,0 +1,249 @@
+#include "runtime/CacheLineSketch.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <utility>
+
+#include "runtime/CpuTopology.hpp"
+
+// splitmix64 finalizer: spreads tids over the HyperLogLog registers and
+// drives the reservoir, deterministically so reruns report the same lines.
+static uint64_t mix(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+static constexpr int HLL_BITS =
+  std::countr_zero(CacheLineSketch::HLL_REGISTERS);
+
+CacheLineSketch::CacheLineSketch(size_t memory_bytes,
+                                 const CpuTopology* topology)
+    : topology_(topology) {
+  // An entry, its heap slot and, at worst, two index slots per line.
+  const size_t per_line = sizeof(Entry) + sizeof(uint32_t) +
+                          2 * (sizeof(std::pair<uint64_t, uint32_t>) + 1);
+  capacity_ = std::max(MIN_CAPACITY, memory_bytes / per_line);
+  entries_.reserve(capacity_);
+  heap_.reserve(capacity_);
+  index_.reserve(capacity_);
+}
+
+size_t CacheLineSketch::memory_bytes() const {
+  return entries_.capacity() * sizeof(Entry) +
+         heap_.capacity() * sizeof(uint32_t) + index_.memory_bytes();
+}
+
+double CacheLineSketch::thread_count_error() {
+  return 1.04 / std::sqrt(static_cast<double>(HLL_REGISTERS));
+}
+
+void CacheLineSketch::reset(Entry& e, uint64_t base) {
+  const uint32_t pos = e.heap_pos;
+  e                  = Entry{};
+  e.base             = base;
+  e.heap_pos         = pos;
+}
+
+void CacheLineSketch::swap_heap(size_t a, size_t b) {
+  std::swap(heap_[a], heap_[b]);
+  entries_[heap_[a]].heap_pos = static_cast<uint32_t>(a);
+  entries_[heap_[b]].heap_pos = static_cast<uint32_t>(b);
+}
+
+void CacheLineSketch::sift_down(size_t pos) {
+  const size_t n = heap_.size();
+  for (;;) {
+    size_t least = pos;
+    for (const size_t child : {2 * pos + 1, 2 * pos + 2}) {
+      if (child < n &&
+          entries_[heap_[child]].count < entries_[heap_[least]].count)
+        least = child;
+    }
+    if (least == pos) return;
+    swap_heap(pos, least);
+    pos = least;
+  }
+}
+
+void CacheLineSketch::sift_up(size_t pos) {
+  while (pos > 0) {
+    const size_t parent = (pos - 1) / 2;
+    if (entries_[heap_[parent]].count <= entries_[heap_[pos]].count) return;
+    swap_heap(pos, parent);
+    pos = parent;
+  }
+}
+
+void CacheLineSketch::add(uint64_t addr, uint32_t tid, uint32_t cpu,
+                          SampleType type) {
+  const uint64_t base = addr / LINE_SIZE * LINE_SIZE;
+  const auto off      = static_cast<uint8_t>(addr - base);
+  const bool store    = type == SampleType::CACHE_STORE;
+  ++samples_;
+  saw_stores_ |= store;
+
+  uint32_t idx = 0;
+  if (auto it = index_.find(base); it != index_.end()) {
+    idx = it->second;
+  } else if (entries_.size() < capacity_) {
+    idx        = static_cast<uint32_t>(entries_.size());
+    Entry& e   = entries_.emplace_back();
+    e.base     = base;
+    e.heap_pos = static_cast<uint32_t>(heap_.size());
+    heap_.push_back(idx);
+    sift_up(e.heap_pos);
+    index_.emplace(base, idx);
+  } else {
+    // Space-Saving: take over the least counted line, inheriting its count.
+    idx            = heap_[0];
+    Entry& victim  = entries_[idx];
+    const auto min = victim.count;
+    index_.erase(victim.base);
+    reset(victim, base);
+    victim.count = victim.error = min;
+    index_.emplace(base, idx);
+  }
+
+  Entry& e = entries_[idx];
+  ++e.count;
+  const uint64_t seen = e.count - e.error;
+
+  if (seen > 1) {
+    if (tid != e.last_tid) ++e.switches;
+    if (cpu != e.last_cpu) {
+      const auto d = topology_ ? topology_->distance(e.last_cpu, cpu)
+                               : CpuDistance::UNKNOWN;
+      ++e.transitions[static_cast<size_t>(d)];
+    }
+  }
+  e.last_tid = tid;
+  e.last_cpu = cpu;
+  e.offsets |= uint64_t{1} << off;
+  if (store) {
+    ++e.writes;
+    e.write_offsets |= uint64_t{1} << off;
+  } else {
+    ++e.reads;
+  }
+
+  const uint64_t h = mix(tid);
+  const auto reg   = static_cast<size_t>(h >> (64 - HLL_BITS));
+  const auto rank =
+    static_cast<uint8_t>(std::countl_zero(h << HLL_BITS | 1) + 1);
+  e.hll[reg] = std::max(e.hll[reg], rank);
+
+  // Reservoir sampling (Algorithm R) over the touches since takeover.
+  const Touch touch{tid, off, store};
+  if (seen <= RESERVOIR_SIZE) {
+    e.reservoir[seen - 1] = touch;
+  } else if (const uint64_t j = mix(e.base ^ seen) % seen; j < RESERVOIR_SIZE) {
+    e.reservoir[j] = touch;
+  }
+
+  sift_down(e.heap_pos);
+}
+
+double CacheLineSketch::hll_estimate(
+  const std::array<uint8_t, HLL_REGISTERS>& hll) {
+  constexpr double m = HLL_REGISTERS;
+  double sum         = 0;
+  size_t zeros       = 0;
+  for (const uint8_t r : hll) {
+    sum += std::ldexp(1.0, -r);
+    if (r == 0) ++zeros;
+  }
+  const double raw = 0.697 * m * m / sum;
+  // Linear counting is more accurate for the few threads most lines have.
+  if (raw <= 2.5 * m && zeros > 0)
+    return m * std::log(m / static_cast<double>(zeros));
+  return raw;
+}
+
+CacheLine CacheLineSketch::metrics(const Entry& e) const {
+  CacheLine out;
+  const uint64_t seen = e.count - e.error;
+  out.base_addr       = e.base;
+  out.sample_count    = seen;
+  out.sample_reads    = e.reads;
+  out.sample_writes   = e.writes;
+
+  out.thread_switches = e.switches;
+  if (seen > 1) {
+    out.bounce_score =
+      static_cast<double>(e.switches) / static_cast<double>(seen - 1);
+  }
+
+  for (size_t d = 0; d < CPU_DISTANCES; ++d) {
+    const uint32_t cost = topology_
+                            ? topology_->cost(static_cast<CpuDistance>(d))
+                            : CpuTopology::DEFAULT_COSTS[d];
+    out.transitions[d] = e.transitions[d];
+    out.coherence_cycles += static_cast<double>(e.transitions[d]) * cost;
+  }
+
+  // Per-thread statistics from the reservoir: offsets, whether the thread
+  // stored, and its most frequent offset.
+  struct ThreadTouches {
+    uint32_t tid     = 0;
+    uint64_t offsets = 0;
+    bool wrote       = false;
+    std::array<uint8_t, LINE_SIZE> counts{};
+  };
+  std::vector<ThreadTouches> threads;
+  const size_t kept = std::min<uint64_t>(seen, RESERVOIR_SIZE);
+  for (size_t k = 0; k < kept; ++k) {
+    const Touch& t = e.reservoir[k];
+    auto it        = std::ranges::find(threads, t.tid, &ThreadTouches::tid);
+    if (it == threads.end()) {
+      threads.emplace_back().tid = t.tid;
+      it                         = threads.end() - 1;
+    }
+    it->offsets |= uint64_t{1} << t.off;
+    it->wrote |= t.store;
+    ++it->counts[t.off];
+  }
+
+  uint64_t any    = 0;
+  uint64_t shared = 0;
+  uint64_t tops   = 0;
+  for (const auto& t : threads) {
+    out.tids.push_back(t.tid);
+    shared |= any & t.offsets;
+    any |= t.offsets;
+    if (t.wrote)
+      ++out.writer_count;
+    else
+      out.reader_mask |= t.offsets;
+    const auto top = std::ranges::max_element(t.counts);
+    tops |= uint64_t{1} << (top - t.counts.begin());
+  }
+
+  const auto estimate =
+    static_cast<size_t>(std::llround(hll_estimate(e.hll)));
+  out.thread_count    = std::max(estimate, threads.size());
+  out.thread_overflow = out.thread_count > threads.size();
+
+  out.offset_mask         = e.offsets;
+  out.write_mask          = e.write_offsets;
+  out.total_offset_count  = static_cast<size_t>(std::popcount(e.offsets));
+  out.shared_offset_count = static_cast<size_t>(std::popcount(shared));
+  out.unique_top_offsets  = static_cast<size_t>(std::popcount(tops));
+  out.private_offset_fraction =
+    out.total_offset_count == 0
+      ? 0.0
+      : static_cast<double>(out.total_offset_count -
+                            out.shared_offset_count) /
+          static_cast<double>(out.total_offset_count);
+  return out;
+}
+
+std::vector<CacheLine> CacheLineSketch::finish(size_t min_samples) const {
+  std::vector<CacheLine> out;
+  for (const auto& e : entries_) {
+    if (e.count >= min_samples) out.push_back(metrics(e));
+  }
+  return out;
+}
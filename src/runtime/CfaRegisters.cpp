@@ -0,0 +1,25 @@
+#include "runtime/CfaRegisters.hpp"
+
+#include "dwarf/DwarfExpr.hpp"
+#include "runtime/SampleStore.hpp"
+
+uint32_t CfaRegisters::needed(const PerfSample& s) const {
+  if (!(s.regs_mask & ~SampleStore::COLUMN_REGS) || !s.ip_mapping) return 0;
+
+  const Mapping& m = *s.ip_mapping;
+  Module* mod      = modules_.for_file(m);
+  if (!mod) return 0;
+  mod->load_frames();
+  if (!mod->fdes()) return 0;
+
+  const auto pc = mod->link_address(m, s.ip);
+  if (!pc) return 0;
+  const CfaRule& rule = mod->cfa().at(*pc);
+
+  uint32_t regs = 0;
+  if (rule.kind == CfaRule::REGISTER && rule.reg < 32)
+    regs = 1u << rule.reg;
+  else if (rule.kind == CfaRule::EXPRESSION)
+    regs = DwarfExpr::registers(mod->cfa().expression(rule));
+  return regs & s.regs_mask & ~SampleStore::COLUMN_REGS;
+}
@@ -0,0 +1,138 @@
+#include "runtime/CfaTable.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+// The CFA rule of one CFI row as libdwarf reports it. Expressions are kept
+// once each, however many rows share them.
+CfaRule CfaTable::make_rule(Dwarf_Small value_type, Dwarf_Signed regnum,
+                            Dwarf_Signed offset_or_len, Dwarf_Ptr block) {
+  CfaRule rule;
+  if (value_type == DW_EXPR_EXPRESSION ||
+      value_type == DW_EXPR_VAL_EXPRESSION) {
+    if (!block || offset_or_len <= 0) return rule;
+    auto [it, inserted] = expr_ids_.try_emplace(block);
+    if (inserted) {
+      it->second = static_cast<int32_t>(exprs_.size());
+      exprs_.emplace_back(static_cast<const uint8_t*>(block),
+                          static_cast<size_t>(offset_or_len));
+    }
+    rule.kind   = CfaRule::EXPRESSION;
+    rule.offset = it->second;
+    return rule;
+  }
+  const Dwarf_Signed offset = offset_or_len;
+  if (regnum < 0 || regnum > std::numeric_limits<uint16_t>::max() ||
+      offset < std::numeric_limits<int32_t>::min() ||
+      offset > std::numeric_limits<int32_t>::max())
+    return rule;
+  rule.kind   = CfaRule::REGISTER;
+  rule.reg    = static_cast<uint16_t>(regnum);
+  rule.offset = static_cast<int32_t>(offset);
+  return rule;
+}
+
+static bool same_rule(const CfaRule& a, const CfaRule& b) {
+  return a.kind == b.kind && a.reg == b.reg && a.offset == b.offset;
+}
+
+CfaTable::CfaTable(Dwarf_Fde* fdes, Dwarf_Signed count) : fdes_(fdes) {
+#ifdef HAVE_DWARF_CFA_REG3_B
+  struct Range {
+    uint64_t lo, hi;
+    Dwarf_Fde fde;
+  };
+  std::vector<Range> ranges;
+  for (Dwarf_Signed i = 0; i < count; ++i) {
+    Dwarf_Addr lopc              = 0;
+    Dwarf_Unsigned len           = 0;
+    Dwarf_Ptr fde_bytes          = nullptr;
+    Dwarf_Unsigned fde_bytes_len = 0;
+    Dwarf_Off cie_offset         = 0;
+    Dwarf_Signed cie_index       = 0;
+    Dwarf_Off fde_offset         = 0;
+    Dwarf_Error err              = nullptr;
+    if (fdes[i] && dwarf_get_fde_range(fdes[i], &lopc, &len, &fde_bytes,
+                                       &fde_bytes_len, &cie_offset,
+                                       &cie_index, &fde_offset,
+                                       &err) == DW_DLV_OK &&
+        len > 0)
+      ranges.push_back({lopc, lopc + len, fdes[i]});
+  }
+  std::ranges::sort(ranges, {}, &Range::lo);
+
+  // Each FDE's rows, from its low PC to the next row's PC until the CFA
+  // program runs out; the end of an FDE is a NONE row unless the next one
+  // starts right there.
+  auto push = [&](uint64_t pc, const CfaRule& rule) {
+    if (!rows_.empty() && rows_.back().pc == pc) rows_.pop_back();
+    if (!rows_.empty() && same_rule(rows_.back().rule, rule)) return;
+    rows_.push_back({pc, rule});
+  };
+  for (const Range& r : ranges) {
+    // Overlapping FDEs are bad CFI: the first one wins.
+    const uint64_t lo = std::max(r.lo, rows_.empty() ? 0 : rows_.back().pc);
+    if (lo >= r.hi) continue;
+
+    Dwarf_Addr pc = lo;
+    while (pc < r.hi) {
+      Dwarf_Small value_type       = 0;
+      Dwarf_Signed offset_relevant = 0;
+      Dwarf_Signed regnum          = 0;
+      Dwarf_Signed offset_or_len   = 0;
+      Dwarf_Ptr block_ptr          = nullptr;
+      Dwarf_Addr row_pc            = 0;
+      Dwarf_Bool has_more_rows     = 0;
+      Dwarf_Addr next_pc           = 0;
+      Dwarf_Error err              = nullptr;
+      if (dwarf_get_fde_info_for_cfa_reg3_b(
+            r.fde, pc, &value_type, &offset_relevant, &regnum,
+            &offset_or_len, &block_ptr, &row_pc, &has_more_rows, &next_pc,
+            &err) != DW_DLV_OK) {
+        push(pc, {});
+        break;
+      }
+      push(pc, make_rule(value_type, regnum, offset_or_len, block_ptr));
+      if (!has_more_rows || next_pc <= pc) break;
+      pc = next_pc;
+    }
+    push(r.hi, {});
+  }
+  rows_.shrink_to_fit();
+#else
+  (void)count;
+#endif
+}
+
+CfaRule CfaTable::query(uint64_t pc) {
+  if (!rows_.empty()) {
+    auto it = std::ranges::upper_bound(rows_, pc, {}, &Row::pc);
+    return it == rows_.begin() ? CfaRule{} : std::prev(it)->rule;
+  }
+  if (!fdes_) return {};
+
+  Dwarf_Fde fde   = nullptr;
+  Dwarf_Addr lopc = 0, hipc = 0;
+  Dwarf_Error err = nullptr;
+  if (dwarf_get_fde_at_pc(fdes_, pc, &fde, &lopc, &hipc, &err) != DW_DLV_OK)
+    return {};
+
+  Dwarf_Small value_type       = 0;
+  Dwarf_Signed offset_relevant = 0;
+  Dwarf_Signed regnum          = 0;
+  Dwarf_Signed offset_or_len   = 0;
+  Dwarf_Ptr block_ptr          = nullptr;
+  Dwarf_Addr row_pc            = 0;
+  if (dwarf_get_fde_info_for_cfa_reg3(fde, pc, &value_type, &offset_relevant,
+                                      &regnum, &offset_or_len, &block_ptr,
+                                      &row_pc, &err) != DW_DLV_OK)
+    return {};
+  return make_rule(value_type, regnum, offset_or_len, block_ptr);
+}
+
+const CfaRule& CfaTable::at(uint64_t pc) {
+  if (auto it = memo_.find(pc); it != memo_.end()) return it->second;
+  const CfaRule rule = query(pc);
+  return memo_[pc] = rule;
+}
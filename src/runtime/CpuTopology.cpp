@@ -0,0 +1,171 @@
+#include "runtime/CpuTopology.hpp"
+
+#include <charconv>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+
+#include "common/Utils.hpp"
+
+namespace fs = std::filesystem;
+
+static std::optional<int> parse_int(std::string_view sv) {
+  sv             = trim(sv);
+  int v          = 0;
+  auto [ptr, ec] = std::from_chars(sv.data(), sv.data() + sv.size(), v);
+  if (ec != std::errc{} || ptr != sv.data() + sv.size()) return std::nullopt;
+  return v;
+}
+
+static std::optional<int> read_int(const fs::path& path) {
+  std::ifstream in(path);
+  std::string s;
+  if (!std::getline(in, s)) return std::nullopt;
+  return parse_int(s);
+}
+
+// Lowest CPU of a "0-3,8-11" list.
+static std::optional<int> first_cpu(const fs::path& path) {
+  std::ifstream in(path);
+  std::string s;
+  if (!std::getline(in, s)) return std::nullopt;
+  return parse_int(s.substr(0, s.find_first_of(",-")));
+}
+
+// "key=value" -> value; `eq` is the position of '='.
+static std::optional<int> value_of(const std::string& kv, size_t eq) {
+  if (eq == std::string::npos) return std::nullopt;
+  return parse_int(std::string_view(kv).substr(eq + 1));
+}
+
+static const std::array<const char*, CPU_DISTANCES> NAMES{
+  "same-cpu", "smt", "shared-cache", "cross-cache", "cross-node", "unknown"};
+
+const char* CpuTopology::name(CpuDistance d) {
+  return NAMES[static_cast<size_t>(d)];
+}
+
+CpuTopology CpuTopology::from_sysfs(const std::string& root) {
+  CpuTopology topo;
+  std::error_code ec;
+  for (const auto& entry : fs::directory_iterator(root, ec)) {
+    const auto dir = entry.path().filename().string();
+    if (!dir.starts_with("cpu")) continue;
+    const auto cpu_n = parse_int(std::string_view(dir).substr(3));
+    if (!cpu_n || *cpu_n < 0) continue;
+
+    Cpu cpu;
+    const auto topology = entry.path() / "topology";
+    const auto package  = read_int(topology / "physical_package_id");
+    const auto core     = read_int(topology / "core_id");
+    if (package) cpu.package = *package;
+    // core_id is only unique within its package.
+    if (core) cpu.core = (package.value_or(0) << 16) | *core;
+
+    // The last-level cache is the highest-level data or unified cache.
+    int level = 0;
+    const auto caches = entry.path() / "cache";
+    for (const auto& cache : fs::directory_iterator(caches, ec)) {
+      if (!cache.path().filename().string().starts_with("index")) continue;
+      std::ifstream type_in(cache.path() / "type");
+      std::string type;
+      std::getline(type_in, type);
+      const auto l = read_int(cache.path() / "level");
+      if (!l || type == "Instruction" || *l <= level) continue;
+      if (auto first = first_cpu(cache.path() / "shared_cpu_list")) {
+        level   = *l;
+        cpu.llc = *first;
+      }
+    }
+
+    for (const auto& sub : fs::directory_iterator(entry.path(), ec)) {
+      const auto name = sub.path().filename().string();
+      if (!name.starts_with("node")) continue;
+      if (auto node = parse_int(std::string_view(name).substr(4)))
+        cpu.node = *node;
+    }
+
+    const auto n = static_cast<size_t>(*cpu_n);
+    if (n >= topo.cpus_.size()) topo.cpus_.resize(n + 1);
+    topo.cpus_[n] = cpu;
+  }
+  return topo;
+}
+
+CpuTopology CpuTopology::from_file(const std::string& path) {
+  std::ifstream in(path);
+  if (!in) throw std::runtime_error(std::format("cannot open {}", path));
+
+  CpuTopology topo;
+  std::string line;
+  for (size_t lineno = 1; std::getline(in, line); ++lineno) {
+    auto bad = [&](std::string_view what) {
+      return std::runtime_error(
+        std::format("{}:{}: {}: '{}'", path, lineno, what, line));
+    };
+    line = line.substr(0, line.find('#'));
+    std::istringstream ls(line);
+    std::string kind;
+    if (!(ls >> kind)) continue;
+
+    if (kind == "cpu") {
+      std::string num;
+      ls >> num;
+      const auto n = parse_int(num);
+      if (!n || *n < 0) throw bad("bad cpu number");
+      Cpu cpu;
+      for (std::string kv; ls >> kv;) {
+        const auto eq = kv.find('=');
+        const auto v  = value_of(kv, eq);
+        if (!v) throw bad("expected key=value");
+        const auto key = kv.substr(0, eq);
+        if (key == "core")
+          cpu.core = *v;
+        else if (key == "package")
+          cpu.package = *v;
+        else if (key == "llc")
+          cpu.llc = *v;
+        else if (key == "node")
+          cpu.node = *v;
+        else
+          throw bad("unknown cpu field");
+      }
+      const auto idx = static_cast<size_t>(*n);
+      if (idx >= topo.cpus_.size()) topo.cpus_.resize(idx + 1);
+      topo.cpus_[idx] = cpu;
+    } else if (kind == "cost") {
+      for (std::string kv; ls >> kv;) {
+        const auto eq = kv.find('=');
+        const auto v  = value_of(kv, eq);
+        if (!v || *v < 0) throw bad("expected class=cycles");
+        size_t d = 0;
+        while (d < NAMES.size() && kv.substr(0, eq) != NAMES[d]) ++d;
+        if (d == NAMES.size()) throw bad("unknown distance class");
+        topo.costs_[d] = static_cast<uint32_t>(*v);
+      }
+    } else {
+      throw bad("expected 'cpu' or 'cost'");
+    }
+  }
+  return topo;
+}
+
+CpuDistance CpuTopology::distance(uint32_t a, uint32_t b) const {
+  if (a == b) return CpuDistance::SAME_CPU;
+  const Cpu* x = cpu(a);
+  const Cpu* y = cpu(b);
+  if (!x || !y) return CpuDistance::UNKNOWN;
+
+  auto same   = [](int p, int q) { return p >= 0 && p == q; };
+  auto differ = [](int p, int q) { return p >= 0 && q >= 0 && p != q; };
+  if (differ(x->package, y->package) || differ(x->node, y->node))
+    return CpuDistance::CROSS_NODE;
+  if (same(x->core, y->core)) return CpuDistance::SMT;
+  if (same(x->llc, y->llc)) return CpuDistance::SHARED_CACHE;
+  if (differ(x->llc, y->llc)) return CpuDistance::CROSS_CACHE;
+  return CpuDistance::UNKNOWN;
+}
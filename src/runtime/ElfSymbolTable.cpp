@@ -0,0 +1,190 @@
+#include "runtime/ElfSymbolTable.hpp"
+
+#include <cxxabi.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <format>
+#include <unordered_map>
+
+static std::string demangle(const char* name) {
+  int status = 0;
+  char* out  = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+  if (status != 0 || !out) return name;
+  std::string s{out};
+  std::free(out);
+  return s;
+}
+
+ElfSymbolTable::ElfSymbolTable(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return;
+
+  struct stat st{};
+  if (fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(Elf64_Ehdr)) {
+    close(fd);
+    return;
+  }
+
+  const size_t file_size = static_cast<size_t>(st.st_size);
+  void* map = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return;
+
+  const auto* base = static_cast<const uint8_t*>(map);
+  auto in_file     = [&](uint64_t off, uint64_t len) {
+    return off <= file_size && len <= file_size - off;
+  };
+
+  Elf64_Ehdr eh;
+  std::memcpy(&eh, base, sizeof(eh));
+  if (std::memcmp(eh.e_ident, ELFMAG, SELFMAG) != 0 ||
+      eh.e_ident[EI_CLASS] != ELFCLASS64) {
+    munmap(map, file_size);
+    return;
+  }
+
+  // PT_LOAD segments (file offset -> link-time vaddr)
+  if (eh.e_phentsize == sizeof(Elf64_Phdr) &&
+      in_file(eh.e_phoff, uint64_t{eh.e_phnum} * sizeof(Elf64_Phdr))) {
+    for (uint16_t i = 0; i < eh.e_phnum; ++i) {
+      Elf64_Phdr ph;
+      std::memcpy(&ph, base + eh.e_phoff + i * sizeof(ph), sizeof(ph));
+      if (ph.p_type != PT_LOAD) continue;
+      segments.push_back(Segment{ph.p_offset, ph.p_filesz, ph.p_vaddr});
+    }
+  }
+
+  if (eh.e_shentsize != sizeof(Elf64_Shdr) ||
+      !in_file(eh.e_shoff, uint64_t{eh.e_shnum} * sizeof(Elf64_Shdr))) {
+    munmap(map, file_size);
+    return;
+  }
+
+  auto section = [&](size_t i) {
+    Elf64_Shdr sh;
+    std::memcpy(&sh, base + eh.e_shoff + i * sizeof(sh), sizeof(sh));
+    return sh;
+  };
+
+  // Prefer the full .symtab; stripped binaries only have .dynsym.
+  for (uint32_t wanted : {SHT_SYMTAB, SHT_DYNSYM}) {
+    for (size_t i = 0; i < eh.e_shnum; ++i) {
+      const auto sh = section(i);
+      if (sh.sh_type != wanted || sh.sh_entsize != sizeof(Elf64_Sym)) continue;
+      if (sh.sh_link >= eh.e_shnum) continue;
+      const auto strtab = section(sh.sh_link);
+      if (!in_file(sh.sh_offset, sh.sh_size) ||
+          !in_file(strtab.sh_offset, strtab.sh_size))
+        continue;
+
+      std::unordered_map<std::string, uint32_t> name_ids;
+      const size_t count = sh.sh_size / sizeof(Elf64_Sym);
+      for (size_t k = 0; k < count; ++k) {
+        Elf64_Sym sym;
+        std::memcpy(&sym, base + sh.sh_offset + k * sizeof(sym), sizeof(sym));
+        const auto type = ELF64_ST_TYPE(sym.st_info);
+        if (type != STT_FUNC && type != STT_GNU_IFUNC) continue;
+        if (sym.st_shndx == SHN_UNDEF || sym.st_value == 0) continue;
+        if (sym.st_name >= strtab.sh_size) continue;
+
+        const char* raw = reinterpret_cast<const char*>(
+          base + strtab.sh_offset + sym.st_name);
+        const size_t max_len = strtab.sh_size - sym.st_name;
+        if (strnlen(raw, max_len) == max_len) continue;
+
+        auto [it, inserted] =
+          name_ids.try_emplace(raw, static_cast<uint32_t>(names.size()));
+        if (inserted) names.push_back(demangle(raw));
+        symbols.push_back(Symbol{sym.st_value, sym.st_size, it->second});
+      }
+    }
+    if (!symbols.empty()) break;
+  }
+
+  munmap(map, file_size);
+
+  // Aliases share an address; keep the one with a size.
+  std::ranges::sort(symbols, [](const Symbol& a, const Symbol& b) {
+    if (a.addr != b.addr) return a.addr < b.addr;
+    return a.size > b.size;
+  });
+  auto dup = std::ranges::unique(
+    symbols, [](const Symbol& a, const Symbol& b) { return a.addr == b.addr; });
+  symbols.erase(dup.begin(), dup.end());
+}
+
+bool ElfSymbolTable::file_offset_to_vaddr(uint64_t file_offset,
+                                          uint64_t& vaddr) const {
+  for (const auto& seg : segments) {
+    if (file_offset >= seg.offset && file_offset < seg.offset + seg.filesz) {
+      vaddr = file_offset - seg.offset + seg.vaddr;
+      return true;
+    }
+  }
+  return false;
+}
+
+const std::string* ElfSymbolTable::lookup_file_offset(
+  uint64_t file_offset) const {
+  uint64_t vaddr = 0;
+  if (!file_offset_to_vaddr(file_offset, vaddr)) return nullptr;
+
+  auto it = std::upper_bound(
+    symbols.begin(), symbols.end(), vaddr,
+    [](uint64_t v, const Symbol& s) { return v < s.addr; });
+  if (it == symbols.begin()) return nullptr;
+  --it;
+  if (vaddr >= it->addr + std::max<uint64_t>(it->size, 1)) return nullptr;
+  return &names[it->name];
+}
+
+std::string ElfSymbolTable::read_build_id(const std::string& path) {
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return {};
+  auto read_at = [&](void* out, size_t len, uint64_t off) {
+    return pread(fd, out, len, static_cast<off_t>(off)) ==
+           static_cast<ssize_t>(len);
+  };
+
+  std::string id;
+  Elf64_Ehdr eh;
+  if (read_at(&eh, sizeof(eh), 0) &&
+      std::memcmp(eh.e_ident, ELFMAG, SELFMAG) == 0 &&
+      eh.e_ident[EI_CLASS] == ELFCLASS64 &&
+      eh.e_phentsize == sizeof(Elf64_Phdr)) {
+    for (uint16_t i = 0; i < eh.e_phnum && id.empty(); ++i) {
+      Elf64_Phdr ph;
+      if (!read_at(&ph, sizeof(ph), eh.e_phoff + i * sizeof(ph))) break;
+      if (ph.p_type != PT_NOTE || ph.p_filesz > (1u << 16)) continue;
+
+      std::vector<uint8_t> notes(ph.p_filesz);
+      if (!read_at(notes.data(), notes.size(), ph.p_offset)) continue;
+      // Elf64_Nhdr, name and descriptor, each padded to 4 bytes.
+      auto pad = [](uint64_t n) { return (n + 3) & ~uint64_t{3}; };
+      for (size_t off = 0; off + sizeof(Elf64_Nhdr) <= notes.size();) {
+        Elf64_Nhdr nh;
+        std::memcpy(&nh, notes.data() + off, sizeof(nh));
+        const uint64_t name = off + sizeof(nh);
+        const uint64_t desc = name + pad(nh.n_namesz);
+        if (desc + nh.n_descsz > notes.size()) break;
+        if (nh.n_type == NT_GNU_BUILD_ID && nh.n_namesz == 4 &&
+            std::memcmp(notes.data() + name, "GNU", 4) == 0) {
+          for (uint32_t k = 0; k < nh.n_descsz; ++k)
+            id += std::format("{:02x}", notes[desc + k]);
+          break;
+        }
+        off = desc + pad(nh.n_descsz);
+      }
+    }
+  }
+  close(fd);
+  return id;
+}
@@ -2,253 +2,519 @@
 
 #include <algorithm>
 #include <array>
-#include <csignal>
+#include <bit>
+#include <cmath>
 #include <format>
 #include <iostream>
+#include <iterator>
 #include <ranges>
+#include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
-#include <unordered_set>
 
+#include "common/FlatMap.hpp"
 #include "common/Types.hpp"
+#include "common/Utils.hpp"
+#include "runtime/CpuTopology.hpp"
+#include "runtime/SampleStore.hpp"
 
 static constexpr double WRITE_READ_HOT_RATIO{5.0};
-static constexpr size_t MIN_HOT_SAMPLES{1000};
 static constexpr double MIN_BOUNCE_SCORE{0.10};
 static constexpr double MIN_PRIVATE_OFFSET_FRACTION{0.50};
 static constexpr size_t MIN_UNIQUE_TOP_OFFSETS{2};
+static constexpr double READ_MOSTLY_MAX_WRITE_FRACTION{0.10};
+static constexpr double Z_95{1.96};
+
+static const std::array<const char*, SHARING_CLASSES> CLASS_NAMES{
+  "False sharing", "True sharing", "Read-mostly", "Handoff", "Private"};
+static const std::array<const char*, SHARING_CLASSES> CLASS_HINTS{
+  "threads write different words of the line: pad or align each thread's "
+  "data to its own line (alignas(64)), or group fields by writer",
+  "threads contend for the same word: shard it per thread or CPU and "
+  "combine on read, or batch updates",
+  "a rarely written field shares the line with data others only read: move "
+  "the written field to its own line",
+  "one thread writes what a single other thread reads: batch the handoff, "
+  "and keep producer and consumer indices on separate lines",
+  "no cross-thread write traffic: no action needed"};
+
+// A line's sample count at a fixed period is Poisson: variance-stabilized
+// interval (sqrt(n) -+ z/2)^2.
+static Estimate count_interval(double n) {
+  const double r  = std::sqrt(n);
+  const double lo = std::max(0.0, r - Z_95 / 2);
+  return {n, lo * lo, (r + Z_95 / 2) * (r + Z_95 / 2)};
+}
+
+// Wilson score interval of the proportion k / n.
+static Estimate proportion_interval(double k, double n) {
+  if (n <= 0) return {};
+  const double p     = k / n;
+  const double z2    = Z_95 * Z_95;
+  const double scale = 1 + z2 / n;
+  const double mid   = (p + z2 / (2 * n)) / scale;
+  const double half =
+    Z_95 * std::sqrt(p * (1 - p) / n + z2 / (4 * n * n)) / scale;
+  return {p, std::max(0.0, mid - half), std::min(1.0, mid + half)};
+}
+
+// Shard of a cache line. Lines are mixed first so that strided layouts
+// (one hot line every N bytes) still spread across shards.
+static size_t shard_of(uint64_t addr, size_t shards) {
+  const uint64_t line = addr / FalseSharingAnalysis::CACHE_LINE_SIZE;
+  return static_cast<size_t>((line * 0x9e3779b97f4a7c15ULL) >> 32) % shards;
+}
 
 std::vector<CacheLine> FalseSharingAnalysis::find_hot_cache_lines(
-  const std::vector<PerfSample>& samples) {
-  std::unordered_map<uint64_t, CacheLine> cache_lines;
-
-  // Pass 1: aggregate per cache line (counts, tids, offsets)
-  for (const auto& s : samples) {
-    if (s.addr == 0) continue;
-
-    uint64_t base = (s.addr / CACHE_LINE_SIZE) * CACHE_LINE_SIZE;
-    auto& line    = cache_lines[base];
-
-    line.base_addr = base;
-    line.tids.push_back(s.tid);
-    line.addrs.push_back(s.addr);
-    line.sample_count++;
-
-    switch (s.event_type) {
-      case SampleType::CACHE_LOAD:
-        ++line.sample_reads;
-        break;
-      case SampleType::CACHE_STORE:
-        ++line.sample_writes;
-        break;
+  const SampleStore& samples, unsigned jobs, const CpuTopology* topology) {
+  const size_t n = samples.size();
+  if (jobs <= 1 || n < PARALLEL_MIN_SAMPLES || n > UINT32_MAX) {
+    CacheLineAccumulator acc(topology);
+    for (size_t i = 0; i < n; ++i) {
+      if (samples.addrs[i] == 0) continue;
+      acc.add(samples.addrs[i], samples.tids[i], samples.cpus[i],
+              samples.types[i]);
     }
+    return find_hot_cache_lines(acc);
   }
 
-  // Pass 2: compute time-ordered switching + per-thread offset overlap for
-  // candidate lines. This avoids inflated switching due to cross-CPU
-  // interleaving in perf script output.
-  struct Touch {
-    uint64_t t;
-    uint32_t tid;
-    uint8_t off;
+  // Pass 1: every worker splits a contiguous chunk of samples into one
+  // index list per shard. Pass 2: every worker owns a shard and replays its
+  // lists chunk by chunk, so each line still sees its samples in order and
+  // the bounce scores match the serial pass exactly.
+  const size_t shards = jobs;
+  const size_t chunk  = (n + jobs - 1) / jobs;
+  std::vector<std::vector<std::vector<uint32_t>>> parts(
+    jobs, std::vector<std::vector<uint32_t>>(shards));
+  std::vector<CacheLineAccumulator> accs(shards,
+                                         CacheLineAccumulator(topology));
+  std::vector<std::vector<CacheLine>> hot(shards);
+
+  auto run = [&](auto&& fn) {
+    std::vector<std::thread> workers;
+    workers.reserve(jobs);
+    for (unsigned w = 0; w < jobs; ++w) workers.emplace_back(fn, w);
+    for (auto& t : workers) t.join();
   };
-  std::unordered_map<uint64_t, std::vector<Touch>> seq;
-  seq.reserve(cache_lines.size());
 
-  for (auto& [base, line] : cache_lines) {
-    if (line.sample_count < MIN_HOT_SAMPLES) continue;
+  run([&](unsigned w) {
+    const size_t begin = std::min(n, w * chunk);
+    const size_t end   = std::min(n, begin + chunk);
+    auto& out          = parts[w];
+    for (auto& v : out) v.reserve((end - begin) / shards + 16);
+    for (size_t i = begin; i < end; ++i) {
+      const uint64_t addr = samples.addrs[i];
+      if (addr == 0) continue;
+      out[shard_of(addr, shards)].push_back(static_cast<uint32_t>(i));
+    }
+  });
+
+  run([&](unsigned shard) {
+    auto& acc = accs[shard];
+    for (auto& part : parts) {
+      for (const uint32_t i : part[shard])
+        acc.add(samples.addrs[i], samples.tids[i], samples.cpus[i],
+                samples.types[i]);
+      std::vector<uint32_t>().swap(part[shard]);
+    }
+    hot[shard] = acc.finish(MIN_HOT_SAMPLES);
+  });
 
-    std::sort(line.tids.begin(), line.tids.end());
-    auto tid_it = std::unique(line.tids.begin(), line.tids.end());
-    const auto unique_tid_count =
-      static_cast<size_t>(std::distance(line.tids.begin(), tid_it));
+  std::vector<CacheLine> result;
+  for (auto& h : hot) std::ranges::move(h, std::back_inserter(result));
+  classify_and_rank(
+    result, std::ranges::any_of(accs, &CacheLineAccumulator::saw_stores));
+  return result;
+}
 
-    std::vector<uint64_t> offsets;
-    offsets.reserve(line.addrs.size());
-    for (auto a : line.addrs) offsets.push_back(a - line.base_addr);
-    std::sort(offsets.begin(), offsets.end());
-    offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
-    const auto unique_offset_count = offsets.size();
+std::vector<CacheLine> FalseSharingAnalysis::find_hot_cache_lines(
+  const CacheLineAccumulator& acc, size_t min_samples) {
+  auto result = acc.finish(min_samples);
+  classify_and_rank(result, acc.saw_stores());
+  return result;
+}
 
-    if (unique_tid_count <= 1 || unique_offset_count <= 1) continue;
+std::vector<CacheLine> FalseSharingAnalysis::find_hot_cache_lines(
+  const CacheLineSketch& sketch, size_t min_samples) {
+  auto result = sketch.finish(min_samples);
+  classify_and_rank(result, sketch.saw_stores());
+  return result;
+}
 
-    seq[base].reserve(line.sample_count);
+void FalseSharingAnalysis::classify_and_rank(std::vector<CacheLine>& lines,
+                                             bool store_info) {
+  for (auto& line : lines) {
+    line.sharing = classify(line, store_info);
+    estimate(line);
   }
+  rank(lines);
+}
 
-  if (!seq.empty()) {
-    for (const auto& s : samples) {
-      if (s.addr == 0) continue;
-      uint64_t base = (s.addr / CACHE_LINE_SIZE) * CACHE_LINE_SIZE;
-      auto it       = seq.find(base);
-      if (it == seq.end()) continue;
-      const uint8_t off = static_cast<uint8_t>(s.addr - base);
-      it->second.push_back(Touch{s.time_stamp, s.tid, off});
-    }
+void FalseSharingAnalysis::estimate(CacheLine& line) {
+  const auto n    = static_cast<double>(line.sample_count);
+  line.samples_ci = count_interval(n);
+  line.bounce_ci  = proportion_interval(
+    static_cast<double>(line.thread_switches), std::max(0.0, n - 1));
+
+  // The cost scales with the number of sampled transitions.
+  size_t moves = 0;
+  for (const size_t t : line.transitions) moves += t;
+  const auto ci      = count_interval(static_cast<double>(moves));
+  const double scale = moves ? line.coherence_cycles / ci.value : 0.0;
+  line.cycles_ci     = {line.coherence_cycles, ci.low * scale,
+                        ci.high * scale};
+}
 
-    for (auto& [base, v] : seq) {
-      auto& line = cache_lines[base];
+SharingClass FalseSharingAnalysis::classify(const CacheLine& line,
+                                            bool store_info) {
+  if (line.thread_count <= 1) return SharingClass::PRIVATE;
+
+  const bool has_stores = line.sample_writes > 0;
+  // Read-only lines stay valid in every reader's cache.
+  if (store_info && !has_stores) return SharingClass::PRIVATE;
+  const double reads =
+    static_cast<double>(std::max<size_t>(1, line.sample_reads));
+  const bool write_heavy =
+    has_stores &&
+    static_cast<double>(line.sample_writes) / reads > WRITE_READ_HOT_RATIO;
+  // Threads that rarely take turns keep the line in their own cache.
+  if (line.bounce_score < MIN_BOUNCE_SCORE && !write_heavy)
+    return SharingClass::PRIVATE;
+
+  if (has_stores) {
+    const double write_fraction = static_cast<double>(line.sample_writes) /
+                                  static_cast<double>(line.sample_count);
+    if (write_fraction <= READ_MOSTLY_MAX_WRITE_FRACTION &&
+        (line.reader_mask & ~line.write_mask) != 0)
+      return SharingClass::READ_MOSTLY;
+    if (line.writer_count == 1 && line.thread_count == 2 &&
+        !line.thread_overflow && (line.reader_mask & line.write_mask) != 0)
+      return SharingClass::HANDOFF;
+  }
 
-      bool any_time = false;
-      for (const auto& e : v) {
-        if (e.t != 0) {
-          any_time = true;
-          break;
-        }
-      }
-      if (any_time) {
-        std::sort(v.begin(), v.end(),
-                  [](const auto& a, const auto& b) { return a.t < b.t; });
-      }
+  // True sharing: threads hammer the same word. False sharing: threads
+  // mostly touch different words of the same line.
+  if (line.total_offset_count > 1 &&
+      line.private_offset_fraction >= MIN_PRIVATE_OFFSET_FRACTION &&
+      line.unique_top_offsets >= MIN_UNIQUE_TOP_OFFSETS)
+    return SharingClass::FALSE_SHARING;
+  return SharingClass::TRUE_SHARING;
+}
 
-      // Switches
-      uint32_t last  = 0;
-      bool have_last = false;
-      for (const auto& e : v) {
-        if (have_last && e.tid != last) ++line.thread_switches;
-        last      = e.tid;
-        have_last = true;
-      }
-      if (v.size() > 1) {
-        line.bounce_score = static_cast<double>(line.thread_switches) /
-                            static_cast<double>(v.size() - 1);
-      }
+const char* FalseSharingAnalysis::name(SharingClass c) {
+  return CLASS_NAMES[static_cast<size_t>(c)];
+}
 
-      // Per-thread offset histograms (0..63)
-      std::unordered_map<uint32_t, std::array<uint32_t, CACHE_LINE_SIZE>>
-        counts;
-      counts.reserve(8);
-      for (const auto& e : v) {
-        counts[e.tid][e.off]++;
-      }
+const char* FalseSharingAnalysis::hint(SharingClass c) {
+  return CLASS_HINTS[static_cast<size_t>(c)];
+}
 
-      // shared offsets: touched by >=2 tids
-      std::array<uint16_t, CACHE_LINE_SIZE> touched_by{};
-      for (const auto& [tid, arr] : counts) {
-        (void)tid;
-        for (size_t i = 0; i < CACHE_LINE_SIZE; ++i) {
-          if (arr[i] != 0) touched_by[i]++;
-        }
-      }
+// Within a class, by the lower confidence bounds: a line with few samples
+// needs a clearly higher estimate to outrank a well-sampled one.
+void FalseSharingAnalysis::rank(std::vector<CacheLine>& lines) {
+  std::ranges::sort(lines, [](const auto& a, const auto& b) {
+    if (a.sharing != b.sharing) return a.sharing < b.sharing;
+    if (a.cycles_ci.low != b.cycles_ci.low)
+      return a.cycles_ci.low > b.cycles_ci.low;
+    const double as = a.bounce_ci.low * a.private_offset_fraction;
+    const double bs = b.bounce_ci.low * b.private_offset_fraction;
+    if (as != bs) return as > bs;
+    if (a.sample_count != b.sample_count)
+      return a.sample_count > b.sample_count;
+    return a.base_addr < b.base_addr;
+  });
+}
 
-      size_t total_off  = 0;
-      size_t shared_off = 0;
-      for (size_t i = 0; i < CACHE_LINE_SIZE; ++i) {
-        if (touched_by[i] > 0) {
-          ++total_off;
-          if (touched_by[i] >= 2) ++shared_off;
-        }
-      }
-      line.total_offset_count  = total_off;
-      line.shared_offset_count = shared_off;
-      line.private_offset_fraction =
-        (total_off == 0) ? 0.0
-                         : static_cast<double>(total_off - shared_off) /
-                             static_cast<double>(total_off);
-
-      // unique top offsets per thread
-      std::unordered_set<uint8_t> tops;
-      for (const auto& [tid, arr] : counts) {
-        (void)tid;
-        uint32_t best  = 0;
-        uint8_t best_i = 0;
-        for (uint8_t i = 0; i < CACHE_LINE_SIZE; ++i) {
-          if (arr[i] > best) {
-            best   = arr[i];
-            best_i = i;
-          }
-        }
-        if (best != 0) tops.insert(best_i);
-      }
-      line.unique_top_offsets = tops.size();
-    }
+std::vector<CacheLinePair> FalseSharingAnalysis::find_hot_pairs(
+  const SampleStore& samples, std::vector<CacheLine>& hot_lines,
+  bool hot_only) {
+  FlatMap<uint64_t, bool> hot_pairs;
+  if (hot_only) {
+    for (const auto& line : hot_lines)
+      hot_pairs.emplace(line.base_addr / PAIR_SIZE * PAIR_SIZE, true);
   }
 
-  std::vector<CacheLine> result;
-  result.reserve(cache_lines.size());
-
-  // Filter: hot + multi-thread + multi-offset + interleaving + low offset
-  // overlap
-  for (auto& [_, line] : cache_lines) {
-    if (line.sample_count < MIN_HOT_SAMPLES) continue;
-
-    std::vector<uint32_t> unique_tids = line.tids;
-    std::sort(unique_tids.begin(), unique_tids.end());
-    unique_tids.erase(std::unique(unique_tids.begin(), unique_tids.end()),
-                      unique_tids.end());
-
-    std::vector<uint64_t> offsets;
-    offsets.reserve(line.addrs.size());
-    for (auto a : line.addrs) offsets.push_back(a - line.base_addr);
-    std::sort(offsets.begin(), offsets.end());
-    offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
-
-    if (unique_tids.size() <= 1 || offsets.size() <= 1) continue;
-
-    // Heuristic to separate "true sharing" (threads hammer same word/offset)
-    // from "false sharing" (threads mostly touch different words in same line).
-    if (line.private_offset_fraction < MIN_PRIVATE_OFFSET_FRACTION ||
-        line.unique_top_offsets < MIN_UNIQUE_TOP_OFFSETS) {
+  CacheLinePairAccumulator acc;
+  for (size_t i = 0; i < samples.size(); ++i) {
+    const uint64_t addr = samples.addrs[i];
+    if (addr == 0) continue;
+    if (hot_only && !hot_pairs.contains(addr / PAIR_SIZE * PAIR_SIZE))
       continue;
-    }
+    acc.add(addr, samples.tids[i], samples.types[i]);
+  }
 
-    // If we have store info (Intel PEBS), keep the original strong signal.
-    if (line.sample_writes > 0) {
-      const double reads =
-        static_cast<double>(std::max<size_t>(1, line.sample_reads));
-      const double ratio = static_cast<double>(line.sample_writes) / reads;
-      if (ratio > WRITE_READ_HOT_RATIO ||
-          line.bounce_score >= MIN_BOUNCE_SCORE) {
-        result.push_back(std::move(line));
-      }
-    } else {
-      // For event sources without reliable load/store split (e.g., AMD IBS):
-      if (line.bounce_score >= MIN_BOUNCE_SCORE) {
-        result.push_back(std::move(line));
-      }
+  for (auto& line : hot_lines) {
+    const auto pair = acc.find(line.base_addr / PAIR_SIZE * PAIR_SIZE);
+    if (!pair) continue;
+    const size_t other = line.base_addr % PAIR_SIZE == 0 ? 1 : 0;
+    for (const uint32_t tid : pair->half_tids[other]) {
+      if (std::ranges::find(line.tids, tid) == line.tids.end())
+        line.adjacent_tids.push_back(tid);
     }
   }
 
+  std::vector<CacheLinePair> result;
+  for (auto& pair : acc.finish(MIN_HOT_SAMPLES)) {
+    if (pair.half_samples[0] == 0 || pair.half_samples[1] == 0) continue;
+    if (!pair.split_writers || pair.cross_bounce < MIN_BOUNCE_SCORE) continue;
+    result.push_back(std::move(pair));
+  }
   std::ranges::sort(result, [](const auto& a, const auto& b) {
-    const double as = a.bounce_score * a.private_offset_fraction;
-    const double bs = b.bounce_score * b.private_offset_fraction;
-    if (as != bs) return as > bs;
-    return a.sample_count > b.sample_count;
+    if (a.cross_bounce != b.cross_bounce)
+      return a.cross_bounce > b.cross_bounce;
+    if (a.sample_count != b.sample_count)
+      return a.sample_count > b.sample_count;
+    return a.base_addr < b.base_addr;
   });
   return result;
 }
 
+void FalseSharingAnalysis::assign_modules(std::vector<CacheLine>& hot_lines,
+                                          const SampleStore& samples) {
+  FlatMap<uint64_t, size_t> index;
+  index.reserve(hot_lines.size());
+  for (size_t i = 0; i < hot_lines.size(); ++i)
+    index.emplace(hot_lines[i].base_addr, i);
+
+  // Per line: a file-backed data mapping if any sample saw one, and how
+  // often each code dso touched it.
+  std::vector<const Mapping*> data_owner(hot_lines.size(), nullptr);
+  std::vector<FlatMap<uint32_t, size_t>> code_owners(
+    hot_lines.size());
+
+  for (size_t i = 0; i < samples.size(); ++i) {
+    const uint64_t addr = samples.addrs[i];
+    if (addr == 0) continue;
+    auto it = index.find((addr / CACHE_LINE_SIZE) * CACHE_LINE_SIZE);
+    if (it == index.end()) continue;
+
+    if (!data_owner[it->second]) {
+      const Mapping* m = samples.addr_mapping(i);
+      if (m && m->file_backed()) data_owner[it->second] = m;
+    }
+    ++code_owners[it->second][samples.dso_ids[i]];
+  }
+
+  for (size_t i = 0; i < hot_lines.size(); ++i) {
+    if (data_owner[i]) {
+      hot_lines[i].module = data_owner[i]->path;
+      continue;
+    }
+    uint32_t best_dso = 0;
+    size_t best       = 0;
+    for (const auto& [dso, n] : code_owners[i]) {
+      if (n > best || (n == best && dso < best_dso)) {
+        best     = n;
+        best_dso = dso;
+      }
+    }
+    hot_lines[i].module = samples.dsos.get(best_dso);
+  }
+}
+
 void FalseSharingAnalysis::print(const std::vector<CacheLine>& hot_lines,
-                                 size_t max_lines) {
-  std::cout << "\n=== False Sharing Analysis ===\n\n";
+                                 uint64_t sample_period, size_t max_lines) {
+  std::cout << "\n=== Cache Line Sharing Analysis ===\n\n";
+  std::cout << std::format(
+    "Estimates are samples x sample period ({}), with 95% confidence "
+    "intervals; lines rank by the lower bound\n\n",
+    sample_period);
+
+  for (size_t c = 0; c < SHARING_CLASSES; ++c) {
+    const auto sharing = static_cast<SharingClass>(c);
+    // Lines come grouped by class; rank is the position within the class.
+    const auto first =
+      std::ranges::find(hot_lines, sharing, &CacheLine::sharing);
+    const auto last = std::find_if(first, hot_lines.end(), [&](const auto& l) {
+      return l.sharing != sharing;
+    });
+    const auto count = static_cast<size_t>(last - first);
+    std::cout << std::format("--- {}: {} line{} ---\n", name(sharing), count,
+                             count == 1 ? "" : "s");
+    if (count == 0) {
+      std::cout << "\n";
+      continue;
+    }
+    std::cout << std::format("Hint: {}\n\n", hint(sharing));
+
+    // Group the top lines by module, keeping their rank within each group.
+    const size_t shown = std::min(count, max_lines);
+    std::vector<std::string_view> modules;
+    std::unordered_map<std::string_view, std::vector<size_t>> by_module;
+    for (size_t i = 0; i < shown; ++i) {
+      auto& group = by_module[first[i].module];
+      if (group.empty()) modules.push_back(first[i].module);
+      group.push_back(i);
+    }
 
-  for (size_t i = 0; i < std::min(hot_lines.size(), max_lines); ++i) {
-    const auto& line = hot_lines[i];
+    for (const auto module : modules) {
+      const auto& group = by_module[module];
+      std::cout << std::format("Module: {} ({} hot line{})\n\n",
+                               module.empty() ? "[unknown]" : module,
+                               group.size(), group.size() == 1 ? "" : "s");
+      for (const size_t i : group)
+        print_line(first[i], i + 1, sample_period);
+    }
+  }
+}
 
-    std::vector<uint32_t> unique_tids = line.tids;
-    std::sort(unique_tids.begin(), unique_tids.end());
-    unique_tids.erase(std::unique(unique_tids.begin(), unique_tids.end()),
-                      unique_tids.end());
-    if (unique_tids.size() <= 1) continue;
+void FalseSharingAnalysis::print_line(const CacheLine& line, size_t rank,
+                                      uint64_t sample_period) {
+  if (line.offset_mask == 0) return;
+  const auto period = static_cast<double>(sample_period);
+  auto events       = [&](double samples) {
+    return format_count(samples * period);
+  };
+
+  const uint64_t min_addr =
+    line.base_addr + static_cast<uint64_t>(std::countr_zero(line.offset_mask));
+  const uint64_t max_addr =
+    line.base_addr + 63 -
+    static_cast<uint64_t>(std::countl_zero(line.offset_mask));
+
+  std::cout << std::format(
+    "Cache Line #{}: 0x{:x}\n"
+    "  Samples: {} (reads={}, writes={})\n"
+    "  Estimated accesses: ~{} (95% CI {} - {}; reads ~{}, writes ~{})\n"
+    "  Threads: {}{}\n"
+    "  Distinct offsets: {} (shared={}, private_frac={:.2f}, "
+    "top_offsets={})\n"
+    "  Thread switches: {} (bounce={:.3f}, 95% CI {:.3f} - {:.3f})\n"
+    "  Address range: 0x{:x} - 0x{:x} ({} bytes)\n",
+    rank, line.base_addr, line.sample_count, line.sample_reads,
+    line.sample_writes, events(line.samples_ci.value),
+    events(line.samples_ci.low), events(line.samples_ci.high),
+    events(static_cast<double>(line.sample_reads)),
+    events(static_cast<double>(line.sample_writes)), line.thread_count,
+    line.thread_overflow ? "+" : "", line.total_offset_count,
+    line.shared_offset_count, line.private_offset_fraction,
+    line.unique_top_offsets, line.thread_switches, line.bounce_score,
+    line.bounce_ci.low, line.bounce_ci.high, min_addr, max_addr,
+    max_addr - min_addr);
+  if (line.sample_writes > 0) {
+    std::cout << std::format(
+      "  Writers: {} of {} threads (write_frac={:.2f}), written offsets: {}, "
+      "reader-only offsets: {}\n",
+      line.writer_count, line.thread_count,
+      static_cast<double>(line.sample_writes) /
+        static_cast<double>(line.sample_count),
+      std::popcount(line.write_mask),
+      std::popcount(line.reader_mask & ~line.write_mask));
+  }
 
-    std::vector<uint64_t> offsets;
-    offsets.reserve(line.addrs.size());
-    for (auto a : line.addrs) offsets.push_back(a - line.base_addr);
-    std::sort(offsets.begin(), offsets.end());
-    offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+  std::string moves;
+  for (size_t d = 0; d < CPU_DISTANCES; ++d) {
+    if (line.transitions[d] == 0) continue;
+    moves += std::format("{}{}=~{}", moves.empty() ? "" : ", ",
+                         CpuTopology::name(static_cast<CpuDistance>(d)),
+                         events(static_cast<double>(line.transitions[d])));
+  }
+  std::cout << std::format(
+    "  Coherence cost: ~{} cycles (95% CI {} - {}; {})\n",
+    events(line.cycles_ci.value), events(line.cycles_ci.low),
+    events(line.cycles_ci.high),
+    moves.empty() ? "no CPU transitions" : "moves: " + moves);
+
+  if (!line.adjacent_tids.empty()) {
+    const uint64_t adjacent = line.base_addr ^ CACHE_LINE_SIZE;
+    std::cout << std::format(
+      "  Adjacent line 0x{:x} is written by {} other thread{}: padding to "
+      "64 bytes still bounces the 128-byte pair, align to 128\n",
+      adjacent, line.adjacent_tids.size(),
+      line.adjacent_tids.size() == 1 ? "" : "s");
+  }
+  std::cout << "\n";
+}
 
-    auto [min_addr, max_addr] = std::ranges::minmax(line.addrs);
+void FalseSharingAnalysis::print_approximation(
+  const CacheLineSketch& sketch, const std::vector<CacheLine>& approx,
+  uint64_t stride, const std::vector<CacheLine>* exact) {
+  std::cout << "=== Approximate Aggregation ===\n\n";
+  const uint64_t error = sketch.max_count_error();
+  std::cout << std::format(
+    "Sketch: {} of {} lines tracked, {:.1f} MB, {} samples\n"
+    "  Lines with more than {} samples are always tracked; sample counts "
+    "only cover the time since a line was last tracked (at most {} samples "
+    "missing)\n"
+    "  Thread counts: +/-{:.0f}% (HyperLogLog, {} registers); shared "
+    "offsets, top offsets and writers from {} sampled touches per line\n",
+    sketch.size(), sketch.capacity(),
+    static_cast<double>(sketch.memory_bytes()) / (1024.0 * 1024.0),
+    sketch.samples(), error, error,
+    100.0 * CacheLineSketch::thread_count_error(),
+    CacheLineSketch::HLL_REGISTERS, CacheLineSketch::RESERVOIR_SIZE);
+  std::cout << std::format(
+    "  Adjacent-line pairs and thread transfers cover only the hot lines "
+    "above; they, phases and stack, global and heap attribution see {}\n\n",
+    stride == 1
+      ? std::string("every sample")
+      : std::format("1 in {} samples (store thinned to fit)", stride));
+  if (!exact) return;
+
+  FlatMap<uint64_t, size_t> index;
+  for (size_t i = 0; i < approx.size(); ++i)
+    index.emplace(approx[i].base_addr, i);
+  std::vector<const CacheLine*> missed;
+  size_t reclassified = 0;
+  for (const auto& line : *exact) {
+    auto it = index.find(line.base_addr);
+    if (it == index.end())
+      missed.push_back(&line);
+    else if (approx[it->second].sharing != line.sharing)
+      ++reclassified;
+  }
+  std::ranges::sort(missed, [](const auto* a, const auto* b) {
+    return a->sample_count > b->sample_count;
+  });
+
+  std::cout << std::format(
+    "Validation against the exact pass: {} hot lines, {} missed, {} in a "
+    "different class, {} reported only by the sketch\n",
+    exact->size(), missed.size(), reclassified,
+    approx.size() + missed.size() - exact->size());
+  for (size_t i = 0; i < std::min<size_t>(missed.size(), 10); ++i) {
+    std::cout << std::format("  missed 0x{:x}: {} samples, {}\n",
+                             missed[i]->base_addr, missed[i]->sample_count,
+                             name(missed[i]->sharing));
+  }
+  std::cout << "\n";
+}
+
+void FalseSharingAnalysis::print_pairs(const std::vector<CacheLinePair>& pairs,
+                                       const std::vector<CacheLine>& hot_lines,
+                                       size_t max_pairs) {
+  std::cout << "=== Adjacent-Line (128-byte pair) False Sharing ===\n\n";
+  if (pairs.empty()) {
+    std::cout << "No 128-byte pairs with different writers per half.\n\n";
+    return;
+  }
+
+  auto tid_list = [](const std::vector<uint32_t>& tids) {
+    std::string out;
+    for (const uint32_t tid : tids)
+      out += std::format("{}{}", out.empty() ? "" : " ", tid);
+    return out;
+  };
 
+  for (size_t i = 0; i < std::min(pairs.size(), max_pairs); ++i) {
+    const auto& p = pairs[i];
+    const bool reported = std::ranges::any_of(hot_lines, [&](const auto& l) {
+      return l.base_addr / PAIR_SIZE * PAIR_SIZE == p.base_addr;
+    });
     std::cout << std::format(
-      "Cache Line #{}: 0x{:x}\n"
-      "  Samples: {} (reads={}, writes={})\n"
-      "  Threads: {}\n"
-      "  Distinct offsets: {} (shared={}, private_frac={:.2f}, "
-      "top_offsets={})\n"
-      "  Thread switches: {} (bounce={:.3f})\n"
-      "  Address range: 0x{:x} - 0x{:x} ({} bytes)\n\n",
-      i + 1, line.base_addr, line.sample_count, line.sample_reads,
-      line.sample_writes, unique_tids.size(), offsets.size(),
-      line.shared_offset_count, line.private_offset_fraction,
-      line.unique_top_offsets, line.thread_switches, line.bounce_score,
-      min_addr, max_addr, max_addr - min_addr);
+      "Pair #{}: 0x{:x} - 0x{:x}\n"
+      "  Samples: {} (low half={}, writes={}; high half={}, writes={})\n"
+      "  Threads: low [{}], high [{}]\n"
+      "  Thread switches: {} (bounce={:.3f}), across halves: {} "
+      "(bounce={:.3f})\n"
+      "  {}\n\n",
+      i + 1, p.base_addr, p.base_addr + PAIR_SIZE - 1, p.sample_count,
+      p.half_samples[0], p.half_writes[0], p.half_samples[1],
+      p.half_writes[1], tid_list(p.half_tids[0]), tid_list(p.half_tids[1]),
+      p.thread_switches, p.bounce_score, p.cross_switches, p.cross_bounce,
+      reported ? "A line of this pair is also reported above"
+               : "Each 64-byte line has its own writer: 64-byte padding is "
+                 "not enough, align to 128");
   }
 }
@@ -0,0 +1,129 @@
+#include "runtime/ModuleSet.hpp"
+
+#include <algorithm>
+
+Module::Module(std::string path, std::string build_id, std::string file)
+    : path_(std::move(path)),
+      build_id_(std::move(build_id)),
+      file_(file.empty() ? path_ : std::move(file)) {}
+
+void Module::load(std::unique_ptr<Extractor> dwarf) {
+  if (loaded()) return;
+  loaded_ = true;
+  dwarf_  = std::move(dwarf);
+  if (!dwarf_) {
+    try {
+      dwarf_ = std::make_unique<Extractor>(file_);
+      dwarf_->create_registry();
+    } catch (...) {
+      dwarf_.reset();
+    }
+  }
+  load_frames();
+}
+
+void Module::load_frames() {
+  if (elf_) return;
+  elf_ = std::make_unique<ElfSymbolTable>(file_);
+
+  try {
+    frame_ctx_ = std::make_unique<DwarfContext>(file_);
+  } catch (...) {
+    return;
+  }
+
+  Dwarf_Error err = nullptr;
+  if (dwarf_get_fde_list_eh(frame_ctx_->dbg(), &cie_data_, &cie_count_,
+                            &fde_data_, &fde_count_, &err) != DW_DLV_OK &&
+      dwarf_get_fde_list(frame_ctx_->dbg(), &cie_data_, &cie_count_,
+                         &fde_data_, &fde_count_, &err) != DW_DLV_OK) {
+    fde_data_  = nullptr;
+    fde_count_ = 0;
+    return;
+  }
+  cfa_ = CfaTable(fde_data_, fde_count_);
+}
+
+Module::~Module() {
+  if (frame_ctx_ && fde_data_) {
+    dwarf_fde_cie_list_dealloc(frame_ctx_->dbg(), cie_data_, cie_count_,
+                               fde_data_, fde_count_);
+  }
+}
+
+std::optional<uint64_t> Module::min_fde_pc() const {
+  std::optional<uint64_t> lowest;
+  for (Dwarf_Signed i = 0; i < fde_count_; ++i) {
+    Dwarf_Addr lopc              = 0;
+    Dwarf_Unsigned len           = 0;
+    Dwarf_Ptr fde_bytes          = nullptr;
+    Dwarf_Unsigned fde_bytes_len = 0;
+    Dwarf_Off cie_offset         = 0;
+    Dwarf_Signed cie_index       = 0;
+    Dwarf_Off fde_offset         = 0;
+    Dwarf_Error e                = nullptr;
+
+    if (!fde_data_[i] ||
+        dwarf_get_fde_range(fde_data_[i], &lopc, &len, &fde_bytes,
+                            &fde_bytes_len, &cie_offset, &cie_index,
+                            &fde_offset, &e) != DW_DLV_OK)
+      continue;
+    lowest = std::min<uint64_t>(lowest.value_or(lopc), lopc);
+  }
+  return lowest;
+}
+
+std::optional<uint64_t> Module::link_address(const Mapping& m,
+                                             uint64_t addr) const {
+  uint64_t vaddr = 0;
+  if (!elf_ || !elf_->file_offset_to_vaddr(m.file_offset(addr), vaddr))
+    return std::nullopt;
+  return vaddr;
+}
+
+Module& ModuleSet::add(std::unique_ptr<Module> module) {
+  Module& m = *modules_.emplace_back(std::move(module));
+  by_path_.emplace(m.path(), &m);
+  if (!m.build_id().empty()) by_build_id_.emplace(m.build_id(), &m);
+  return m;
+}
+
+Module* ModuleSet::for_mapping(uint32_t id) {
+  if (id == AddressSpace::NONE) return nullptr;
+  if (id >= by_mapping_.size()) {
+    by_mapping_.resize(space_.size() + 1, nullptr);
+    looked_up_.resize(space_.size() + 1, false);
+  }
+  if (looked_up_[id]) return by_mapping_[id];
+  looked_up_[id] = true;
+
+  by_mapping_[id] = for_file(space_.get(id));
+  return by_mapping_[id];
+}
+
+Module* ModuleSet::for_file(const Mapping& m) {
+  if (!m.file_backed()) return nullptr;
+
+  // The same file can be mapped under several paths (symlinks, bind mounts)
+  // and the same path can be replaced on disk; the build-id tells them apart.
+  Module* mod = nullptr;
+  if (!m.build_id.empty()) {
+    if (auto it = by_build_id_.find(m.build_id); it != by_build_id_.end())
+      mod = it->second;
+  }
+  if (!mod) {
+    auto it = by_path_.find(m.path);
+    if (it != by_path_.end()) {
+      const auto& known = it->second->build_id();
+      if (m.build_id.empty() || known.empty() || known == m.build_id)
+        mod = it->second;
+    }
+  }
+  if (!mod) mod = &add(std::make_unique<Module>(m.path, m.build_id));
+  return mod;
+}
+
+Module* ModuleSet::find(const std::string& path) const {
+  auto it = by_path_.find(path);
+  return it == by_path_.end() ? nullptr : it->second;
+}
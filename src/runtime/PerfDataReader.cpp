@@ -0,0 +1,231 @@
+#include "runtime/PerfDataReader.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+// On-disk layout from tools/perf/util/header.h
+struct PerfFileSection {
+  uint64_t offset;
+  uint64_t size;
+};
+
+struct PerfFileHeader {
+  uint64_t magic;
+  uint64_t size;
+  uint64_t attr_size;
+  PerfFileSection attrs;
+  PerfFileSection data;
+  PerfFileSection event_types;
+  uint64_t adds_features[4];
+};
+
+static constexpr uint64_t PERF_MAGIC2 = 0x32454c4946524550ULL;  // "PERFILE2"
+
+// Feature bits (enum perf_header_feature)
+static constexpr int HEADER_EVENT_DESC = 12;
+static constexpr int HEADER_DIR_FORMAT = 24;
+static constexpr int HEADER_COMPRESSED = 27;
+
+// User record types synthesized by perf (enum perf_user_event_type)
+static constexpr uint32_t PERF_RECORD_USER_TYPE_START = 64;
+static constexpr uint32_t PERF_RECORD_FINISHED_ROUND  = 68;
+
+static bool has_feature(const PerfFileHeader& h, int bit) {
+  return (h.adds_features[bit / 64] >> (bit % 64)) & 1;
+}
+
+PerfDataReader::PerfDataReader(const std::string& path) {
+  fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd_ < 0) throw std::runtime_error("Failed to open " + path);
+
+  struct stat st{};
+  if (fstat(fd_, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd_);
+    throw std::runtime_error(path + " is not a regular perf.data file");
+  }
+
+  size_ = static_cast<size_t>(st.st_size);
+  if (size_ < sizeof(PerfFileHeader)) {
+    close(fd_);
+    throw std::runtime_error(path + " is too small to be a perf.data file");
+  }
+
+  void* map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+  if (map == MAP_FAILED) {
+    close(fd_);
+    throw std::runtime_error("Failed to mmap " + path);
+  }
+  data_ = static_cast<const uint8_t*>(map);
+  madvise(map, size_, MADV_SEQUENTIAL);
+
+  try {
+    PerfFileHeader h;
+    std::memcpy(&h, data_, sizeof(h));
+    if (h.magic != PERF_MAGIC2)
+      throw std::runtime_error(path +
+                               ": not a native-endian perf.data (PERFILE2)");
+    if (h.size != sizeof(PerfFileHeader))
+      throw std::runtime_error(path + ": pipe-mode perf.data is not supported");
+    if (has_feature(h, HEADER_COMPRESSED) || has_feature(h, HEADER_DIR_FORMAT))
+      throw std::runtime_error(
+        path + ": compressed/directory perf.data is not supported");
+    if (h.data.offset > size_ || h.data.size > size_ - h.data.offset)
+      throw std::runtime_error(path + ": truncated data section");
+
+    data_offset_ = h.data.offset;
+    data_size_   = h.data.size;
+
+    read_attrs();
+  } catch (...) {
+    munmap(const_cast<uint8_t*>(data_), size_);
+    close(fd_);
+    throw;
+  }
+}
+
+PerfDataReader::~PerfDataReader() {
+  if (data_) munmap(const_cast<uint8_t*>(data_), size_);
+  if (fd_ >= 0) close(fd_);
+}
+
+// HEADER_EVENT_DESC lists the events in the same order as the attrs section:
+//   u32 nr, u32 attr_size, { attr, u32 nr_ids, str name, u64 ids[nr_ids] }[nr]
+// where str is { u32 len; char buf[len]; } (len includes NUL padding).
+static std::vector<std::string> event_desc_names(const uint8_t* base,
+                                                 size_t size,
+                                                 const PerfFileHeader& h) {
+  std::vector<std::string> names;
+  if (!has_feature(h, HEADER_EVENT_DESC)) return names;
+
+  // Feature sections follow the data section, one per set bit, in bit order.
+  uint64_t sec_off = h.data.offset + h.data.size;
+  for (int bit = 0; bit < HEADER_EVENT_DESC; ++bit)
+    if (has_feature(h, bit)) sec_off += sizeof(PerfFileSection);
+  if (sec_off + sizeof(PerfFileSection) > size) return names;
+
+  PerfFileSection sec;
+  std::memcpy(&sec, base + sec_off, sizeof(sec));
+  if (sec.offset > size || sec.size > size - sec.offset) return names;
+
+  const uint8_t* p   = base + sec.offset;
+  const uint8_t* end = p + sec.size;
+  auto u32           = [&](uint32_t& v) {
+    if (end - p < 4) return false;
+    std::memcpy(&v, p, 4);
+    p += 4;
+    return true;
+  };
+
+  uint32_t nr = 0, attr_size = 0;
+  if (!u32(nr) || !u32(attr_size)) return names;
+  for (uint32_t i = 0; i < nr; ++i) {
+    uint32_t nr_ids = 0, len = 0;
+    if (static_cast<size_t>(end - p) < attr_size) break;
+    p += attr_size;
+    if (!u32(nr_ids) || !u32(len) || static_cast<size_t>(end - p) < len) break;
+    names.emplace_back(reinterpret_cast<const char*>(p),
+                       strnlen(reinterpret_cast<const char*>(p), len));
+    p += len;
+    if (static_cast<uint64_t>(end - p) < uint64_t{nr_ids} * 8) break;
+    p += uint64_t{nr_ids} * 8;
+  }
+  return names;
+}
+
+void PerfDataReader::read_attrs() {
+  PerfFileHeader h;
+  std::memcpy(&h, data_, sizeof(h));
+
+  if (h.attr_size <= sizeof(PerfFileSection) || h.attrs.offset > size_ ||
+      h.attrs.size > size_ - h.attrs.offset)
+    throw std::runtime_error("perf.data: bad attrs section");
+
+  const auto names     = event_desc_names(data_, size_, h);
+  const size_t n       = h.attrs.size / h.attr_size;
+  const size_t on_disk = h.attr_size - sizeof(PerfFileSection);
+
+  for (size_t i = 0; i < n; ++i) {
+    const uint8_t* entry = data_ + h.attrs.offset + i * h.attr_size;
+
+    perf_event_attr attr{};
+    std::memcpy(&attr, entry, std::min(on_disk, sizeof(attr)));
+
+    PerfFileSection ids_sec;
+    std::memcpy(&ids_sec, entry + on_disk, sizeof(ids_sec));
+
+    std::vector<uint64_t> ids;
+    if (ids_sec.offset <= size_ && ids_sec.size <= size_ - ids_sec.offset) {
+      ids.resize(ids_sec.size / sizeof(uint64_t));
+      std::memcpy(ids.data(), data_ + ids_sec.offset,
+                  ids.size() * sizeof(uint64_t));
+    }
+
+    decoder_.add_event(attr, ids, i < names.size() ? names[i] : std::string{});
+  }
+
+  if (n == 0) throw std::runtime_error("perf.data: no events recorded");
+}
+
+void PerfDataReader::for_each_sample(const SampleConsumer& fn) {
+  // Records from different CPUs are only ordered between rounds: everything
+  // older than the newest timestamp seen before the previous round marker can
+  // be decoded. Side-band records go through the same queue so a sample is
+  // never symbolized before the MMAP2 that precedes it in time.
+  struct Pending {
+    uint64_t time;
+    uint64_t offset;
+  };
+  std::vector<Pending> pending;
+  uint64_t max_seen   = 0;
+  uint64_t prev_round = 0;
+
+  PerfSample s;
+  auto flush = [&](uint64_t limit) {
+    std::ranges::stable_sort(pending, {}, &Pending::time);
+    auto cut = std::ranges::partition_point(
+      pending, [&](const Pending& p) { return p.time <= limit; });
+    for (auto it = pending.begin(); it != cut; ++it) {
+      // Records are 8-byte aligned within the file, so headers can be handed
+      // to the decoder in place.
+      const auto* rec =
+        reinterpret_cast<const perf_event_header*>(data_ + it->offset);
+      if (decoder_.decode(rec, s)) fn(s);
+    }
+    pending.erase(pending.begin(), cut);
+  };
+
+  uint64_t off       = data_offset_;
+  const uint64_t end = data_offset_ + data_size_;
+  while (off + sizeof(perf_event_header) <= end) {
+    perf_event_header hdr;
+    std::memcpy(&hdr, data_ + off, sizeof(hdr));
+    if (hdr.size < sizeof(hdr) || off + hdr.size > end) break;
+
+    if (hdr.type == PERF_RECORD_FINISHED_ROUND) {
+      flush(prev_round);
+      prev_round = max_seen;
+    } else if (hdr.type < PERF_RECORD_USER_TYPE_START) {
+      const auto* rec = reinterpret_cast<const perf_event_header*>(data_ + off);
+      const uint64_t t = decoder_.timestamp(rec);
+      max_seen         = std::max(max_seen, t);
+      pending.push_back(Pending{t, off});
+    }
+
+    off += hdr.size;
+  }
+
+  flush(std::numeric_limits<uint64_t>::max());
+}
+
+std::vector<PerfSample> PerfDataReader::read_samples() {
+  std::vector<PerfSample> samples;
+  for_each_sample([&](const PerfSample& s) { samples.push_back(s); });
+  return samples;
+}
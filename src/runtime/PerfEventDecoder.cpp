@@ -0,0 +1,326 @@
+#include "runtime/PerfEventDecoder.hpp"
+
+#include <asm/perf_regs.h>
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+// Bounds-checked reader over the body of one perf_event record.
+struct RecordCursor {
+  const uint8_t* p;
+  const uint8_t* end;
+  bool ok = true;
+
+  uint64_t u64() {
+    if (end - p < 8) return fail();
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    p += sizeof(v);
+    return v;
+  }
+
+  uint32_t u32() {
+    if (end - p < 4) return static_cast<uint32_t>(fail());
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    p += sizeof(v);
+    return v;
+  }
+
+  void skip(uint64_t n) {
+    if (static_cast<uint64_t>(end - p) < n) {
+      fail();
+      return;
+    }
+    p += n;
+  }
+
+  uint64_t fail() {
+    ok = false;
+    p  = end;
+    return 0;
+  }
+};
+
+static RecordCursor cursor_for(const perf_event_header* hdr) {
+  const auto* body = reinterpret_cast<const uint8_t*>(hdr + 1);
+  const auto* end  = reinterpret_cast<const uint8_t*>(hdr) + hdr->size;
+  if (end < body) end = body;
+  return RecordCursor{body, end};
+}
+
+static void skip_read_format(RecordCursor& c, uint64_t read_format) {
+  const uint64_t per_value = 1 + ((read_format & PERF_FORMAT_ID) ? 1 : 0) +
+                             ((read_format & PERF_FORMAT_LOST) ? 1 : 0);
+  uint64_t nr = 1;
+  if (read_format & PERF_FORMAT_GROUP) nr = c.u64();
+  if (read_format & PERF_FORMAT_TOTAL_TIME_ENABLED) c.u64();
+  if (read_format & PERF_FORMAT_TOTAL_TIME_RUNNING) c.u64();
+  if (nr > (1u << 16)) {
+    c.fail();
+    return;
+  }
+  c.skip(nr * per_value * sizeof(uint64_t));
+}
+
+static std::string to_hex(const uint8_t* p, size_t n) {
+  static constexpr char digits[] = "0123456789abcdef";
+  std::string out(n * 2, '0');
+  for (size_t i = 0; i < n; ++i) {
+    out[2 * i]     = digits[p[i] >> 4];
+    out[2 * i + 1] = digits[p[i] & 0xf];
+  }
+  return out;
+}
+
+// Reads a NUL-terminated string that is padded to the end of the record.
+static std::string record_string(const RecordCursor& c) {
+  return std::string(reinterpret_cast<const char*>(c.p),
+                     strnlen(reinterpret_cast<const char*>(c.p),
+                             static_cast<size_t>(c.end - c.p)));
+}
+
+void PerfEventDecoder::add_event(const perf_event_attr& attr,
+                                 const std::vector<uint64_t>& ids,
+                                 const std::string& name) {
+  Event ev;
+  ev.attr = attr;
+  ev.name = name;
+  // Same rule as the `perf script` text path.
+  ev.type = name.find("store") != std::string::npos ? SampleType::CACHE_STORE
+                                                     : SampleType::CACHE_LOAD;
+  for (auto id : ids) id_to_event[id] = events.size();
+  events.push_back(std::move(ev));
+}
+
+const PerfEventDecoder::Event* PerfEventDecoder::event_for(
+  const perf_event_header* hdr) const {
+  if (events.empty()) return nullptr;
+  if (events.size() == 1) return &events[0];
+
+  // perf requires all events in a session to share sample_type when several
+  // are recorded, so the id position can be derived from the first one.
+  const uint64_t st = events[0].attr.sample_type;
+  auto c            = cursor_for(hdr);
+  uint64_t id       = 0;
+  if (hdr->type != PERF_RECORD_SAMPLE) {
+    // Side-band records carry the identifier last in their sample_id trailer.
+    if (!(st & PERF_SAMPLE_IDENTIFIER) || c.end - c.p < 8)
+      return &events[0];
+    c.p = c.end - sizeof(uint64_t);
+    id  = c.u64();
+  } else if (st & PERF_SAMPLE_IDENTIFIER) {
+    id = c.u64();
+  } else if (st & PERF_SAMPLE_ID) {
+    const uint64_t before = PERF_SAMPLE_IP | PERF_SAMPLE_TID |
+                            PERF_SAMPLE_TIME | PERF_SAMPLE_ADDR;
+    c.skip(std::popcount(st & before) * sizeof(uint64_t));
+    id = c.u64();
+  } else {
+    return &events[0];
+  }
+
+  auto it = id_to_event.find(id);
+  if (!c.ok || it == id_to_event.end()) return &events[0];
+  return &events[it->second];
+}
+
+uint64_t PerfEventDecoder::timestamp(const perf_event_header* hdr) const {
+  const Event* ev = event_for(hdr);
+  if (!ev) return 0;
+
+  const uint64_t st = ev->attr.sample_type;
+  if (!(st & PERF_SAMPLE_TIME)) return 0;
+
+  auto c = cursor_for(hdr);
+  if (hdr->type == PERF_RECORD_SAMPLE) {
+    const uint64_t before =
+      PERF_SAMPLE_IDENTIFIER | PERF_SAMPLE_IP | PERF_SAMPLE_TID;
+    c.skip(std::popcount(st & before) * sizeof(uint64_t));
+    return c.u64();
+  }
+
+  if (!ev->attr.sample_id_all) return 0;
+
+  // sample_id trailer: { pid, tid } { time } { id } { stream_id } { cpu, res }
+  // { identifier }, each present per sample_type and 8 bytes wide.
+  const uint64_t trailer = PERF_SAMPLE_TID | PERF_SAMPLE_TIME | PERF_SAMPLE_ID |
+                           PERF_SAMPLE_STREAM_ID | PERF_SAMPLE_CPU |
+                           PERF_SAMPLE_IDENTIFIER;
+  const uint64_t len = std::popcount(st & trailer) * sizeof(uint64_t);
+  if (static_cast<uint64_t>(c.end - c.p) < len) return 0;
+  c.p = c.end - len;
+  if (st & PERF_SAMPLE_TID) c.u64();
+  return c.u64();
+}
+
+bool PerfEventDecoder::decode(const perf_event_header* hdr, PerfSample& out) {
+  auto c = cursor_for(hdr);
+
+  switch (hdr->type) {
+    case PERF_RECORD_SAMPLE:
+      return decode_sample(hdr, out);
+
+    case PERF_RECORD_MMAP: {
+      const uint32_t pid = c.u32();
+      c.u32();  // tid
+      const uint64_t start = c.u64();
+      const uint64_t len   = c.u64();
+      const uint64_t pgoff = c.u64();
+      if (!c.ok) return false;
+      space.map(pid, start, len, pgoff, record_string(c));
+      return false;
+    }
+
+    case PERF_RECORD_MMAP2: {
+      const uint32_t pid = c.u32();
+      c.u32();  // tid
+      const uint64_t start = c.u64();
+      const uint64_t len   = c.u64();
+      const uint64_t pgoff = c.u64();
+      std::string build_id;
+      if (hdr->misc & PERF_RECORD_MISC_MMAP_BUILD_ID) {
+        // { u8 size, u8, u16, u8 build_id[20] } instead of maj/min/ino/gen
+        const auto* id = c.p;
+        c.skip(24);
+        if (c.ok) build_id = to_hex(id + 4, std::min<size_t>(id[0], 20));
+      } else {
+        c.skip(24);
+      }
+      c.u32();  // prot
+      c.u32();  // flags
+      if (!c.ok) return false;
+      space.map(pid, start, len, pgoff, record_string(c), std::move(build_id));
+      return false;
+    }
+
+    case PERF_RECORD_COMM: {
+      const uint32_t pid = c.u32();
+      const uint32_t tid = c.u32();
+      if (!c.ok) return false;
+      comms[tid] = record_string(c);
+      // exec() replaces the whole address space.
+      if ((hdr->misc & PERF_RECORD_MISC_COMM_EXEC) && pid == tid)
+        space.clear(pid);
+      return false;
+    }
+
+    case PERF_RECORD_FORK: {
+      const uint32_t pid  = c.u32();
+      const uint32_t ppid = c.u32();
+      if (!c.ok || pid == ppid) return false;  // new thread, shared maps
+      space.fork(ppid, pid);
+      return false;
+    }
+
+    default:
+      return false;
+  }
+}
+
+bool PerfEventDecoder::decode_sample(const perf_event_header* hdr,
+                                     PerfSample& out) {
+  const Event* ev = event_for(hdr);
+  if (!ev) return false;
+
+  const auto& attr  = ev->attr;
+  const uint64_t st = attr.sample_type;
+  auto c            = cursor_for(hdr);
+
+  out            = PerfSample{};
+  out.event_type = ev->type;
+
+  if (st & PERF_SAMPLE_IDENTIFIER) c.u64();
+  if (st & PERF_SAMPLE_IP) out.ip = c.u64();
+  if (st & PERF_SAMPLE_TID) {
+    out.pid = c.u32();
+    out.tid = c.u32();
+  }
+  if (st & PERF_SAMPLE_TIME) out.time_stamp = c.u64();
+  if (st & PERF_SAMPLE_ADDR) out.addr = c.u64();
+  if (st & PERF_SAMPLE_ID) c.u64();
+  if (st & PERF_SAMPLE_STREAM_ID) c.u64();
+  if (st & PERF_SAMPLE_CPU) {
+    out.cpu = c.u32();
+    c.u32();  // reserved
+  }
+  if (st & PERF_SAMPLE_PERIOD) c.u64();
+  if (st & PERF_SAMPLE_READ) skip_read_format(c, attr.read_format);
+  if (st & PERF_SAMPLE_CALLCHAIN) {
+    const uint64_t nr = c.u64();
+    if (nr > (1u << 16)) return false;
+    c.skip(nr * sizeof(uint64_t));
+  }
+  if (st & PERF_SAMPLE_RAW) c.skip(c.u32());
+  if (st & PERF_SAMPLE_BRANCH_STACK) {
+    const uint64_t nr = c.u64();
+    if (nr > (1u << 16)) return false;
+    if (attr.branch_sample_type & PERF_SAMPLE_BRANCH_HW_INDEX) c.u64();
+    c.skip(nr * 3 * sizeof(uint64_t));  // from, to, flags
+  }
+  if (st & PERF_SAMPLE_REGS_USER) {
+    const uint64_t abi = c.u64();
+    if (abi != PERF_SAMPLE_REGS_ABI_NONE) {
+      for (uint64_t mask = attr.sample_regs_user; mask; mask &= mask - 1) {
+        const int reg    = std::countr_zero(mask);
+        const uint64_t v = c.u64();
+        if (reg >= PERF_REG_X86_64_MAX || PERF_TO_DWARF_REG[reg] < 0)
+          continue;
+        out.regs[PERF_TO_DWARF_REG[reg]] = v;
+        out.regs_mask |= 1u << PERF_TO_DWARF_REG[reg];
+      }
+      out.sp = out.regs[DWARF_RSP];
+      out.bp = out.regs[DWARF_RBP];
+    }
+  }
+  // Later fields (stack, weight, data_src, ...) are not used.
+
+  if (!c.ok) return false;
+
+  symbolize(out);
+  return true;
+}
+
+const ElfSymbolTable* PerfEventDecoder::symbols_for(const std::string& path) {
+  // Pseudo paths such as [vdso], [heap] or //anon have no file to read.
+  if (path.empty() || path.front() == '[' || path.starts_with("//"))
+    return nullptr;
+
+  auto it = elf_cache.find(path);
+  if (it == elf_cache.end())
+    it = elf_cache.emplace(path, std::make_unique<ElfSymbolTable>(path)).first;
+  return it->second->empty() ? nullptr : it->second.get();
+}
+
+void PerfEventDecoder::symbolize(PerfSample& s) {
+  s.ip_map   = space.resolve(s.pid, s.ip);
+  s.addr_map = space.resolve(s.pid, s.addr);
+
+  if (s.ip_map == AddressSpace::NONE) {
+    if (space.resolve(AddressSpace::KERNEL_PID, s.ip) != AddressSpace::NONE) {
+      s.dso    = "[kernel.kallsyms]";
+      s.symbol = "[unknown]";
+    } else {
+      s.dso    = "[unknown]";
+      s.symbol = "[unknown]";
+    }
+    return;
+  }
+
+  const Mapping& m = space.get(s.ip_map);
+  s.ip_mapping     = &m;
+  s.dso            = m.path;
+  if (const auto* syms = symbols_for(m.path)) {
+    if (const auto* name = syms->lookup_file_offset(m.file_offset(s.ip))) {
+      s.symbol = *name;
+      return;
+    }
+  }
+  s.symbol = "[unknown]";
+}
+
+const std::string* PerfEventDecoder::comm(uint32_t tid) const {
+  auto it = comms.find(tid);
+  return it == comms.end() ? nullptr : &it->second;
+}
@@ -0,0 +1,716 @@
+#include "runtime/PerfRecorder.hpp"
+
+#include <asm/perf_regs.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_set>
+
+#include "common/Utils.hpp"
+#include "runtime/ProcMaps.hpp"
+
+namespace fs = std::filesystem;
+
+// Data pages per CPU ring buffer (powers of two): RING_PAGES when the
+// locked-memory budget allows, never fewer than MIN_RING_PAGES.
+static constexpr size_t RING_PAGES     = 256;
+static constexpr size_t MIN_RING_PAGES = 8;
+
+static const fs::path PMU_ROOT = "/sys/bus/event_source/devices";
+
+static std::string read_sysfs(const fs::path& path) {
+  std::ifstream in(path);
+  std::string s;
+  std::getline(in, s);
+  return std::string(trim(s));
+}
+
+static std::optional<uint64_t> parse_number(std::string_view sv) {
+  sv = trim(sv);
+  if (sv.starts_with("0x") || sv.starts_with("0X")) return parse_hex_u64(sv);
+  uint64_t v     = 0;
+  auto [ptr, ec] = std::from_chars(sv.data(), sv.data() + sv.size(), v);
+  if (ec != std::errc{} || ptr != sv.data() + sv.size()) return std::nullopt;
+  return v;
+}
+
+// Calls fn(lo, hi) for each entry of a sysfs range list like "0-3,8,10-11".
+template <typename F>
+static void for_each_range(std::string_view list, F&& fn) {
+  for (auto part : std::views::split(list, ',')) {
+    auto r    = trim(std::string_view(part.begin(), part.end()));
+    auto dash = r.find('-');
+    auto lo   = parse_number(r.substr(0, dash));
+    auto hi   = dash == std::string_view::npos
+                  ? lo
+                  : parse_number(r.substr(dash + 1));
+    if (lo && hi && *lo <= *hi) fn(*lo, *hi);
+  }
+}
+
+static std::vector<int> parse_cpu_list(std::string_view list) {
+  std::vector<int> cpus;
+  for_each_range(list, [&](uint64_t lo, uint64_t hi) {
+    for (uint64_t c = lo; c <= hi; ++c) cpus.push_back(static_cast<int>(c));
+  });
+  return cpus;
+}
+
+static std::vector<int> pmu_cpus(const std::string& pmu) {
+  // Hybrid PMUs (cpu_core/cpu_atom) only count on their own CPUs.
+  if (!pmu.empty()) {
+    auto own = read_sysfs(PMU_ROOT / pmu / "cpus");
+    if (!own.empty()) return parse_cpu_list(own);
+  }
+  return parse_cpu_list(read_sysfs("/sys/devices/system/cpu/online"));
+}
+
+// Sets `term` = `value` using the PMU's format description, e.g.
+// format/umask = "config:8-15" or format/ldlat = "config1:0-15".
+static void apply_format_term(const std::string& pmu, const std::string& term,
+                              uint64_t value, perf_event_attr& attr) {
+  if (term == "period") {
+    attr.sample_period = value;
+    return;
+  }
+
+  const auto spec  = read_sysfs(PMU_ROOT / pmu / "format" / term);
+  const auto colon = spec.find(':');
+  if (spec.empty() || colon == std::string::npos)
+    throw std::runtime_error(
+      std::format("perf event: unknown term '{}' for PMU '{}'", term, pmu));
+
+  const auto field = std::string_view(spec).substr(0, colon);
+  __u64* config    = nullptr;
+  if (field == "config") {
+    config = &attr.config;
+  } else if (field == "config1") {
+    config = &attr.config1;
+  } else if (field == "config2") {
+    config = &attr.config2;
+  } else {
+    throw std::runtime_error(
+      std::format("perf event: unsupported format field '{}'", spec));
+  }
+
+  // Bits are filled low to high across the listed ranges.
+  for_each_range(std::string_view(spec).substr(colon + 1),
+                 [&](uint64_t lo, uint64_t hi) {
+                   for (uint64_t bit = lo; bit <= std::min<uint64_t>(hi, 63);
+                        ++bit, value >>= 1) {
+                     if (value & 1) *config |= __u64{1} << bit;
+                   }
+                 });
+}
+
+// Applies a perf term list such as "mem-loads,ldlat=30" or
+// "event=0xcd,umask=0x1". Bare names are event aliases from events/<name>.
+static void apply_terms(const std::string& pmu, std::string_view terms,
+                        perf_event_attr& attr, int depth = 0) {
+  for (auto part : std::views::split(terms, ',')) {
+    std::string_view t(part.begin(), part.end());
+    t = trim(t);
+    if (t.empty()) continue;
+
+    const auto eq = t.find('=');
+    const std::string key(t.substr(0, eq));
+    if (eq != std::string_view::npos) {
+      auto v = parse_number(t.substr(eq + 1));
+      if (!v)
+        throw std::runtime_error(std::format("perf event: bad term '{}'", t));
+      apply_format_term(pmu, key, *v, attr);
+      continue;
+    }
+
+    if (fs::exists(PMU_ROOT / pmu / "format" / key)) {
+      apply_format_term(pmu, key, 1, attr);
+      continue;
+    }
+
+    const auto alias = read_sysfs(PMU_ROOT / pmu / "events" / key);
+    if (alias.empty() || depth > 0)
+      throw std::runtime_error(
+        std::format("perf event: PMU '{}' has no event '{}'", pmu, key));
+    apply_terms(pmu, alias, attr, depth + 1);
+  }
+}
+
+static void apply_modifiers(std::string_view mods, perf_event_attr& attr) {
+  for (char c : mods) {
+    switch (c) {
+      case 'p':
+        attr.precise_ip = std::min(attr.precise_ip + 1, 3);
+        break;
+      case 'P':
+        attr.precise_ip = 3;  // lowered until the PMU accepts it
+        break;
+      case 'u':
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        break;
+      case 'k':
+        attr.exclude_user = 1;
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+static PerfRecorder::EventSpec resolve_event(std::string_view spec) {
+  PerfRecorder::EventSpec ev;
+  ev.name = std::string(spec);
+
+  std::string pmu;
+  auto& attr = ev.attr;
+
+  const auto slash = spec.find('/');
+  if (slash != std::string_view::npos) {
+    // pmu/terms/modifiers
+    const auto last = spec.rfind('/');
+    pmu             = std::string(spec.substr(0, slash));
+    const auto type = parse_number(read_sysfs(PMU_ROOT / pmu / "type"));
+    if (!type)
+      throw std::runtime_error(std::format("perf event: no PMU '{}'", pmu));
+    attr.type = static_cast<uint32_t>(*type);
+    if (last > slash)
+      apply_terms(pmu, spec.substr(slash + 1, last - slash - 1), attr);
+    apply_modifiers(spec.substr(last + 1), attr);
+  } else {
+    // name[:modifiers]
+    const auto colon = spec.find(':');
+    const auto name  = spec.substr(0, colon);
+    if (colon != std::string_view::npos)
+      apply_modifiers(spec.substr(colon + 1), attr);
+
+    if (name == "cpu-cycles" || name == "cycles") {
+      attr.type   = PERF_TYPE_HARDWARE;
+      attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    } else if (name == "instructions") {
+      attr.type   = PERF_TYPE_HARDWARE;
+      attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    } else if (name == "cpu-clock") {
+      attr.type   = PERF_TYPE_SOFTWARE;
+      attr.config = PERF_COUNT_SW_CPU_CLOCK;
+    } else {
+      for (const char* core : {"cpu", "cpu_core"}) {
+        if (fs::exists(PMU_ROOT / core / "events" / std::string(name))) {
+          pmu = core;
+          break;
+        }
+      }
+      if (pmu.empty())
+        throw std::runtime_error(
+          std::format("perf event: unknown event '{}'", name));
+      attr.type = static_cast<uint32_t>(
+        parse_number(read_sysfs(PMU_ROOT / pmu / "type")).value_or(0));
+      apply_terms(pmu, name, attr);
+    }
+  }
+
+  ev.cpus = pmu_cpus(pmu);
+  if (ev.cpus.empty())
+    throw std::runtime_error("perf event: cannot read the online CPU list");
+  return ev;
+}
+
+// Splits "a:pp,cpu/x=1,y=2/,b" on the commas outside of pmu/.../ terms.
+static std::vector<std::string_view> split_event_list(std::string_view list) {
+  std::vector<std::string_view> out;
+  size_t start  = 0;
+  bool in_terms = false;
+  for (size_t i = 0; i <= list.size(); ++i) {
+    if (i < list.size() && list[i] == '/') in_terms = !in_terms;
+    if (i == list.size() || (list[i] == ',' && !in_terms)) {
+      auto e = trim(list.substr(start, i - start));
+      if (!e.empty()) out.push_back(e);
+      start = i + 1;
+    }
+  }
+  return out;
+}
+
+static int perf_event_open(perf_event_attr& attr, pid_t pid, int cpu,
+                           int group_fd, unsigned long flags) {
+  return static_cast<int>(
+    syscall(SYS_perf_event_open, &attr, pid, cpu, group_fd, flags));
+}
+
+// Most data pages a ring (plus its header page) can have within
+// perf_event_mlock_kb, the per-CPU budget for unprivileged users: 128 with
+// the default 516 KiB. Root is not held to it.
+static size_t default_ring_pages(size_t page) {
+  if (geteuid() == 0) return RING_PAGES;
+  std::ifstream in("/proc/sys/kernel/perf_event_mlock_kb");
+  size_t kb = 0;
+  if (!(in >> kb) || kb * 1024 / page < 2) return MIN_RING_PAGES;
+  return std::clamp(std::bit_floor(kb * 1024 / page - 1), MIN_RING_PAGES,
+                    RING_PAGES);
+}
+
+// Attaching opens one fd per thread, CPU and event, far past the usual soft
+// limit of 1024. Raises the soft limit to the hard one, as perf does; false
+// when it already was. Leaves errno alone.
+static bool raise_fd_limit() {
+  const int saved = errno;
+  rlimit l{};
+  bool raised = false;
+  if (getrlimit(RLIMIT_NOFILE, &l) == 0 && l.rlim_cur < l.rlim_max) {
+    l.rlim_cur = l.rlim_max;
+    raised     = setrlimit(RLIMIT_NOFILE, &l) == 0;
+  }
+  errno = saved;
+  return raised;
+}
+
+PerfRecorder::PerfRecorder(const std::string& events, uint64_t period,
+                           unsigned reader_threads)
+    : reader_threads_(reader_threads),
+      ring_pages_(
+        default_ring_pages(static_cast<size_t>(sysconf(_SC_PAGESIZE)))) {
+  for (auto spec : split_event_list(events)) {
+    auto ev = resolve_event(spec);
+    auto& a = ev.attr;
+    a.size  = sizeof(perf_event_attr);
+    if (a.sample_period == 0) a.sample_period = period;
+    // Same fields `perf record -d --sample-cpu --user-regs=<gprs>` asks for.
+    a.sample_type = PERF_SAMPLE_IDENTIFIER | PERF_SAMPLE_IP | PERF_SAMPLE_TID |
+                    PERF_SAMPLE_TIME | PERF_SAMPLE_ADDR | PERF_SAMPLE_CPU |
+                    PERF_SAMPLE_PERIOD | PERF_SAMPLE_REGS_USER;
+    a.sample_regs_user = USER_GPR_MASK;
+    a.disabled       = 1;
+    a.enable_on_exec = 1;
+    a.inherit        = 1;
+    a.sample_id_all  = 1;
+    events_.push_back(std::move(ev));
+  }
+  if (events_.empty())
+    throw std::runtime_error("perf event: no events given");
+
+  // Side-band records (mmaps, comm, fork) are only needed once.
+  auto& first     = events_.front().attr;
+  first.mmap      = 1;
+  first.mmap2     = 1;
+  first.mmap_data = 1;
+  first.comm      = 1;
+  first.comm_exec = 1;
+  first.task      = 1;
+  first.watermark = 1;
+  first.wakeup_watermark =
+    static_cast<uint32_t>(ring_pages_ * sysconf(_SC_PAGESIZE) / 4);
+}
+
+PerfRecorder::~PerfRecorder() {
+  if (child_ > 0) {
+    kill(child_, SIGKILL);
+    waitpid(child_, nullptr, 0);
+  }
+  if (go_fd_ >= 0) close(go_fd_);
+  close_all();
+}
+
+void PerfRecorder::close_all() {
+  for (auto& rb : rings_) {
+    if (rb.base) munmap(rb.base, rb.map_size);
+  }
+  rings_.clear();
+  for (int fd : fds_) close(fd);
+  fds_.clear();
+}
+
+void PerfRecorder::open_counters(const std::vector<pid_t>& tids) {
+  const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+  for (auto& ev : events_) {
+    std::vector<uint64_t> ids;
+    for (pid_t tid : tids) {
+      for (int cpu : ev.cpus) {
+        perf_event_attr attr = ev.attr;
+        int fd               = -1;
+        for (;;) {
+          fd = perf_event_open(attr, tid, cpu, -1, PERF_FLAG_FD_CLOEXEC);
+          if (fd >= 0) break;
+          // Retry with what this PMU / paranoia level allows, as perf does.
+          if ((errno == EOPNOTSUPP || errno == EINVAL) &&
+              attr.precise_ip > 0) {
+            --attr.precise_ip;
+          } else if ((errno == EACCES || errno == EPERM) &&
+                     !attr.exclude_kernel) {
+            attr.exclude_kernel = 1;
+            attr.exclude_hv     = 1;
+          } else if (errno != EMFILE || !raise_fd_limit()) {
+            break;
+          }
+        }
+        if (fd < 0) {
+          // Threads that exited meanwhile and offline or foreign (hybrid)
+          // CPUs are skipped; nothing opened at all is reported below.
+          if (errno == ESRCH || errno == ENODEV || errno == ENOENT) continue;
+          if (errno == EMFILE)
+            throw std::runtime_error(std::format(
+              "perf_event_open({}): out of file descriptors after {} ({} "
+              "threads x {} CPUs per event); raise the hard limit "
+              "(ulimit -Hn)",
+              ev.name, fds_.size(), tids.size(), ev.cpus.size()));
+          throw std::runtime_error(std::format(
+            "perf_event_open({}, cpu {}): {}", ev.name, cpu, strerror(errno)));
+        }
+        ev.attr.precise_ip     = attr.precise_ip;
+        ev.attr.exclude_kernel = attr.exclude_kernel;
+        ev.attr.exclude_hv     = attr.exclude_hv;
+        fds_.push_back(fd);
+
+        uint64_t id = 0;
+        if (ioctl(fd, PERF_EVENT_IOC_ID, &id) == 0) ids.push_back(id);
+
+        // One ring buffer per CPU; later events on the CPU write into it.
+        auto ring = std::ranges::find(rings_, cpu, &RingBuffer::cpu);
+        if (ring != rings_.end()) {
+          if (ioctl(fd, PERF_EVENT_IOC_SET_OUTPUT, ring->fd) != 0)
+            throw std::runtime_error(std::format(
+              "perf_event_open({}): cannot share the cpu {} buffer: {}",
+              ev.name, cpu, strerror(errno)));
+          continue;
+        }
+
+        RingBuffer rb;
+        rb.cpu     = cpu;
+        rb.fd      = fd;
+        void* base = MAP_FAILED;
+        for (;;) {
+          rb.map_size = (ring_pages_ + 1) * page;
+          base        = mmap(nullptr, rb.map_size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED, fd, 0);
+          if (base != MAP_FAILED || errno != EPERM ||
+              ring_pages_ <= MIN_RING_PAGES)
+            break;
+          // Over the locked-memory budget, which other perf sessions share:
+          // halve this and later rings, as perf does.
+          ring_pages_ /= 2;
+        }
+        if (base == MAP_FAILED)
+          throw std::runtime_error(std::format(
+            "perf ring buffer mmap (cpu {}, {} pages): {}{}", cpu,
+            ring_pages_, strerror(errno),
+            errno == EPERM ? "; raise /proc/sys/kernel/perf_event_mlock_kb"
+                           : ""));
+        rb.base = static_cast<uint8_t*>(base);
+        rings_.push_back(rb);
+      }
+    }
+    if (ids.empty())
+      throw std::runtime_error(
+        std::format("perf_event_open({}): no CPU accepted the event", ev.name));
+    decoder_.add_event(ev.attr, ids, ev.name);
+  }
+}
+
+void PerfRecorder::use_clock(clockid_t clock) {
+  for (auto& ev : events_) {
+    ev.attr.use_clockid = 1;
+    ev.attr.clockid     = clock;
+  }
+}
+
+void PerfRecorder::launch(const std::string& binary,
+                          const std::vector<std::string>& env) {
+  // Built before the fork: the child only execs. `env` overrides the
+  // inherited variables and no name is passed twice: with two LD_PRELOAD
+  // entries ld.so would use the last one.
+  std::vector<std::string> vars;
+  std::unordered_set<std::string> names;
+  auto add = [&](std::string_view v) {
+    if (names.emplace(v.substr(0, v.find('='))).second) vars.emplace_back(v);
+  };
+  for (const auto& v : env) add(v);
+  for (char** e = environ; *e; ++e) add(*e);
+  std::vector<char*> envp;
+  for (auto& v : vars) envp.push_back(v.data());
+  envp.push_back(nullptr);
+  char* const argv[] = {const_cast<char*>(binary.c_str()), nullptr};
+
+  int go[2];
+  if (pipe2(go, O_CLOEXEC) != 0)
+    throw std::runtime_error(std::format("pipe: {}", strerror(errno)));
+
+  child_ = fork();
+  if (child_ < 0) {
+    close(go[0]);
+    close(go[1]);
+    throw std::runtime_error(std::format("fork: {}", strerror(errno)));
+  }
+
+  if (child_ == 0) {
+    // Wait until the counters exist; they are enabled by the exec itself.
+    close(go[1]);
+    char c;
+    if (read(go[0], &c, 1) != 1) _exit(127);
+    execve(binary.c_str(), argv, envp.data());
+    perror("exec");
+    _exit(127);
+  }
+
+  close(go[0]);
+  go_fd_  = go[1];
+  target_ = child_;
+  try {
+    open_counters({child_});
+  } catch (...) {
+    close(go_fd_);  // child sees EOF and exits
+    go_fd_ = -1;
+    waitpid(child_, nullptr, 0);
+    child_ = target_ = -1;
+    close_all();
+    throw;
+  }
+}
+
+void PerfRecorder::attach(pid_t pid) {
+  std::vector<pid_t> tids;
+  std::error_code ec;
+  for (const auto& e :
+       fs::directory_iterator(std::format("/proc/{}/task", pid), ec)) {
+    if (auto tid = parse_number(e.path().filename().string()))
+      tids.push_back(static_cast<pid_t>(*tid));
+  }
+  if (tids.empty())
+    throw std::runtime_error(std::format("no such process: {}", pid));
+
+  // Enabled explicitly by collect() rather than by an exec.
+  for (auto& ev : events_) ev.attr.enable_on_exec = 0;
+  try {
+    open_counters(tids);
+  } catch (...) {
+    close_all();
+    throw;
+  }
+
+  // perf synthesizes MMAP records for these; registering them directly
+  // gives the decoder the same view.
+  for (const auto& m : ProcMaps::read(pid)) {
+    if (!m.path.empty())
+      decoder_.address_space().map(static_cast<uint32_t>(pid), m.start,
+                                   m.end - m.start, m.pgoff, m.path);
+  }
+  target_ = pid;
+}
+
+// Copies everything between data_tail and data_head out of the ring and
+// hands the space back to the kernel. Records never straddle the copy, even
+// when they wrap around the end of the buffer.
+void PerfRecorder::drain(RingBuffer& rb, std::vector<uint8_t>& out) {
+  auto* meta          = reinterpret_cast<perf_event_mmap_page*>(rb.base);
+  const size_t page   = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  const uint8_t* data = rb.base + page;
+  const uint64_t size = rb.map_size - page;
+  const uint64_t head = __atomic_load_n(&meta->data_head, __ATOMIC_ACQUIRE);
+  const uint64_t tail = meta->data_tail;
+  if (head == tail) return;
+
+  const uint64_t len   = head - tail;
+  const uint64_t start = tail % size;
+  const uint64_t first = std::min(len, size - start);
+  const size_t at      = out.size();
+  out.resize(at + len);
+  std::memcpy(out.data() + at, data + start, first);
+  std::memcpy(out.data() + at + first, data, len - first);
+
+  __atomic_store_n(&meta->data_tail, head, __ATOMIC_RELEASE);
+}
+
+bool PerfRecorder::collect(const SampleConsumer& fn,
+                           std::chrono::milliseconds duration) {
+  const bool launched = go_fd_ >= 0;
+  if (target_ <= 0 || (launched && child_ <= 0)) return false;
+
+  const unsigned n_readers = std::clamp<unsigned>(
+    reader_threads_ ? reader_threads_ : std::thread::hardware_concurrency(), 1,
+    std::max<size_t>(rings_.size(), 1));
+
+  // Reader threads copy raw records out of their rings in passes. Records
+  // from different CPUs are only ordered between rounds (every reader has
+  // finished a pass that started after the previous round), exactly like
+  // PERF_RECORD_FINISHED_ROUND in perf.data: anything not newer than the
+  // newest timestamp seen at the previous round can be decoded.
+  struct Batch {
+    std::vector<uint8_t> bytes;
+  };
+  std::mutex m;
+  std::condition_variable cv;
+  std::deque<Batch> incoming;
+  std::vector<uint64_t> done_epoch(n_readers, 0);
+  uint64_t epoch = 1;
+  std::atomic<bool> stop{false};
+
+  auto reader = [&](unsigned t) {
+    std::vector<pollfd> pfds;
+    for (size_t i = t; i < rings_.size(); i += n_readers)
+      pfds.push_back(pollfd{rings_[i].fd, POLLIN, 0});
+
+    for (bool last = false; !last;) {
+      last = stop.load(std::memory_order_acquire);
+      if (!last) poll(pfds.data(), pfds.size(), 10);
+
+      uint64_t started;
+      {
+        std::lock_guard lk(m);
+        started = epoch;
+      }
+      Batch b;
+      for (size_t i = t; i < rings_.size(); i += n_readers)
+        drain(rings_[i], b.bytes);
+      {
+        std::lock_guard lk(m);
+        if (!b.bytes.empty()) incoming.push_back(std::move(b));
+        done_epoch[t] = started;
+      }
+      cv.notify_one();
+    }
+  };
+
+  std::vector<std::thread> readers;
+  readers.reserve(n_readers);
+  for (unsigned t = 0; t < n_readers; ++t) readers.emplace_back(reader, t);
+
+  bool started = true;
+  if (launched) {
+    // Let the child exec; the exec enables the counters.
+    const char go = 1;
+    started       = write(go_fd_, &go, 1) == 1;
+    close(go_fd_);
+    go_fd_ = -1;
+  } else {
+    for (int fd : fds_) ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  const auto deadline = std::chrono::steady_clock::now() + duration;
+
+  struct Pending {
+    uint64_t time;
+    const perf_event_header* hdr;
+    uint64_t batch;
+  };
+  // Copied bytes stay alive until every record in them has been decoded.
+  struct Held {
+    std::vector<uint8_t> bytes;
+    size_t live = 0;
+  };
+  std::deque<Held> held;
+  uint64_t held_base = 0;  // batch number of held.front()
+  std::vector<Pending> pending;
+  uint64_t max_seen   = 0;
+  uint64_t prev_round = 0;
+  PerfSample s;
+
+  auto flush = [&](uint64_t limit) {
+    std::ranges::stable_sort(pending, {}, &Pending::time);
+    auto cut = std::ranges::partition_point(
+      pending, [&](const Pending& p) { return p.time <= limit; });
+    for (auto it = pending.begin(); it != cut; ++it) {
+      if (it->hdr->type == PERF_RECORD_LOST) {
+        uint64_t lost[2];  // id, lost
+        std::memcpy(lost, it->hdr + 1, sizeof(lost));
+        lost_ += lost[1];
+      } else if (decoder_.decode(it->hdr, s)) {
+        fn(s);
+      }
+      --held[it->batch - held_base].live;
+    }
+    pending.erase(pending.begin(), cut);
+    while (!held.empty() && held.front().live == 0) {
+      held.pop_front();
+      ++held_base;
+    }
+  };
+
+  auto take = [&](std::vector<uint8_t>&& bytes) {
+    const uint64_t batch = held_base + held.size();
+    auto& kept           = held.emplace_back(Held{std::move(bytes)});
+    size_t off           = 0;
+    while (off + sizeof(perf_event_header) <= kept.bytes.size()) {
+      const auto* hdr =
+        reinterpret_cast<const perf_event_header*>(kept.bytes.data() + off);
+      if (hdr->size < sizeof(perf_event_header) ||
+          off + hdr->size > kept.bytes.size())
+        break;
+      const uint64_t t = decoder_.timestamp(hdr);
+      max_seen         = std::max(max_seen, t);
+      pending.push_back(Pending{t, hdr, batch});
+      ++kept.live;
+      off += hdr->size;
+    }
+  };
+
+  int status    = 0;
+  auto finished = [&] {
+    if (launched) return waitpid(child_, &status, WNOHANG) == child_;
+    if (duration.count() > 0 && std::chrono::steady_clock::now() >= deadline)
+      return true;
+    return kill(target_, 0) != 0 && errno == ESRCH;
+  };
+
+  if (!started) kill(child_, SIGKILL);
+  for (bool done = false; !done;) {
+    done = finished();
+
+    std::deque<Batch> batches;
+    bool round = false;
+    {
+      std::unique_lock lk(m);
+      cv.wait_for(lk, std::chrono::milliseconds(50),
+                  [&] { return !incoming.empty(); });
+      batches.swap(incoming);
+      if (std::ranges::all_of(done_epoch,
+                              [&](uint64_t e) { return e >= epoch; })) {
+        ++epoch;
+        round = true;
+      }
+    }
+
+    for (auto& b : batches) take(std::move(b.bytes));
+    if (round) {
+      flush(prev_round);
+      prev_round = max_seen;
+    }
+  }
+  if (launched) child_ = -1;
+  if (!launched) {
+    for (int fd : fds_) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  }
+
+  // Each reader makes one last pass once it sees `stop`.
+  stop.store(true, std::memory_order_release);
+  for (auto& t : readers) t.join();
+  for (auto& b : incoming) take(std::move(b.bytes));
+  incoming.clear();
+  flush(std::numeric_limits<uint64_t>::max());
+
+  if (!launched) return true;
+  return started && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
@@ -0,0 +1,587 @@
+#include "runtime/PerfScriptParser.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "common/Utils.hpp"
+#include "runtime/PipeStream.hpp"
+
+namespace {
+
+// Computes a bitmask of the blanks (' ' or '\t') in 64 bytes at `p`; bit i is
+// set when p[i] is blank.
+using BlankMaskFn = uint64_t (*)(const char* p);
+
+uint64_t blank_mask_scalar(const char* p) {
+  uint64_t mask = 0;
+  for (int i = 0; i < 64; ++i) {
+    if (p[i] == ' ' || p[i] == '\t') mask |= uint64_t{1} << i;
+  }
+  return mask;
+}
+
+#if defined(__x86_64__)
+uint64_t blank_mask_sse2(const char* p) {
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i tab   = _mm_set1_epi8('\t');
+  uint64_t mask       = 0;
+  for (int i = 0; i < 4; ++i) {
+    const __m128i v =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * i));
+    const __m128i eq =
+      _mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab));
+    mask |= static_cast<uint64_t>(
+              static_cast<uint16_t>(_mm_movemask_epi8(eq)))
+            << (16 * i);
+  }
+  return mask;
+}
+
+__attribute__((target("avx2"))) uint64_t blank_mask_avx2(const char* p) {
+  const __m256i space = _mm256_set1_epi8(' ');
+  const __m256i tab   = _mm256_set1_epi8('\t');
+  const __m256i lo =
+    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+  const __m256i hi =
+    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+  const auto m_lo = static_cast<uint32_t>(_mm256_movemask_epi8(
+    _mm256_or_si256(_mm256_cmpeq_epi8(lo, space), _mm256_cmpeq_epi8(lo, tab))));
+  const auto m_hi = static_cast<uint32_t>(_mm256_movemask_epi8(
+    _mm256_or_si256(_mm256_cmpeq_epi8(hi, space), _mm256_cmpeq_epi8(hi, tab))));
+  return (uint64_t{m_hi} << 32) | m_lo;
+}
+#endif
+
+BlankMaskFn pick_blank_mask() {
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return blank_mask_avx2;
+  return blank_mask_sse2;
+#else
+  return blank_mask_scalar;
+#endif
+}
+
+const BlankMaskFn blank_mask = pick_blank_mask();
+
+// Splits a line on runs of blanks without copying. Blank positions are found
+// 64 bytes at a time with SIMD and then walked with bit scans, so a typical
+// perf script line costs two or three vector compares.
+class LineTokenizer {
+public:
+  explicit LineTokenizer(std::string_view line) : line_(line) {}
+
+  bool next(std::string_view& tok) {
+    // Skip leading blanks.
+    while (pos_ < line_.size()) {
+      const uint64_t non_blank = ~mask_for(pos_) >> (pos_ & 63);
+      if (non_blank) {
+        pos_ += std::countr_zero(non_blank);
+        break;
+      }
+      pos_ = (pos_ | 63) + 1;
+    }
+    if (pos_ >= line_.size()) return false;
+
+    const size_t start = pos_;
+    while (pos_ < line_.size()) {
+      const uint64_t blank = mask_for(pos_) >> (pos_ & 63);
+      if (blank) {
+        pos_ += std::countr_zero(blank);
+        break;
+      }
+      pos_ = (pos_ | 63) + 1;
+    }
+    pos_ = std::min(pos_, line_.size());
+    tok  = line_.substr(start, pos_ - start);
+    return true;
+  }
+
+  size_t position() const { return pos_; }
+  void seek(size_t pos) { pos_ = pos; }
+
+private:
+  // Blank mask of the 64-byte block containing `pos`. Bytes past the end of
+  // the line count as blanks so the last token terminates.
+  uint64_t mask_for(size_t pos) {
+    const size_t block = pos & ~size_t{63};
+    if (block != block_) {
+      block_ = block;
+      if (line_.size() - block >= 64) {
+        mask_ = blank_mask(line_.data() + block);
+      } else {
+        char tail[64];
+        std::memset(tail, ' ', sizeof(tail));
+        std::memcpy(tail, line_.data() + block, line_.size() - block);
+        mask_ = blank_mask(tail);
+      }
+    }
+    return mask_;
+  }
+
+  std::string_view line_;
+  size_t pos_{0};
+  size_t block_{SIZE_MAX};
+  uint64_t mask_{0};
+};
+
+std::optional<uint64_t> parse_dec(std::string_view sv) {
+  uint64_t v     = 0;
+  auto [ptr, ec] = std::from_chars(sv.data(), sv.data() + sv.size(), v);
+  if (ec != std::errc{} || ptr == sv.data()) return std::nullopt;
+  return v;
+}
+
+// "12345.678901" -> nanoseconds. Only digits with exactly one '.' qualify.
+std::optional<uint64_t> parse_timestamp(std::string_view sv) {
+  const auto dot = sv.find('.');
+  if (dot == std::string_view::npos ||
+      sv.find_first_not_of("0123456789.") != std::string_view::npos)
+    return std::nullopt;
+
+  uint64_t secs = 0;
+  std::from_chars(sv.data(), sv.data() + dot, secs);
+  uint64_t nsecs = 0;
+  size_t digits  = 0;
+  for (char c : sv.substr(dot + 1)) {
+    if (c == '.' || digits == 9) break;
+    nsecs = nsecs * 10 + static_cast<uint64_t>(c - '0');
+    ++digits;
+  }
+  for (; digits < 9; ++digits) nsecs *= 10;
+  return secs * 1000000000ULL + nsecs;
+}
+
+bool iequals(std::string_view a, std::string_view b) {
+  if (a.size() != b.size()) return false;
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (std::tolower(static_cast<unsigned char>(a[i])) != b[i]) return false;
+  }
+  return true;
+}
+
+// perf's names for the x86-64 general-purpose registers (and the r-prefixed
+// forms some versions print), by DWARF number.
+struct RegName {
+  std::string_view name;
+  unsigned dwarf;
+};
+constexpr RegName REG_NAMES[] = {
+  {"ax", DWARF_RAX},      {"bx", DWARF_RBX},      {"cx", DWARF_RCX},
+  {"dx", DWARF_RDX},      {"si", DWARF_RSI},      {"di", DWARF_RDI},
+  {"bp", DWARF_RBP},      {"sp", DWARF_RSP},      {"rax", DWARF_RAX},
+  {"rbx", DWARF_RBX},     {"rcx", DWARF_RCX},     {"rdx", DWARF_RDX},
+  {"rsi", DWARF_RSI},     {"rdi", DWARF_RDI},     {"rbp", DWARF_RBP},
+  {"rsp", DWARF_RSP},     {"r8", DWARF_R8},       {"r9", DWARF_R8 + 1},
+  {"r10", DWARF_R8 + 2},  {"r11", DWARF_R8 + 3},  {"r12", DWARF_R8 + 4},
+  {"r13", DWARF_R8 + 5},  {"r14", DWARF_R8 + 6},  {"r15", DWARF_R15},
+};
+
+// DWARF number of the register perf calls `name`, or -1.
+int reg_number(std::string_view name) {
+  for (const auto& r : REG_NAMES) {
+    if (iequals(name, r.name)) return static_cast<int>(r.dwarf);
+  }
+  return -1;
+}
+
+void set_reg(PerfSample& s, int n, uint64_t v) {
+  s.regs[n] = v;
+  s.regs_mask |= 1u << n;
+}
+
+// Sampled user registers, which perf formats differently across versions:
+// "SP:" followed by the value, "sp:0x...", "sp=0x...", for every register
+// perf names. `pending` is set to the register whose value is in the next
+// token.
+void parse_reg_token(std::string_view tok, PerfSample& s, int& pending) {
+  while (!tok.empty() && (tok.back() == ',' || tok.back() == ';'))
+    tok.remove_suffix(1);
+
+  const auto sep = tok.find_first_of(":=");
+  if (sep == std::string_view::npos || sep == 0) return;
+  const int n = reg_number(tok.substr(0, sep));
+  if (n < 0) return;
+  if (sep + 1 == tok.size()) {
+    pending = n;
+    return;
+  }
+  if (auto v = parse_hex_u64(tok.substr(sep + 1))) set_reg(s, n, *v);
+}
+
+}  // namespace
+
+bool PerfScriptParser::parse_line(std::string_view line, PerfSample& s) {
+  LineTokenizer toks(line);
+  std::string_view tok;
+  if (!toks.next(tok) || tok.front() == '#') return false;
+
+  s.tid = s.pid = s.cpu = 0;
+  s.ip = s.addr = s.sp = s.bp = s.time_stamp = 0;
+  s.regs.fill(0);
+  s.regs_mask  = 0;
+  s.ip_mapping = nullptr;
+  s.event_type = SampleType::CACHE_LOAD;
+  s.symbol.clear();
+  s.dso.clear();
+
+  // Optional comm name (non pid/tid token)
+  if (tok.find('/') == std::string_view::npos && !toks.next(tok)) return false;
+
+  // pid/tid
+  const auto slash = tok.find('/');
+  if (slash == std::string_view::npos) return false;
+  auto pid = parse_dec(tok.substr(0, slash));
+  auto tid = parse_dec(tok.substr(slash + 1));
+  if (!pid || !tid) return false;
+  s.pid = static_cast<uint32_t>(*pid);
+  s.tid = static_cast<uint32_t>(*tid);
+
+  // [cpu]
+  if (!toks.next(tok) || tok.size() < 2 || tok.front() != '[' ||
+      tok.back() != ']')
+    return false;
+  auto cpu = parse_dec(tok.substr(1, tok.size() - 2));
+  if (!cpu) return false;
+  s.cpu = static_cast<uint32_t>(*cpu);
+
+  // Optional time token, formatted like "12345.678901:".
+  if (!toks.next(tok)) return false;
+  auto tt = tok;
+  if (tt.back() == ':') tt.remove_suffix(1);
+  if (auto ts = parse_timestamp(tt)) {
+    s.time_stamp = *ts;
+    if (!toks.next(tok)) return false;
+  }
+
+  // event types (often ends with ':')
+  auto event = tok;
+  if (event.back() == ':') event.remove_suffix(1);
+  if (event.starts_with("PERF_RECORD_")) return false;  // side-band line
+  s.event_type = event.find("store") != std::string_view::npos
+                   ? SampleType::CACHE_STORE
+                   : SampleType::CACHE_LOAD;  // loads, generic and IBS events
+
+  // perf prints two addresses for these events; for memory-access sampling
+  // (ibs_op, mem-loads/stores) the first is typically the accessed address and
+  // the second is the instruction pointer.
+  std::optional<uint64_t> addr, ip;
+  if (toks.next(tok)) addr = parse_hex_u64(tok);
+  if (toks.next(tok)) ip = parse_hex_u64(tok);
+  if (!addr || !ip) return false;
+  s.addr = *addr;
+  s.ip   = *ip;
+
+  // Remaining tokens contain sym and dso, but sym can include whitespace (e.g.
+  // "thread_method(PaddedCounter*, int)"). dso is reliably a single token like
+  // "(/path/to/bin)" or "([kernel.kallsyms])".
+  const size_t sym_pos = toks.position();
+  bool have_dso        = false;
+  while (toks.next(tok)) {
+    if (tok.size() >= 2 && tok.front() == '(' && tok.back() == ')') {
+      s.dso.assign(tok.substr(1, tok.size() - 2));
+      have_dso = true;
+      break;
+    }
+    if (!s.symbol.empty()) s.symbol.push_back(' ');
+    s.symbol.append(tok);
+  }
+
+  if (!have_dso) {
+    // Fallback: a bare symbol token followed by a bare dso token.
+    toks.seek(sym_pos);
+    s.symbol.clear();
+    if (toks.next(tok)) s.symbol.assign(tok);
+    if (toks.next(tok)) s.dso.assign(tok);
+  }
+
+  // Optional sampled user registers (we record the general-purpose ones via
+  // perf record --user-regs).
+  int pending = -1;
+  while (toks.next(tok)) {
+    if (pending >= 0) {
+      if (auto v = parse_hex_u64(tok)) set_reg(s, pending, *v);
+      pending = -1;
+      continue;
+    }
+    parse_reg_token(tok, s, pending);
+  }
+  s.sp = s.regs[DWARF_RSP];
+  s.bp = s.regs[DWARF_RBP];
+
+  return true;
+}
+
+std::optional<PerfSample> PerfScriptParser::parse_line(std::string_view line) {
+  PerfSample s{};
+  if (!parse_line(line, s)) return std::nullopt;
+  return s;
+}
+
+bool PerfScriptParser::parse_mmap_line(std::string_view line, Mapping& out) {
+  constexpr auto npos = std::string_view::npos;
+  const auto at       = line.find("PERF_RECORD_MMAP");
+  if (at == npos) return false;
+  auto rest = line.substr(at);
+
+  // " pid/tid: "
+  const auto sp    = rest.find(' ');
+  const auto slash = rest.find('/', sp);
+  const auto lb    = rest.find('[', sp);
+  if (sp == npos || slash == npos || lb == npos || slash > lb) return false;
+  // Kernel maps are reported for pid -1.
+  const auto pid_sv = trim(rest.substr(sp, slash - sp));
+  std::optional<uint64_t> pid{AddressSpace::KERNEL_PID};
+  if (pid_sv != "-1") pid = parse_dec(pid_sv);
+
+  // "[start(len) @ pgoff <maj:min ino gen | <build-id>>]: "
+  const auto lp    = rest.find('(', lb);
+  const auto rp    = rest.find(')', lp);
+  const auto at_pg = rest.find('@', rp);
+  const auto rb    = rest.find("]:", at_pg);
+  if (lp == npos || rp == npos || at_pg == npos || rb == npos) return false;
+  const auto start = parse_hex_u64(rest.substr(lb + 1, lp - lb - 1));
+  const auto len   = parse_hex_u64(rest.substr(lp + 1, rp - lp - 1));
+
+  LineTokenizer inside(rest.substr(at_pg + 1, rb - at_pg - 1));
+  std::string_view tok;
+  std::optional<uint64_t> pgoff;
+  if (inside.next(tok)) pgoff = parse_hex_u64(tok);
+  if (!pid || !start || !len || !pgoff) return false;
+
+  out.build_id.clear();
+  if (inside.next(tok) && tok.size() > 2 && tok.front() == '<' &&
+      tok.back() == '>')
+    out.build_id.assign(tok.substr(1, tok.size() - 2));
+
+  // "]: r-xp /path/with maybe spaces"
+  LineTokenizer tail(rest.substr(rb + 2));
+  if (!tail.next(tok)) return false;  // protection flags
+  out.path.assign(trim(rest.substr(rb + 2 + tail.position())));
+
+  out.pid   = static_cast<uint32_t>(*pid);
+  out.start = *start;
+  out.end   = *start + *len;
+  out.pgoff = *pgoff;
+  return true;
+}
+
+static void apply_mmap(AddressSpace& space, Mapping& m) {
+  space.map(m.pid, m.start, m.end - m.start, m.pgoff, std::move(m.path),
+            std::move(m.build_id));
+}
+
+static void resolve(const AddressSpace& space, PerfSample& s) {
+  s.ip_map     = space.resolve(s.pid, s.ip);
+  s.addr_map   = space.resolve(s.pid, s.addr);
+  s.ip_mapping =
+    s.ip_map != AddressSpace::NONE ? &space.get(s.ip_map) : nullptr;
+}
+
+// One newline-aligned block of perf script text and the samples parsed from
+// it by a worker thread. Sample slots are reused across blocks, so once warm
+// their symbol/dso strings stop allocating; only the first `count` are valid.
+// mmap lines are kept with the number of samples that preceded them, so the
+// consumer can replay them in order.
+struct ParseChunk {
+  std::string text;
+  std::vector<PerfSample> samples;
+  size_t count = 0;
+  std::vector<std::pair<size_t, Mapping>> mmaps;
+  bool done = false;
+};
+
+static void parse_chunk(ParseChunk& chunk, bool want_mmaps) {
+  chunk.count = 0;
+  chunk.mmaps.clear();
+  std::string_view rest = chunk.text;
+  Mapping m;
+  while (!rest.empty()) {
+    auto nl   = rest.find('\n');
+    auto line = rest.substr(0, nl);
+    rest      = (nl == std::string_view::npos) ? std::string_view{}
+                                               : rest.substr(nl + 1);
+    if (chunk.count == chunk.samples.size()) chunk.samples.emplace_back();
+    if (PerfScriptParser::parse_line(line, chunk.samples[chunk.count]))
+      ++chunk.count;
+    else if (want_mmaps && PerfScriptParser::parse_mmap_line(line, m))
+      chunk.mmaps.emplace_back(chunk.count, std::move(m));
+  }
+}
+
+void PerfScriptParser::for_each_sample(PipeStream& pipe,
+                                       const SampleConsumer& fn,
+                                       unsigned jobs, AddressSpace* space) {
+  if (jobs <= 1) {
+    std::string_view line;
+    PerfSample sample{};
+    Mapping m;
+    while (pipe.next_line(line)) {
+      if (parse_line(line, sample)) {
+        if (space) resolve(*space, sample);
+        fn(sample);
+      } else if (space && parse_mmap_line(line, m)) {
+        apply_mmap(*space, m);
+      }
+    }
+    return;
+  }
+
+  // Blocks are kept in read order; at most `max_in_flight` exist at once, so
+  // memory stays bounded while workers parse ahead of the consumer.
+  const size_t max_in_flight = size_t{jobs} * 2;
+  std::deque<std::unique_ptr<ParseChunk>> in_flight;
+  std::deque<ParseChunk*> todo;
+  std::vector<std::unique_ptr<ParseChunk>> spare;
+  std::exception_ptr error;
+  bool stop = false;
+
+  std::mutex m;
+  std::condition_variable work_cv;
+  std::condition_variable done_cv;
+
+  auto worker = [&] {
+    for (;;) {
+      ParseChunk* chunk = nullptr;
+      {
+        std::unique_lock lk(m);
+        work_cv.wait(lk, [&] { return stop || !todo.empty(); });
+        if (todo.empty()) return;
+        chunk = todo.front();
+        todo.pop_front();
+      }
+
+      std::exception_ptr err;
+      try {
+        parse_chunk(*chunk, space != nullptr);
+      } catch (...) {
+        err = std::current_exception();
+      }
+
+      {
+        std::lock_guard lk(m);
+        if (err && !error) error = err;
+        chunk->done = true;
+      }
+      done_cv.notify_one();
+    }
+  };
+
+  std::vector<std::thread> workers;
+  // Runs on every exit path, so an exception from `fn`, apply_mmap or the
+  // pipe does not leave joinable threads behind. Blocks no worker has picked
+  // up yet are dropped.
+  auto join_workers = [&] {
+    {
+      std::lock_guard lk(m);
+      stop = true;
+      todo.clear();
+    }
+    work_cv.notify_all();
+    for (auto& t : workers) t.join();
+  };
+
+  try {
+    workers.reserve(jobs);
+    for (unsigned i = 0; i < jobs; ++i) workers.emplace_back(worker);
+
+    // A worker's error stops the dispatch right away instead of after the
+    // rest of the input has been read.
+    bool eof = false;
+    for (;;) {
+      std::unique_ptr<ParseChunk> ready;
+      {
+        std::unique_lock lk(m);
+        if (error || (eof && in_flight.empty())) break;
+        done_cv.wait(lk, [&] {
+          return error || (!in_flight.empty() && in_flight.front()->done) ||
+                 (!eof && in_flight.size() < max_in_flight);
+        });
+        if (error) break;
+        if (!in_flight.empty() && in_flight.front()->done) {
+          ready = std::move(in_flight.front());
+          in_flight.pop_front();
+        }
+      }
+
+      if (ready) {
+        auto next_mmap = ready->mmaps.begin();
+        for (size_t i = 0; i < ready->count; ++i) {
+          for (; next_mmap != ready->mmaps.end() && next_mmap->first == i;
+               ++next_mmap)
+            apply_mmap(*space, next_mmap->second);
+          if (space) resolve(*space, ready->samples[i]);
+          fn(ready->samples[i]);
+        }
+        for (; next_mmap != ready->mmaps.end(); ++next_mmap)
+          apply_mmap(*space, next_mmap->second);
+        ready->done = false;
+        spare.push_back(std::move(ready));
+        continue;
+      }
+
+      // Room for another block: read it on this thread while workers parse.
+      std::unique_ptr<ParseChunk> chunk;
+      if (!spare.empty()) {
+        chunk = std::move(spare.back());
+        spare.pop_back();
+      } else {
+        chunk = std::make_unique<ParseChunk>();
+      }
+      if (!pipe.read_block(chunk->text)) {
+        eof = true;
+        continue;
+      }
+
+      {
+        std::lock_guard lk(m);
+        todo.push_back(chunk.get());
+        in_flight.push_back(std::move(chunk));
+      }
+      work_cv.notify_one();
+    }
+  } catch (...) {
+    join_workers();
+    throw;
+  }
+  join_workers();
+
+  if (error) std::rethrow_exception(error);
+}
+
+void PerfScriptParser::for_each_sample(const std::string& perf_data_file,
+                                       const SampleConsumer& fn, unsigned jobs,
+                                       AddressSpace* space) {
+  std::string cmd = std::format("perf script -i {} -F {}{} 2>/dev/null",
+                                perf_data_file, FIELDS,
+                                space ? " --show-mmap-events" : "");
+
+  PipeStream pipe(cmd);
+  for_each_sample(pipe, fn, jobs, space);
+}
+
+std::vector<PerfSample> PerfScriptParser::parse_file(
+  const std::string& perf_data_file) {
+  std::vector<PerfSample> samples;
+  for_each_sample(perf_data_file,
+                  [&](const PerfSample& s) { samples.push_back(s); });
+  return samples;
+}
@@ -0,0 +1,163 @@
+#include "runtime/PhaseAnalysis.hpp"
+
+#include <algorithm>
+#include <format>
+#include <iostream>
+#include <iterator>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+#include "common/Utils.hpp"
+#include "runtime/CacheLineAccumulator.hpp"
+#include "runtime/FalseSharingAnalysis.hpp"
+#include "runtime/SampleStore.hpp"
+
+static constexpr uint64_t MAX_WINDOWS{uint64_t{1} << 24};
+
+// Contended lines over the samples order[begin, end).
+static std::vector<CacheLine> hot_lines(const SampleStore& samples,
+                                        const CpuTopology* topology,
+                                        const std::vector<uint32_t>& order,
+                                        size_t begin, size_t end) {
+  CacheLineAccumulator acc(topology);
+  for (size_t k = begin; k < end; ++k) {
+    const uint32_t i = order[k];
+    acc.add(samples.addrs[i], samples.tids[i], samples.cpus[i],
+            samples.types[i]);
+  }
+  auto hot = FalseSharingAnalysis::find_hot_cache_lines(
+    acc, PhaseAnalysis::MIN_WINDOW_SAMPLES);
+  std::erase_if(hot, [](const CacheLine& line) {
+    return line.sharing == SharingClass::PRIVATE;
+  });
+  return hot;
+}
+
+// The top lines of a window, sorted by address for set operations.
+static std::vector<uint64_t> signature(const std::vector<CacheLine>& hot) {
+  std::vector<uint64_t> sig;
+  const size_t n = std::min(hot.size(), PhaseAnalysis::SIGNATURE_LINES);
+  for (size_t i = 0; i < n; ++i) sig.push_back(hot[i].base_addr);
+  std::ranges::sort(sig);
+  return sig;
+}
+
+static double similarity(const std::vector<uint64_t>& a,
+                         const std::vector<uint64_t>& b) {
+  if (a.empty() && b.empty()) return 1.0;
+  std::vector<uint64_t> common;
+  std::ranges::set_intersection(a, b, std::back_inserter(common));
+  return static_cast<double>(common.size()) /
+         static_cast<double>(a.size() + b.size() - common.size());
+}
+
+std::vector<Phase> PhaseAnalysis::find_phases(const SampleStore& samples,
+                                              uint64_t window_ns,
+                                              const CpuTopology* topology) {
+  if (window_ns == 0) throw std::runtime_error("window must be positive");
+  if (samples.size() > UINT32_MAX)
+    throw std::runtime_error("too many samples for windowed analysis");
+
+  // Samples without a time or a data address say nothing about contention.
+  auto usable = [&](size_t i) {
+    return samples.times[i] != 0 && samples.addrs[i] != 0;
+  };
+  uint64_t first = UINT64_MAX;
+  uint64_t last  = 0;
+  for (size_t i = 0; i < samples.size(); ++i) {
+    if (!usable(i)) continue;
+    first = std::min(first, samples.times[i]);
+    last  = std::max(last, samples.times[i]);
+  }
+  if (first > last) return {};
+
+  const uint64_t count = (last - first) / window_ns + 1;
+  if (count > MAX_WINDOWS) {
+    throw std::runtime_error(std::format(
+      "a {} ms window splits the {:.3f} s recording into {} windows",
+      static_cast<double>(window_ns) / 1e6,
+      static_cast<double>(last - first) / 1e9, count));
+  }
+
+  // Counting sort by window. Within a window samples keep their recorded
+  // order, which the bounce score depends on.
+  auto window_of = [&](size_t i) {
+    return (samples.times[i] - first) / window_ns;
+  };
+  std::vector<uint32_t> offsets(count + 1, 0);
+  for (size_t i = 0; i < samples.size(); ++i) {
+    if (usable(i)) ++offsets[window_of(i) + 1];
+  }
+  std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+  std::vector<uint32_t> order(offsets.back());
+  std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+  for (size_t i = 0; i < samples.size(); ++i) {
+    if (usable(i)) order[cursor[window_of(i)]++] = static_cast<uint32_t>(i);
+  }
+
+  // Phases are contiguous in `order`: [bounds[k], bounds[k + 1]).
+  std::vector<Phase> phases;
+  std::vector<size_t> bounds;
+  std::vector<uint64_t> prev;
+  for (uint64_t w = 0; w < count; ++w) {
+    const size_t begin = offsets[w];
+    const size_t end   = offsets[w + 1];
+    if (begin == end) continue;  // nothing sampled; does not end a phase
+
+    auto sig = signature(hot_lines(samples, topology, order, begin, end));
+    if (phases.empty() || similarity(sig, prev) < MIN_SIMILARITY) {
+      phases.emplace_back().start = w * window_ns;
+      bounds.push_back(begin);
+    }
+    auto& phase = phases.back();
+    phase.end   = (w + 1) * window_ns;
+    ++phase.windows;
+    phase.samples += end - begin;
+    prev = std::move(sig);
+  }
+  bounds.push_back(order.size());
+
+  for (size_t k = 0; k < phases.size(); ++k)
+    phases[k].hot =
+      hot_lines(samples, topology, order, bounds[k], bounds[k + 1]);
+  return phases;
+}
+
+void PhaseAnalysis::print(const std::vector<Phase>& phases, uint64_t window_ns,
+                          uint64_t sample_period, size_t max_lines) {
+  std::cout << std::format("=== Contention Phases ({} ms windows) ===\n\n",
+                           static_cast<double>(window_ns) / 1e6);
+  if (phases.empty()) {
+    std::cout << "No timestamped samples with data addresses.\n\n";
+    return;
+  }
+
+  for (size_t k = 0; k < phases.size(); ++k) {
+    const auto& p = phases[k];
+    std::cout << std::format(
+      "Phase {}: {:.3f}s - {:.3f}s ({} window{}, {} samples, {} contended "
+      "line{})\n",
+      k + 1, static_cast<double>(p.start) / 1e9,
+      static_cast<double>(p.end) / 1e9, p.windows, p.windows == 1 ? "" : "s",
+      p.samples, p.hot.size(), p.hot.size() == 1 ? "" : "s");
+
+    for (size_t i = 0; i < std::min(p.hot.size(), max_lines); ++i) {
+      const auto& line = p.hot[i];
+      std::string tids;
+      for (const uint32_t tid : line.tids)
+        tids += std::format("{}{}", tids.empty() ? "" : " ", tid);
+      const auto period = static_cast<double>(sample_period);
+      std::cout << std::format(
+        "  #{} 0x{:x}  {}  bounce={:.3f} ({:.3f} - {:.3f})  samples={} "
+        "(~{} accesses, ~{} writes)  threads={}{} [{}]\n",
+        i + 1, line.base_addr, FalseSharingAnalysis::name(line.sharing),
+        line.bounce_score, line.bounce_ci.low, line.bounce_ci.high,
+        line.sample_count,
+        format_count(static_cast<double>(line.sample_count) * period),
+        format_count(static_cast<double>(line.sample_writes) * period),
+        line.thread_count, line.thread_overflow ? "+" : "", tids);
+    }
+    std::cout << "\n";
+  }
+}
@@ -1,6 +1,9 @@
 #include "runtime/PipeStream.hpp"
 
-#include <array>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -16,24 +19,109 @@ PipeStream::~PipeStream() {
   if (pipe_) pclose(pipe_);
 }
 
-PipeStream::PipeStream(PipeStream&& other) noexcept : pipe_(other.pipe_) {
+PipeStream::PipeStream(PipeStream&& other) noexcept
+  : pipe_(other.pipe_),
+    buf_(std::move(other.buf_)),
+    begin_(other.begin_),
+    end_(other.end_),
+    eof_(other.eof_) {
   other.pipe_ = nullptr;
 }
 
 std::string PipeStream::read_all() {
   std::string result;
-  std::array<char, 4096> buffer;
-  while (fgets(buffer.data(), buffer.size(), pipe_)) {
-    result += buffer.data();
+  std::string_view line;
+  while (next_line(line)) {
+    result += line;
+    result.push_back('\n');
   }
   return result;
 }
 
 std::vector<std::string> PipeStream::read_lines() {
   std::vector<std::string> lines;
-  std::array<char, 4096> buffer;
-  while (fgets(buffer.data(), buffer.size(), pipe_)) {
-    lines.emplace_back(buffer.data());
-  }
+  std::string_view line;
+  while (next_line(line)) lines.emplace_back(line);
   return lines;
 }
+
+bool PipeStream::refill() {
+  if (eof_ || !pipe_) return false;
+
+  if (buf_.empty()) buf_.resize(BUFFER_SIZE);
+
+  // Keep the unfinished line, move it to the front and read behind it.
+  const size_t partial = end_ - begin_;
+  if (begin_ > 0) {
+    std::memmove(buf_.data(), buf_.data() + begin_, partial);
+    begin_ = 0;
+    end_   = partial;
+  }
+  if (end_ == buf_.size()) buf_.resize(buf_.size() * 2);
+
+  const int fd = fileno(pipe_);
+  ssize_t n    = 0;
+  do {
+    n = read(fd, buf_.data() + end_, buf_.size() - end_);
+  } while (n < 0 && errno == EINTR);
+
+  if (n <= 0) {
+    eof_ = true;
+    return false;
+  }
+  end_ += static_cast<size_t>(n);
+  return true;
+}
+
+bool PipeStream::next_line(std::string_view& line) {
+  size_t scanned = begin_;
+  for (;;) {
+    const void* nl =
+      (end_ > scanned)
+        ? std::memchr(buf_.data() + scanned, '\n', end_ - scanned)
+        : nullptr;
+    if (nl) {
+      const size_t pos = static_cast<const char*>(nl) - buf_.data();
+      line   = std::string_view(buf_.data() + begin_, pos - begin_);
+      begin_ = pos + 1;
+      return true;
+    }
+
+    const size_t partial = end_ - begin_;
+    if (!refill()) break;
+    scanned = partial;  // refill() moved the partial line to offset 0
+  }
+
+  // Last line without a trailing newline
+  if (begin_ < end_) {
+    line   = std::string_view(buf_.data() + begin_, end_ - begin_);
+    begin_ = end_;
+    return true;
+  }
+  return false;
+}
+
+bool PipeStream::read_block(std::string& out, size_t min_bytes) {
+  out.clear();
+  for (;;) {
+    // Take every complete line currently buffered.
+    const char* first = buf_.data() + begin_;
+    const char* last  = first;
+    for (const char* p = buf_.data() + end_; p > first; --p) {
+      if (p[-1] == '\n') {
+        last = p;
+        break;
+      }
+    }
+    out.append(first, last);
+    begin_ += static_cast<size_t>(last - first);
+
+    if (out.size() >= min_bytes) return true;
+    if (!refill()) break;
+  }
+
+  // Final line without a trailing newline
+  out.append(buf_.data() + begin_, end_ - begin_);
+  begin_ = end_;
+  return !out.empty();
+}
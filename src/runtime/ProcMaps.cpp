@@ -0,0 +1,44 @@
+#include "runtime/ProcMaps.hpp"
+
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+
+std::vector<ProcMapping> ProcMaps::read(pid_t pid) {
+  std::vector<ProcMapping> maps;
+  std::ifstream in(std::format("/proc/{}/maps", pid));
+  std::string line;
+  // start-end perms offset dev inode [path]
+  while (std::getline(in, line)) {
+    std::istringstream ls(line);
+    std::string range, dev, inode;
+    ProcMapping m;
+    ls >> range >> m.perms >> std::hex >> m.pgoff >> dev >> inode;
+    if (!ls) continue;
+    std::getline(ls >> std::ws, m.path);
+
+    const auto dash = range.find('-');
+    if (dash == std::string::npos) continue;
+    m.start = std::stoull(range.substr(0, dash), nullptr, 16);
+    m.end   = std::stoull(range.substr(dash + 1), nullptr, 16);
+    maps.push_back(std::move(m));
+  }
+  return maps;
+}
+
+std::string ProcMaps::exe_path(pid_t pid) {
+  std::error_code ec;
+  auto exe = std::filesystem::read_symlink(std::format("/proc/{}/exe", pid), ec)
+               .string();
+  if (ec)
+    throw std::runtime_error(
+      std::format("cannot resolve /proc/{}/exe: {}", pid, ec.message()));
+
+  constexpr std::string_view deleted = " (deleted)";
+  if (exe.ends_with(deleted)) exe.resize(exe.size() - deleted.size());
+  return exe;
+}
@@ -0,0 +1,392 @@
+#include "runtime/SampleCache.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include "runtime/ElfSymbolTable.hpp"
+
+namespace fs = std::filesystem;
+
+static constexpr char CACHE_MAGIC[8] = {'C', 'S', 'C', 'A', 'C', 'H', 'E', '1'};
+static constexpr uint32_t CACHE_VERSION = 6;
+
+// Native byte order; a cache is only read back on the machine that wrote it.
+// Layout after the header:
+//   u32 tids[n], pids[n], cpus[n], symbol_ids[n], dso_ids[n], ip_maps[n],
+//       addr_maps[n]
+//   u8 types[n]
+//   u64 ips[n], sps[n], bps[n]
+//   SampleStore::SavedReg saved_regs[saved_regs]
+//   varint time deltas (time_bytes), varint addr deltas (addr_bytes)
+//   symbol table, dso table: u32 count, { u32 len, char[len] }[count]
+//   mappings: u32 count, { u32 pid, u64 start, end, pgoff, str path,
+//             str build_id }[count]
+//   live mappings: u32 pids, { u32 pid, u32 count, u32 ids[count] }[pids]
+struct CacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t sampled_regs;
+  uint32_t binary_only;  // 1: samples outside the binary were dropped
+  uint64_t count;
+  uint64_t seen;  // samples recorded, before the DSO filter
+  uint64_t source_size;
+  int64_t source_mtime;  // ns since the epoch
+  uint64_t binary_size;
+  int64_t binary_mtime;
+  char binary_build_id[64];  // hex, NUL-padded
+  uint64_t time_bytes;
+  uint64_t addr_bytes;
+  uint64_t saved_regs;
+};
+
+struct SourceStamp {
+  uint64_t size = 0;
+  int64_t mtime = 0;
+};
+
+static SourceStamp stamp_of(const std::string& source) {
+  if (source.empty()) return {};
+  std::error_code ec;
+  SourceStamp st;
+  st.size = fs::file_size(source, ec);
+  if (ec) return {};
+  st.mtime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+               fs::last_write_time(source, ec).time_since_epoch())
+               .count();
+  return st;
+}
+
+// The analyzed binary's stamp and build-id in header form.
+static void stamp_binary(CacheHeader& h, const std::string& binary) {
+  const auto stamp = stamp_of(binary);
+  const auto id    = ElfSymbolTable::read_build_id(binary);
+  h.binary_size    = stamp.size;
+  h.binary_mtime   = stamp.mtime;
+  std::memset(h.binary_build_id, 0, sizeof(h.binary_build_id));
+  std::memcpy(h.binary_build_id, id.data(),
+              std::min(id.size(), sizeof(h.binary_build_id)));
+}
+
+static void put_varint(std::string& out, uint64_t v) {
+  while (v >= 0x80) {
+    out.push_back(static_cast<char>(v | 0x80));
+    v >>= 7;
+  }
+  out.push_back(static_cast<char>(v));
+}
+
+// Zigzag-varint deltas: consecutive samples are close in time and often in
+// address, so most entries take one to three bytes instead of eight.
+static std::string encode_deltas(const std::vector<uint64_t>& values) {
+  std::string out;
+  out.reserve(values.size() * 2);
+  uint64_t prev = 0;
+  for (uint64_t v : values) {
+    const auto delta = static_cast<int64_t>(v - prev);
+    put_varint(out, (static_cast<uint64_t>(delta) << 1) ^
+                      static_cast<uint64_t>(delta >> 63));
+    prev = v;
+  }
+  return out;
+}
+
+static bool decode_deltas(const uint8_t* p, const uint8_t* end, size_t n,
+                          std::vector<uint64_t>& out) {
+  out.resize(n);
+  uint64_t prev = 0;
+  for (size_t i = 0; i < n; ++i) {
+    uint64_t zz = 0;
+    for (int shift = 0;; shift += 7) {
+      if (p == end || shift > 63) return false;
+      const uint8_t b = *p++;
+      zz |= uint64_t{b & 0x7fu} << shift;
+      if (!(b & 0x80)) break;
+    }
+    prev += (zz >> 1) ^ (~(zz & 1) + 1);
+    out[i] = prev;
+  }
+  return p == end;
+}
+
+template <typename T>
+static void write_column(std::ofstream& out, const std::vector<T>& col) {
+  out.write(reinterpret_cast<const char*>(col.data()),
+            static_cast<std::streamsize>(col.size() * sizeof(T)));
+}
+
+template <typename T>
+static void write_value(std::ofstream& out, T v) {
+  out.write(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+static void write_string(std::ofstream& out, const std::string& s) {
+  write_value(out, static_cast<uint32_t>(s.size()));
+  out.write(s.data(), static_cast<std::streamsize>(s.size()));
+}
+
+static void write_strings(std::ofstream& out, const StringTable& table) {
+  const auto count = static_cast<uint32_t>(table.size());
+  write_value(out, count);
+  for (uint32_t id = 0; id < count; ++id) write_string(out, table.get(id));
+}
+
+static void write_address_space(std::ofstream& out,
+                                const AddressSpace& space) {
+  write_value(out, static_cast<uint32_t>(space.mappings().size()));
+  for (const auto& m : space.mappings()) {
+    write_value(out, m.pid);
+    write_value(out, m.start);
+    write_value(out, m.end);
+    write_value(out, m.pgoff);
+    write_string(out, m.path);
+    write_string(out, m.build_id);
+  }
+  write_value(out, static_cast<uint32_t>(space.live().size()));
+  for (const auto& [pid, table] : space.live()) {
+    write_value(out, pid);
+    write_value(out, static_cast<uint32_t>(table.size()));
+    for (const auto& [start, id] : table) write_value(out, id);
+  }
+}
+
+void SampleCache::save(const std::string& cache_path,
+                       const SampleStore& samples, uint64_t seen,
+                       const std::string& source, const std::string& binary,
+                       bool binary_only) {
+  const auto times = encode_deltas(samples.times);
+  const auto addrs = encode_deltas(samples.addrs);
+  const auto stamp = stamp_of(source);
+
+  CacheHeader h{};
+  std::memcpy(h.magic, CACHE_MAGIC, sizeof(h.magic));
+  h.version      = CACHE_VERSION;
+  h.sampled_regs = samples.sampled_regs;
+  h.binary_only  = binary_only;
+  h.count        = samples.size();
+  h.seen         = seen;
+  h.source_size  = stamp.size;
+  h.source_mtime = stamp.mtime;
+  h.time_bytes   = times.size();
+  h.addr_bytes   = addrs.size();
+  h.saved_regs   = samples.saved_regs.size();
+  stamp_binary(h, binary);
+
+  const std::string tmp = cache_path + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out) throw std::runtime_error("cannot write " + tmp);
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    write_column(out, samples.tids);
+    write_column(out, samples.pids);
+    write_column(out, samples.cpus);
+    write_column(out, samples.symbol_ids);
+    write_column(out, samples.dso_ids);
+    write_column(out, samples.ip_maps);
+    write_column(out, samples.addr_maps);
+    write_column(out, samples.types);
+    write_column(out, samples.ips);
+    write_column(out, samples.sps);
+    write_column(out, samples.bps);
+    write_column(out, samples.saved_regs);
+    out.write(times.data(), static_cast<std::streamsize>(times.size()));
+    out.write(addrs.data(), static_cast<std::streamsize>(addrs.size()));
+    write_strings(out, samples.symbols);
+    write_strings(out, samples.dsos);
+    write_address_space(out, samples.address_space);
+    if (!out) throw std::runtime_error("short write to " + tmp);
+  }
+
+  std::error_code ec;
+  fs::rename(tmp, cache_path, ec);
+  if (ec)
+    throw std::runtime_error(
+      std::format("cannot rename {}: {}", tmp, ec.message()));
+}
+
+// Bounds-checked reader over the mapped cache file.
+struct CacheCursor {
+  const uint8_t* p;
+  const uint8_t* end;
+
+  template <typename T>
+  void column(std::vector<T>& col, size_t n) {
+    const uint64_t bytes = uint64_t{n} * sizeof(T);
+    if (static_cast<uint64_t>(end - p) < bytes)
+      throw std::runtime_error("sample cache: truncated column");
+    col.resize(n);
+    std::memcpy(col.data(), p, bytes);
+    p += bytes;
+  }
+
+  const uint8_t* take(uint64_t bytes) {
+    if (static_cast<uint64_t>(end - p) < bytes)
+      throw std::runtime_error("sample cache: truncated file");
+    const uint8_t* at = p;
+    p += bytes;
+    return at;
+  }
+
+  template <typename T>
+  T value() {
+    T v;
+    std::memcpy(&v, take(sizeof(v)), sizeof(v));
+    return v;
+  }
+
+  uint32_t u32() { return value<uint32_t>(); }
+  uint64_t u64() { return value<uint64_t>(); }
+
+  std::string string() {
+    const uint32_t len = u32();
+    return std::string(reinterpret_cast<const char*>(take(len)), len);
+  }
+
+  void strings(StringTable& table) {
+    const uint32_t count = u32();
+    for (uint32_t id = 0; id < count; ++id) {
+      const uint32_t len = u32();
+      const auto* s      = reinterpret_cast<const char*>(take(len));
+      // Ids are dense and the strings unique, so interning in order gives
+      // every string its original id back.
+      if (table.intern(std::string_view(s, len)) != id)
+        throw std::runtime_error("sample cache: bad string table");
+    }
+  }
+
+  void address_space(AddressSpace& space) {
+    const uint32_t count = u32();
+    if (count > static_cast<uint64_t>(end - p))
+      throw std::runtime_error("sample cache: bad mapping count");
+    std::vector<Mapping> mappings(count);
+    for (auto& m : mappings) {
+      m.pid      = u32();
+      m.start    = u64();
+      m.end      = u64();
+      m.pgoff    = u64();
+      m.path     = string();
+      m.build_id = string();
+    }
+
+    std::unordered_map<uint32_t, AddressSpace::Intervals> live;
+    for (uint32_t pids = u32(); pids > 0; --pids) {
+      auto& table = live[u32()];
+      for (uint32_t n = u32(); n > 0; --n) {
+        const uint32_t id = u32();
+        if (id == AddressSpace::NONE || id > mappings.size())
+          throw std::runtime_error("sample cache: mapping id out of range");
+        table.emplace(mappings[id - 1].start, id);
+      }
+    }
+    space.restore(std::move(mappings), std::move(live));
+  }
+};
+
+std::optional<SampleCache::Contents> SampleCache::load(
+  const std::string& cache_path, const std::string& source,
+  const std::string& binary, bool binary_only) {
+  const int fd = open(cache_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return std::nullopt;
+
+  struct stat st{};
+  if (fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(CacheHeader)) {
+    close(fd);
+    throw std::runtime_error("sample cache: " + cache_path + " is truncated");
+  }
+  const size_t size = static_cast<size_t>(st.st_size);
+  void* map         = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    throw std::runtime_error("sample cache: cannot map " + cache_path);
+
+  // Unmapped on every exit path.
+  struct Unmap {
+    void* p;
+    size_t n;
+    ~Unmap() { munmap(p, n); }
+  } unmap{map, size};
+  const auto* base = static_cast<const uint8_t*>(map);
+
+  CacheHeader h;
+  std::memcpy(&h, base, sizeof(h));
+  if (std::memcmp(h.magic, CACHE_MAGIC, sizeof(h.magic)) != 0 ||
+      h.version != CACHE_VERSION)
+    throw std::runtime_error(
+      std::format("sample cache: {} is not a CacheScope v{} cache",
+                  cache_path, CACHE_VERSION));
+
+  if (h.source_size != 0 || h.source_mtime != 0) {
+    const auto now = stamp_of(source);
+    if (now.size != h.source_size || now.mtime != h.source_mtime)
+      return std::nullopt;  // perf.data was re-recorded
+  }
+  CacheHeader now{};
+  stamp_binary(now, binary);
+  if (now.binary_size != h.binary_size ||
+      now.binary_mtime != h.binary_mtime ||
+      std::memcmp(now.binary_build_id, h.binary_build_id,
+                  sizeof(h.binary_build_id)) != 0)
+    return std::nullopt;  // the binary was rebuilt or replaced
+  if (h.binary_only != static_cast<uint32_t>(binary_only))
+    return std::nullopt;  // other samples were dropped
+
+  SampleStore s;
+  CacheCursor c{base + sizeof(h), base + size};
+  const size_t n = h.count;
+  if (n > size) throw std::runtime_error("sample cache: bad sample count");
+
+  c.column(s.tids, n);
+  c.column(s.pids, n);
+  c.column(s.cpus, n);
+  c.column(s.symbol_ids, n);
+  c.column(s.dso_ids, n);
+  c.column(s.ip_maps, n);
+  c.column(s.addr_maps, n);
+  c.column(s.types, n);
+  c.column(s.ips, n);
+  c.column(s.sps, n);
+  c.column(s.bps, n);
+  if (h.saved_regs > size)
+    throw std::runtime_error("sample cache: bad register count");
+  c.column(s.saved_regs, h.saved_regs);
+  s.sampled_regs = h.sampled_regs;
+
+  const uint8_t* times = c.take(h.time_bytes);
+  const uint8_t* addrs = c.take(h.addr_bytes);
+  if (!decode_deltas(times, times + h.time_bytes, n, s.times) ||
+      !decode_deltas(addrs, addrs + h.addr_bytes, n, s.addrs))
+    throw std::runtime_error("sample cache: bad delta column");
+
+  c.strings(s.symbols);
+  c.strings(s.dsos);
+  c.address_space(s.address_space);
+
+  for (size_t i = 0; i < n; ++i) {
+    if (s.symbol_ids[i] >= s.symbols.size() || s.dso_ids[i] >= s.dsos.size())
+      throw std::runtime_error("sample cache: string id out of range");
+    if (s.ip_maps[i] > s.address_space.size() ||
+        s.addr_maps[i] > s.address_space.size())
+      throw std::runtime_error("sample cache: mapping id out of range");
+  }
+  for (size_t i = 0; i < s.saved_regs.size(); ++i) {
+    const auto& r = s.saved_regs[i];
+    if (r.row >= n || r.reg >= std::tuple_size_v<UserRegs> ||
+        (i > 0 && r.row < s.saved_regs[i - 1].row))
+      throw std::runtime_error("sample cache: bad saved register");
+  }
+
+  return Contents{std::move(s), h.seen};
+}
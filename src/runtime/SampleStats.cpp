@@ -4,24 +4,23 @@
 #include <ostream>
 #include <unordered_set>
 
-#include "common/Types.hpp"
+#include "runtime/SampleStore.hpp"
 
-SampleStats SampleStats::compute(const std::vector<PerfSample>& samples) {
+SampleStats SampleStats::compute(const SampleStore& samples) {
   SampleStats s;
   s.total_samples = samples.size();
 
   std::unordered_set<uint32_t> tids;
   std::unordered_set<uint32_t> cpus;
 
-  for (const auto& sample : samples) {
-    if (sample.addr != 0) s.samples_with_addr++;
-    if (sample.ip != 0) s.samples_with_ip++;
-    if (sample.sp != 0) s.samples_with_sp++;
-    if (sample.bp != 0) s.samples_with_bp++;
+  // One column at a time keeps each scan sequential.
+  for (auto addr : samples.addrs) s.samples_with_addr += (addr != 0);
+  for (auto ip : samples.ips) s.samples_with_ip += (ip != 0);
+  for (auto sp : samples.sps) s.samples_with_sp += (sp != 0);
+  for (auto bp : samples.bps) s.samples_with_bp += (bp != 0);
 
-    tids.insert(sample.tid);
-    cpus.insert(sample.cpu);
-  }
+  tids.insert(samples.tids.begin(), samples.tids.end());
+  cpus.insert(samples.cpus.begin(), samples.cpus.end());
 
   s.unique_threads = tids.size();
   s.unique_cpus    = cpus.size();
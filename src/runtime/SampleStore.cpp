@@ -0,0 +1,131 @@
+#include "runtime/SampleStore.hpp"
+
+#include <algorithm>
+#include <bit>
+
+void SampleStore::push_back(const PerfSample& s, uint32_t keep_regs) {
+  tids.push_back(s.tid);
+  pids.push_back(s.pid);
+  cpus.push_back(s.cpu);
+  ips.push_back(s.ip);
+  addrs.push_back(s.addr);
+  sps.push_back(s.sp);
+  bps.push_back(s.bp);
+  times.push_back(s.time_stamp);
+  types.push_back(s.event_type);
+  symbol_ids.push_back(symbols.intern(s.symbol));
+  dso_ids.push_back(dsos.intern(s.dso));
+  ip_maps.push_back(s.ip_map);
+  addr_maps.push_back(s.addr_map);
+  sampled_regs |= s.regs_mask;
+
+  const auto row = static_cast<uint32_t>(tids.size() - 1);
+  keep_regs &= s.regs_mask & ~COLUMN_REGS;
+  for (; keep_regs; keep_regs &= keep_regs - 1) {
+    const auto n = static_cast<uint32_t>(std::countr_zero(keep_regs));
+    if (n < s.regs.size()) saved_regs.push_back({row, n, s.regs[n]});
+  }
+}
+
+std::optional<uint64_t> SampleStore::reg(size_t i, unsigned n) const {
+  if (n == DWARF_RIP) return ips[i];
+  if (n >= 32 || !(sampled_regs & 1u << n)) return std::nullopt;
+  if (n == DWARF_RSP) return sps[i];
+  if (n == DWARF_RBP) return bps[i];
+  auto it = std::ranges::lower_bound(saved_regs, i, {}, &SavedReg::row);
+  for (; it != saved_regs.end() && it->row == i; ++it) {
+    if (it->reg == n) return it->value;
+  }
+  return std::nullopt;
+}
+
+void SampleStore::reserve(size_t n) {
+  tids.reserve(n);
+  pids.reserve(n);
+  cpus.reserve(n);
+  ips.reserve(n);
+  addrs.reserve(n);
+  sps.reserve(n);
+  bps.reserve(n);
+  times.reserve(n);
+  types.reserve(n);
+  symbol_ids.reserve(n);
+  dso_ids.reserve(n);
+  ip_maps.reserve(n);
+  addr_maps.reserve(n);
+}
+
+namespace {
+
+template <typename T>
+void keep_even_rows(std::vector<T>& column) {
+  size_t out = 0;
+  for (size_t i = 0; i < column.size(); i += 2) column[out++] = column[i];
+  column.resize(out);
+}
+
+}  // namespace
+
+void SampleStore::thin() {
+  keep_even_rows(tids);
+  keep_even_rows(pids);
+  keep_even_rows(cpus);
+  keep_even_rows(ips);
+  keep_even_rows(addrs);
+  keep_even_rows(sps);
+  keep_even_rows(bps);
+  keep_even_rows(times);
+  keep_even_rows(types);
+  keep_even_rows(symbol_ids);
+  keep_even_rows(dso_ids);
+  keep_even_rows(ip_maps);
+  keep_even_rows(addr_maps);
+
+  std::erase_if(saved_regs, [](const SavedReg& r) { return r.row % 2; });
+  for (auto& r : saved_regs) r.row /= 2;
+}
+
+PerfSample SampleStore::at(size_t i) const {
+  PerfSample s{};
+  s.tid        = tids[i];
+  s.pid        = pids[i];
+  s.cpu        = cpus[i];
+  s.ip         = ips[i];
+  s.addr       = addrs[i];
+  s.sp         = sps[i];
+  s.bp         = bps[i];
+  s.time_stamp = times[i];
+  s.event_type = types[i];
+  s.symbol     = symbol(i);
+  s.dso        = dso(i);
+  s.ip_map     = ip_maps[i];
+  s.addr_map   = addr_maps[i];
+  s.regs[DWARF_RSP] = s.sp;
+  s.regs[DWARF_RBP] = s.bp;
+  s.regs_mask       = sampled_regs & COLUMN_REGS & ~(1u << DWARF_RIP);
+
+  auto it = std::ranges::lower_bound(saved_regs, i, {}, &SavedReg::row);
+  for (; it != saved_regs.end() && it->row == i; ++it) {
+    s.regs[it->reg] = it->value;
+    s.regs_mask |= 1u << it->reg;
+  }
+  return s;
+}
+
+size_t SampleStore::memory_bytes() const {
+  return tids.capacity() * sizeof(uint32_t) +
+         pids.capacity() * sizeof(uint32_t) +
+         cpus.capacity() * sizeof(uint32_t) +
+         ips.capacity() * sizeof(uint64_t) +
+         addrs.capacity() * sizeof(uint64_t) +
+         sps.capacity() * sizeof(uint64_t) +
+         bps.capacity() * sizeof(uint64_t) +
+         times.capacity() * sizeof(uint64_t) +
+         types.capacity() * sizeof(SampleType) +
+         symbol_ids.capacity() * sizeof(uint32_t) +
+         dso_ids.capacity() * sizeof(uint32_t) +
+         ip_maps.capacity() * sizeof(uint32_t) +
+         addr_maps.capacity() * sizeof(uint32_t) +
+         saved_regs.capacity() * sizeof(SavedReg) + symbols.memory_bytes() +
+         dsos.memory_bytes() + address_space.size() * sizeof(Mapping);
+}
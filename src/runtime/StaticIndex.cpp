@@ -0,0 +1,33 @@
+#include "runtime/StaticIndex.hpp"
+
+#include <algorithm>
+
+StaticIndex::StaticIndex(const std::vector<DwarfGlobalObject>& objects) {
+  ranges_.reserve(objects.size());
+  for (const auto& obj : objects) {
+    if (obj.size == 0) continue;
+    ranges_.push_back({obj.addr, obj.addr + obj.size, &obj});
+  }
+  // Larger objects first among equal starts, so aliases of a prefix lose.
+  std::ranges::sort(ranges_, [](const auto& a, const auto& b) {
+    if (a.start != b.start) return a.start < b.start;
+    return a.end > b.end;
+  });
+
+  // An object that overlaps its predecessor (the same variable seen in
+  // several compile units, or an alias) is dropped.
+  std::vector<StaticRange> kept;
+  kept.reserve(ranges_.size());
+  for (const auto& r : ranges_) {
+    if (!kept.empty() && r.start < kept.back().end) continue;
+    kept.push_back(r);
+  }
+  ranges_ = std::move(kept);
+}
+
+const StaticRange* StaticIndex::find(uint64_t addr) const {
+  auto it = std::ranges::upper_bound(ranges_, addr, {}, &StaticRange::start);
+  if (it == ranges_.begin()) return nullptr;
+  --it;
+  return addr < it->end ? &*it : nullptr;
+}
@@ -0,0 +1,189 @@
+#include "runtime/TransferMatrix.hpp"
+
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "runtime/FalseSharingAnalysis.hpp"
+#include "runtime/SampleStore.hpp"
+
+void TransferMatrix::add(uint32_t from, uint32_t to, uint64_t n) {
+  cells_[key(from, to)] += n;
+  total_ += n;
+}
+
+void TransferMatrix::merge(const TransferMatrix& other) {
+  for (const auto& [k, n] : other.cells_) cells_[k] += n;
+  total_ += other.total_;
+}
+
+uint64_t TransferMatrix::at(uint32_t from, uint32_t to) const {
+  auto it = cells_.find(key(from, to));
+  return it == cells_.end() ? 0 : it->second;
+}
+
+std::vector<uint32_t> TransferMatrix::tids() const {
+  std::vector<uint32_t> out;
+  for (const auto& [k, n] : cells_) {
+    out.push_back(static_cast<uint32_t>(k >> 32));
+    out.push_back(static_cast<uint32_t>(k));
+  }
+  std::ranges::sort(out);
+  out.erase(std::unique(out.begin(), out.end()), out.end());
+  return out;
+}
+
+std::vector<TransferMatrix::Cell> TransferMatrix::ranked() const {
+  std::vector<Cell> out;
+  out.reserve(cells_.size());
+  for (const auto& [k, n] : cells_) {
+    out.push_back(
+      {static_cast<uint32_t>(k >> 32), static_cast<uint32_t>(k), n});
+  }
+  std::ranges::sort(out, [](const Cell& a, const Cell& b) {
+    if (a.count != b.count) return a.count > b.count;
+    if (a.from != b.from) return a.from < b.from;
+    return a.to < b.to;
+  });
+  return out;
+}
+
+ContentionMatrices ContentionMatrices::build(
+  const SampleStore& samples, const std::vector<CacheLine>& hot_lines,
+  bool hot_only) {
+  ContentionMatrices out;
+  out.hot_only = hot_only;
+  out.lines.resize(hot_lines.size());
+  FlatMap<uint64_t, size_t> index;
+  for (size_t i = 0; i < hot_lines.size(); ++i) {
+    index.emplace(hot_lines[i].base_addr, i);
+    out.line_addrs.push_back(hot_lines[i].base_addr);
+  }
+
+  // Last toucher per line; 0 before the first touch (tid 0 is the idle
+  // task and never owns user data).
+  FlatMap<uint64_t, uint32_t> last;
+  constexpr uint64_t LINE = FalseSharingAnalysis::CACHE_LINE_SIZE;
+  for (size_t i = 0; i < samples.size(); ++i) {
+    if (samples.addrs[i] == 0) continue;
+    const uint64_t base = samples.addrs[i] / LINE * LINE;
+    const auto it       = index.find(base);
+    if (hot_only && it == index.end()) continue;
+    const uint32_t tid = samples.tids[i];
+    uint32_t& prev     = last[base];
+    if (prev != 0 && prev != tid) {
+      out.all.add(prev, tid);
+      if (it != index.end()) out.lines[it->second].add(prev, tid);
+    }
+    prev = tid;
+  }
+  return out;
+}
+
+static std::string top_cells(const TransferMatrix& m, size_t max_cells) {
+  std::string out;
+  const auto cells = m.ranked();
+  for (size_t i = 0; i < std::min(cells.size(), max_cells); ++i) {
+    out += std::format("{}{}->{} x{}", i ? ", " : "", cells[i].from,
+                       cells[i].to, cells[i].count);
+  }
+  return out;
+}
+
+void ContentionMatrices::print(size_t max_scopes, size_t max_cells) const {
+  std::cout << "=== Thread Contention ===\n\n";
+  std::cout << std::format(
+    "{}: {} transfers between {} threads\n  {}\n\n",
+    hot_only ? "Hot lines" : "All lines", all.total(), all.tids().size(),
+    all.empty() ? "(none)" : top_cells(all, 10));
+
+  for (size_t i = 0; i < std::min(lines.size(), max_scopes); ++i) {
+    if (lines[i].empty()) continue;
+    std::cout << std::format("Cache line 0x{:x}: {} transfers; {}\n",
+                             line_addrs[i], lines[i].total(),
+                             top_cells(lines[i], max_cells));
+  }
+
+  std::vector<const std::pair<std::string, TransferMatrix>*> ranked;
+  for (const auto& o : objects) {
+    if (!o.second.empty()) ranked.push_back(&o);
+  }
+  std::ranges::sort(ranked, [](const auto* a, const auto* b) {
+    if (a->second.total() != b->second.total())
+      return a->second.total() > b->second.total();
+    return a->first < b->first;
+  });
+  for (size_t i = 0; i < std::min(ranked.size(), max_scopes); ++i) {
+    const auto& [name, m] = *ranked[i];
+    std::cout << std::format("Object {}: {} transfers; {}\n", name, m.total(),
+                             top_cells(m, max_cells));
+  }
+  std::cout << "\n";
+}
+
+static std::string json_escape(const std::string& s) {
+  std::string out;
+  for (const char c : s) {
+    if (c == '"' || c == '\\') out += '\\';
+    if (static_cast<unsigned char>(c) < 0x20) {
+      out += std::format("\\u{:04x}",
+                         static_cast<unsigned>(static_cast<unsigned char>(c)));
+      continue;
+    }
+    out += c;
+  }
+  return out;
+}
+
+// Object names can contain commas and quotes (templates, operators).
+static std::string csv_field(const std::string& s) {
+  if (s.find_first_of(",\"\n") == std::string::npos) return s;
+  std::string out = "\"";
+  for (const char c : s) {
+    if (c == '"') out += '"';
+    out += c;
+  }
+  return out + "\"";
+}
+
+void ContentionMatrices::save(const std::string& path) const {
+  std::ofstream out(path);
+  if (!out) throw std::runtime_error(std::format("cannot write {}", path));
+
+  std::vector<std::pair<std::string, const TransferMatrix*>> scopes;
+  scopes.emplace_back(hot_only ? "hot" : "all", &all);
+  for (size_t i = 0; i < lines.size(); ++i)
+    scopes.emplace_back(std::format("line:0x{:x}", line_addrs[i]), &lines[i]);
+  for (const auto& [name, m] : objects)
+    scopes.emplace_back("object:" + name, &m);
+
+  if (path.ends_with(".json")) {
+    out << "{\"scopes\": [";
+    for (size_t s = 0; s < scopes.size(); ++s) {
+      const auto& [scope, m] = scopes[s];
+      out << std::format("{}\n  {{\"scope\": \"{}\", \"tids\": [",
+                         s ? "," : "", json_escape(scope));
+      const auto tids = m->tids();
+      for (size_t i = 0; i < tids.size(); ++i)
+        out << (i ? ", " : "") << tids[i];
+      out << "], \"cells\": [";
+      const auto cells = m->ranked();
+      for (size_t i = 0; i < cells.size(); ++i) {
+        out << std::format("{}[{}, {}, {}]", i ? ", " : "", cells[i].from,
+                           cells[i].to, cells[i].count);
+      }
+      out << "]}";
+    }
+    out << "\n]}\n";
+  } else {
+    out << "scope,from_tid,to_tid,transfers\n";
+    for (const auto& [scope, m] : scopes) {
+      const auto field = csv_field(scope);
+      for (const auto& c : m->ranked())
+        out << std::format("{},{},{},{}\n", field, c.from, c.to, c.count);
+    }
+  }
+  if (!out) throw std::runtime_error(std::format("error writing {}", path));
+}
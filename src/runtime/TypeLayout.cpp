@@ -0,0 +1,184 @@
+#include "runtime/TypeLayout.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <format>
+
+using Leaf = TypeLayout::Leaf;
+
+// "__x" and "_X" are reserved for the implementation.
+static bool is_reserved(const std::string& name) {
+  return name.size() > 1 && name[0] == '_' &&
+         (name[1] == '_' || std::isupper(static_cast<unsigned char>(name[1])));
+}
+
+static const TypeInfo* strip(const TypeInfo* type) {
+  for (int i = 0; type && i < TypeLayouts::MAX_DEPTH; ++i) {
+    if (type->kind != TypeKind::Typedef && type->kind != TypeKind::Const &&
+        type->kind != TypeKind::Volatile)
+      return type;
+    type = type->pointee;
+  }
+  return nullptr;
+}
+
+static bool is_aggregate(const TypeInfo* type) {
+  return type->kind == TypeKind::Struct || type->kind == TypeKind::Class ||
+         type->kind == TypeKind::Union || type->kind == TypeKind::Array;
+}
+
+std::string TypeLayout::resolve(uint64_t offset) const {
+  auto it = std::ranges::upper_bound(leaves_, offset, {}, &Leaf::begin);
+  if (it == leaves_.begin()) return {};
+  --it;
+  if (offset >= it->end) return {};
+  if (it->stride == 0) return it->path;
+
+  const uint64_t rel = offset - it->origin;
+  auto out           = std::format("{}[{}]", it->path, rel / it->stride);
+  if (it->element) out += it->element->resolve(rel % it->stride);
+  return out;
+}
+
+void TypeLayouts::flatten(const TypeInfo* type, uint64_t base,
+                          const std::string& path, int depth,
+                          std::vector<Leaf>& out) {
+  type = strip(type);
+  if (!type || type->size == 0) return;
+
+  if (depth < MAX_DEPTH && type->kind == TypeKind::Array) {
+    const TypeInfo* elem = strip(type->element);
+    if (elem && elem->size > 0) {
+      const TypeLayout* layout =
+        is_aggregate(elem) ? &of(type->element) : nullptr;
+      out.push_back(
+        {base, base + type->size, path, elem->size, base, layout});
+      return;
+    }
+  }
+
+  // Library internals (std::atomic's _M_i) make their enclosing member the
+  // leaf, as do aggregates without members.
+  const bool descend =
+    depth < MAX_DEPTH &&
+    (type->kind == TypeKind::Struct || type->kind == TypeKind::Class ||
+     type->kind == TypeKind::Union) &&
+    !(type->fields.empty() && type->bases.empty()) &&
+    std::ranges::none_of(type->fields,
+                         [](const auto* f) { return is_reserved(f->name); });
+  if (!descend) {
+    out.push_back({base, base + type->size, path});
+    return;
+  }
+
+  for (const FieldInfo* b : type->bases)
+    flatten(b->type, base + b->offset, path, depth + 1, out);
+  for (const FieldInfo* f : type->fields) {
+    // Anonymous structs and unions lend their members to the parent.
+    const auto name =
+      f->name == "<anonymous>" ? path : std::format("{}.{}", path, f->name);
+    if (f->bit_size == 0) {
+      flatten(f->type, base + f->offset, name, depth + 1, out);
+    } else if (f->size > 0) {
+      out.push_back({base + f->offset, base + f->offset + f->size,
+                     std::format("{}:{}", name, f->bit_size)});
+    }
+  }
+}
+
+// Every member covering [begin, end), under the longest common member
+// prefix: ".u.{i | f}".
+static std::string shared_path(const std::vector<const Leaf*>& covering) {
+  std::vector<std::string> paths;
+  for (const Leaf* l : covering)
+    paths.push_back(l->stride ? l->path + "[]" : l->path);
+
+  size_t common = paths[0].size();
+  for (const auto& p : paths) {
+    size_t n = 0;
+    while (n < common && n < p.size() && p[n] == paths[0][n]) ++n;
+    common = n;
+  }
+  const auto dot = common ? paths[0].rfind('.', common - 1) : std::string::npos;
+  common         = dot == std::string::npos ? 0 : dot + 1;
+
+  std::string out = paths[0].substr(0, common) + "{";
+  for (size_t i = 0; i < paths.size(); ++i)
+    out += (i ? " | " : "") + paths[i].substr(common);
+  return out + "}";
+}
+
+// Sorts the leaves and splits overlapping ones at every boundary, so each
+// byte range names all the members sharing it.
+static std::vector<Leaf> disjoint(std::vector<Leaf> leaves) {
+  std::ranges::sort(leaves, [](const Leaf& a, const Leaf& b) {
+    if (a.begin != b.begin) return a.begin < b.begin;
+    return a.end < b.end;
+  });
+
+  std::vector<Leaf> out;
+  out.reserve(leaves.size());
+  for (size_t i = 0; i < leaves.size();) {
+    // A cluster of leaves chained by overlap.
+    size_t j     = i + 1;
+    uint64_t end = leaves[i].end;
+    for (; j < leaves.size() && leaves[j].begin < end; ++j)
+      end = std::max(end, leaves[j].end);
+    if (j == i + 1) {
+      out.push_back(std::move(leaves[i]));
+      i = j;
+      continue;
+    }
+
+    std::vector<uint64_t> cuts;
+    for (size_t k = i; k < j; ++k) {
+      cuts.push_back(leaves[k].begin);
+      cuts.push_back(leaves[k].end);
+    }
+    std::ranges::sort(cuts);
+    cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+
+    for (size_t c = 0; c + 1 < cuts.size(); ++c) {
+      std::vector<const Leaf*> covering;
+      for (size_t k = i; k < j; ++k) {
+        if (leaves[k].begin <= cuts[c] && cuts[c + 1] <= leaves[k].end)
+          covering.push_back(&leaves[k]);
+      }
+      if (covering.empty()) continue;
+
+      Leaf piece;
+      if (covering.size() == 1)
+        piece = *covering[0];
+      else
+        piece.path = shared_path(covering);
+      piece.begin = cuts[c];
+      piece.end   = cuts[c + 1];
+
+      Leaf* prev = out.empty() ? nullptr : &out.back();
+      if (prev && prev->end == piece.begin && prev->path == piece.path &&
+          prev->stride == piece.stride && prev->origin == piece.origin)
+        prev->end = piece.end;
+      else
+        out.push_back(std::move(piece));
+    }
+    i = j;
+  }
+  return out;
+}
+
+const TypeLayout& TypeLayouts::of(const TypeInfo* type) {
+  static const TypeLayout EMPTY;
+  if (!type) return EMPTY;
+  if (auto it = layouts_.find(type); it != layouts_.end()) return *it->second;
+
+  // Registered before it is built: a type reached again through its own
+  // members sees an empty layout instead of recursing.
+  auto owned         = std::make_unique<TypeLayout>();
+  TypeLayout* layout = owned.get();
+  layouts_.emplace(type, std::move(owned));
+
+  std::vector<Leaf> leaves;
+  flatten(type, 0, "", 0, leaves);
+  layout->leaves_ = disjoint(std::move(leaves));
+  return *layout;
+}